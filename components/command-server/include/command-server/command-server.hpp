@@ -0,0 +1,358 @@
+#pragma once
+#include "esp_log.h"
+#include <algorithm>
+#include <any>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <logic/logic.hpp>
+#include <memory>
+#include <message-queue/interfaces.hpp>
+#include <mqtt-helper/mqtt-helper.hpp>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <utils/text-writer.hpp>
+#include <utils/utils.hpp>
+#include <vector>
+#include <weight-meter/weight-meter.hpp>
+
+/// @brief Runs remote commands received over MQTT
+///
+/// A request is a publish to `<prefix>/req/<command>/<id>`, the payload holds
+/// the arguments separated by spaces, `[meter]` is a weight meter instance
+/// and 0 if omitted:
+///
+/// | command     | arguments          | event                             |
+/// |-------------|--------------------|-----------------------------------|
+/// | `read`      | `[meter]`          | #WeightMeter::Event::eReadCmd     |
+/// | `tare`      | `[meter]`          | #WeightMeter::Event::eTare        |
+/// | `calibrate` | `<grams> [meter]`  | #WeightMeter::Event::eCalibrate   |
+/// | `capture`   | `<seconds> [meter]`| #WeightMeter::Event::eStartCapture|
+/// | `flush`     |                    | #Logic::Event::eFlushTelemetry    |
+///
+/// The reply goes to `<prefix>/rsp/<id>`:
+/// `{"id":<id>,"cmd":<command>,"status":<status>,"us":<time>,...}` where the
+/// time is from the arrival of the request to the reply and the status is
+/// one of `ok`, `unstable` (a tare or a calibration was refused), `invalid`,
+/// `unknown`, `busy`, `error` (a capture could not be started) and
+/// `timeout`. A `flush` is replied as soon as it is queued, a `capture` when
+/// the capture ends. A capture is up to #Capture::MAX_DURATION long.
+///
+/// The requests and the commands are queued at the priority 0, ahead of the
+/// telemetry.
+class CommandServer final : public mq::ISystem {
+  static constexpr const char *TAG = "COMMAND-SERVER";
+  static constexpr unsigned PRIORITY = 0U;
+  static constexpr std::size_t MAX_PENDING = 8U;
+  static constexpr std::size_t MAX_ID_SIZE = 64U;
+  /// the replies of the systems come to the events from this one on, the
+  /// event is the token of the command
+  static constexpr decltype(mq::Addr::ev) FIRST_TOKEN = 0x100U;
+
+public:
+  enum class Event : decltype(mq::Addr::ev) {
+    eRequest, ///< #Request
+    eTimeout, ///< the token of a pending command
+  };
+
+  /// @brief The payload of #Event::eRequest
+  struct Request {
+    mqtt::InboundMessage message;
+    mq::IClock::time_point received;
+  };
+
+  struct Config {
+    std::string prefix;      ///< of the request and reply topics
+    std::string capturePath; ///< the file of the `capture` command
+    std::chrono::milliseconds timeout; ///< for the reply of a system
+  };
+
+  /// @throws std::invalid_argument if the request filter is already handled
+  /// by the client
+  CommandServer(mq::IContext &ctx, mq::IScheduler &scheduler,
+                std::shared_ptr<mqtt::Client> mqttClient, Config config)
+      : m_ctx{ctx}, m_scheduler{scheduler},
+        m_mqttClient{std::move(mqttClient)}, m_config{std::move(config)},
+        m_filter{m_config.prefix + "/req/+/+"} {
+    if (!m_mqttClient)
+      throw std::invalid_argument{"the MQTT client can not be null"};
+    m_pending.reserve(MAX_PENDING);
+    // a handler may still be running when the server is destroyed, so it
+    // captures only the context and the clock
+    const bool added = m_mqttClient->AddFilterHandler(
+        m_filter, [&ctx = m_ctx, &clock = m_scheduler.GetClock()](
+                      const mqtt::InboundMessage &message) {
+          const auto received = clock.Now();
+          ctx.Push(mq::Message{mq::NONE,
+                               mq::Addr{mq::Id::eCommandServer,
+                                        utils::EnumValue(Event::eRequest)},
+                               Request{message, received}},
+                   PRIORITY);
+        });
+    if (!added)
+      throw std::invalid_argument{"the topic filter is already handled"};
+    m_mqttClient->Subscribe(m_filter, mqtt::QoS::e1);
+  }
+
+  ~CommandServer() override {
+    m_mqttClient->RemoveFilterHandler(m_filter);
+    m_mqttClient->Unsubscribe(m_filter);
+  }
+
+  void Process(const mq::Message &msg) override {
+    if (msg.to.sys != GetId())
+      return;
+    switch (msg.to.ev) {
+    case utils::EnumValue(Event::eRequest):
+      if (const auto *request = std::any_cast<Request>(&msg.data))
+        m_OnRequest(*request);
+      break;
+    case utils::EnumValue(Event::eTimeout):
+      if (const auto *token =
+              std::any_cast<decltype(mq::Addr::ev)>(&msg.data))
+        if (auto it = m_FindPending(*token); it != m_pending.end()) {
+          m_Reply(it->id, m_Name(it->command), it->received, "timeout");
+          m_pending.erase(it);
+        }
+      break;
+    default:
+      if (auto it = m_FindPending(msg.to.ev); it != m_pending.end()) {
+        m_OnResult(*it, msg.data);
+        m_pending.erase(it);
+      }
+      break;
+    }
+  }
+
+  [[nodiscard]] mq::Id GetId() const noexcept final {
+    return mq::Id::eCommandServer;
+  }
+
+private:
+  enum class Command : std::uint8_t {
+    eRead,
+    eTare,
+    eCalibrate,
+    eCapture,
+    eFlush,
+  };
+  static constexpr std::array<std::string_view, 5> COMMANDS{
+      "read", "tare", "calibrate", "capture", "flush"};
+
+  struct Pending {
+    decltype(mq::Addr::ev) token;
+    Command command;
+    std::string id;
+    mq::IClock::time_point received;
+  };
+
+  mq::IContext &m_ctx;
+  mq::IScheduler &m_scheduler;
+  std::shared_ptr<mqtt::Client> m_mqttClient;
+  const Config m_config;
+  const std::string m_filter;
+  std::vector<Pending> m_pending;
+  decltype(mq::Addr::ev) m_nextToken{FIRST_TOKEN};
+  std::array<char, 512> m_text{}; // the reply buffer
+  std::string m_replyTopic;
+
+  [[nodiscard]] static std::string_view m_Name(Command command) noexcept {
+    return COMMANDS[utils::EnumValue(command)];
+  }
+
+  [[nodiscard]] std::vector<Pending>::iterator
+  m_FindPending(decltype(mq::Addr::ev) token) {
+    return std::find_if(m_pending.begin(), m_pending.end(),
+                        [token](const auto &p) { return p.token == token; });
+  }
+
+  /// Split off the first argument
+  [[nodiscard]] static std::string_view m_NextArg(std::string_view &args) {
+    const auto begin = std::min(args.find_first_not_of(' '), args.size());
+    const auto end = std::min(args.find(' ', begin), args.size());
+    const auto arg = args.substr(begin, end - begin);
+    args.remove_prefix(end);
+    return arg;
+  }
+
+  [[nodiscard]] static std::optional<std::uint8_t>
+  m_ParseMeter(std::string_view arg) {
+    std::uint8_t instance{};
+    if (arg.empty())
+      return instance;
+    const auto [end, error] =
+        std::from_chars(arg.data(), arg.data() + arg.size(), instance);
+    if (error != std::errc{} || end != arg.data() + arg.size())
+      return std::nullopt;
+    return instance;
+  }
+
+  [[nodiscard]] static std::optional<float>
+  m_ParseFloat(std::string_view arg) {
+    // no floating point from_chars in this toolchain
+    std::array<char, 32> text{};
+    if (arg.empty() || arg.size() >= text.size())
+      return std::nullopt;
+    std::copy(arg.cbegin(), arg.cend(), text.begin());
+    char *end{};
+    const auto value = std::strtof(text.data(), &end);
+    if (end != text.data() + arg.size() || !std::isfinite(value))
+      return std::nullopt;
+    return value;
+  }
+
+  void m_OnRequest(const Request &request) {
+    // <prefix>/req/<command>/<id>
+    const auto topic = request.message.GetTopic();
+    auto rest = topic.substr(std::min(m_filter.size() - 3U, topic.size()));
+    const auto slash = std::min(rest.find('/'), rest.size());
+    const auto name = rest.substr(0, slash);
+    const auto id = rest.substr(std::min(slash + 1U, rest.size()));
+    if (id.empty() || id.size() > MAX_ID_SIZE) {
+      ESP_LOGW(TAG, "Invalid command ID in %.*s",
+               static_cast<int>(topic.size()), topic.data());
+      return;
+    }
+    const auto it = std::find(COMMANDS.cbegin(), COMMANDS.cend(), name);
+    if (it == COMMANDS.cend()) {
+      m_Reply(id, name, request.received, "unknown");
+      return;
+    }
+    const auto command = static_cast<Command>(it - COMMANDS.cbegin());
+    if (m_pending.size() == MAX_PENDING) {
+      m_Reply(id, name, request.received, "busy");
+      return;
+    }
+
+    auto args = request.message.GetPayload();
+    mq::Addr to{mq::NONE};
+    std::any data;
+    std::optional<float> value;
+    auto timeout = m_config.timeout;
+    if (command == Command::eCalibrate || command == Command::eCapture) {
+      value = m_ParseFloat(m_NextArg(args));
+      if (!value || *value <= 0.f) {
+        m_Reply(id, name, request.received, "invalid");
+        return;
+      }
+    }
+    const auto meter = m_ParseMeter(m_NextArg(args));
+    if (!meter || !m_NextArg(args).empty()) {
+      m_Reply(id, name, request.received, "invalid");
+      return;
+    }
+    const auto meterId = mq::MakeId(mq::Id::eWeightMeter, *meter);
+
+    switch (command) {
+    case Command::eRead:
+      to = mq::Addr{meterId, utils::EnumValue(WeightMeter::Event::eReadCmd)};
+      break;
+    case Command::eTare:
+      to = mq::Addr{meterId, utils::EnumValue(WeightMeter::Event::eTare)};
+      break;
+    case Command::eCalibrate:
+      to = mq::Addr{meterId, utils::EnumValue(WeightMeter::Event::eCalibrate)};
+      data = *value;
+      break;
+    case Command::eCapture: {
+      // the timestamps of the capture can't represent a longer one
+      if (*value > static_cast<float>(Capture::MAX_DURATION.count())) {
+        m_Reply(id, name, request.received, "invalid");
+        return;
+      }
+      const auto duration = std::chrono::seconds{
+          static_cast<std::chrono::seconds::rep>(std::ceil(*value))};
+      to = mq::Addr{meterId,
+                    utils::EnumValue(WeightMeter::Event::eStartCapture)};
+      data = WeightMeter::CaptureRequest{m_config.capturePath, duration};
+      timeout += duration;
+    } break;
+    case Command::eFlush:
+      m_ctx.Push(mq::Message{mq::Addr{GetId(), 0},
+                             mq::Addr{mq::Id::eLogic,
+                                      utils::EnumValue(
+                                          Logic::Event::eFlushTelemetry)},
+                             {}},
+                 PRIORITY);
+      m_Reply(id, name, request.received, "ok");
+      return;
+    }
+
+    const auto token = m_NextToken();
+    m_pending.push_back(
+        Pending{token, command, std::string{id}, request.received});
+    m_ctx.Push(mq::Message{mq::Addr{GetId(), token}, to, std::move(data)},
+               PRIORITY);
+    m_scheduler.ScheduleAfter(
+        mq::Message{mq::NONE,
+                    mq::Addr{GetId(), utils::EnumValue(Event::eTimeout)},
+                    token},
+        m_ctx.GetNumPriorities() - 1, timeout);
+  }
+
+  [[nodiscard]] decltype(mq::Addr::ev) m_NextToken() {
+    auto token = m_nextToken;
+    while (m_FindPending(token) != m_pending.end())
+      token = token == UINT16_MAX ? FIRST_TOKEN : token + 1U;
+    m_nextToken = token == UINT16_MAX ? FIRST_TOKEN : token + 1U;
+    return token;
+  }
+
+  void m_OnResult(const Pending &pending, const std::any &data) {
+    const auto reply = [&](std::string_view status, auto &&fields) {
+      m_Reply(pending.id, m_Name(pending.command), pending.received, status,
+              fields);
+    };
+    if (const auto *reading = std::any_cast<WeightMeter::Reading>(&data))
+      reply("ok", [reading](utils::JsonWriter &json) {
+        json.Key("g").Fixed(reading->grams, 1U);
+        json.Key("q").Value(utils::EnumValue(reading->quality));
+        json.Key("age").Value(reading->age.count());
+      });
+    else if (const auto *result =
+                 std::any_cast<WeightMeter::CalibrationResult>(&data))
+      reply(result->done ? "ok" : "unstable",
+            [&calibration = result->calibration](utils::JsonWriter &json) {
+              json.Key("zero").Fixed(calibration.zero, 1U);
+              json.Key("gain").Fixed(calibration.gain, 6U);
+            });
+    else if (const auto *stats = std::any_cast<Capture::Stats>(&data))
+      reply(stats->failed ? "error" : "ok", [stats](utils::JsonWriter &json) {
+        json.Key("samples").Value(stats->samples);
+        json.Key("drops").Value(stats->drops);
+        json.Key("maxFill").Value(stats->maxFill);
+      });
+    else
+      ESP_LOGW(TAG, "Unexpected reply to %s", pending.id.c_str());
+  }
+
+  template <typename Fields = void (*)(utils::JsonWriter &)>
+  void m_Reply(
+      std::string_view id, std::string_view command,
+      mq::IClock::time_point received, std::string_view status,
+      Fields &&fields = [](utils::JsonWriter &) {}) {
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        m_scheduler.GetClock().Now() - received);
+    utils::TextWriter text{m_text};
+    utils::JsonWriter json{text};
+    json.BeginObject().Key("id").Value(id).Key("cmd").Value(command);
+    json.Key("status").Value(status).Key("us").Value(us.count());
+    fields(json);
+    json.EndObject();
+    if (text.IsOverflow()) {
+      ESP_LOGE(TAG, "The reply to %.*s is too long",
+               static_cast<int>(id.size()), id.data());
+      return;
+    }
+    m_replyTopic.assign(m_config.prefix).append("/rsp/").append(id);
+    if (m_mqttClient->PublishAsync(m_replyTopic, text.View(), mqtt::QoS::e1) ==
+        mqtt::Client::ERROR_ID)
+      ESP_LOGW(TAG, "Failed to reply to %s", m_replyTopic.c_str());
+  }
+};
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <driver/gpio.h>
+#include <optional>
 #include <rom/ets_sys.h>
 #include <rom/gpio.h>
 #include <thread>
@@ -47,9 +51,62 @@ public:
     gpio_set_level(m_pd_sck, LOW);
     // wait for the chip to become ready
     while (IsReady()) {
-      std::this_thread::sleep_for(std::chrono::milliseconds{10});
+      std::this_thread::sleep_for(POLL_PERIOD);
     }
+    return m_ShiftIn();
+  }
+
+  /// @brief Wait for the conversion at most the timeout
+  ///
+  /// @return std::nullopt if the chip is not ready in time, e.g. when it is
+  /// disconnected and DOUT stays high
+  [[nodiscard]] std::optional<std::uint32_t>
+  Read(std::chrono::milliseconds timeout) const {
+    gpio_set_level(m_pd_sck, LOW);
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (IsReady()) {
+      const auto now = std::chrono::steady_clock::now();
+      if (now >= deadline)
+        return std::nullopt;
+      std::this_thread::sleep_for(
+          std::min<std::chrono::steady_clock::duration>(POLL_PERIOD,
+                                                        deadline - now));
+    }
+    return m_ShiftIn();
+  }
+
+  [[nodiscard]] std::uint32_t ReadAverage(std::uint8_t times) const {
+    std::uint32_t sum{};
+    for (std::uint8_t i{}; i < times; i++) {
+      sum += Read();
+    }
+    return sum / static_cast<std::uint32_t>(times);
+  }
 
+  [[nodiscard]] std::uint32_t GetValue(std::uint8_t times) const {
+    std::uint32_t avg = ReadAverage(times);
+    return (avg > m_offset) ? (avg - m_offset) : 0UL;
+  }
+
+  [[nodiscard]] float GetUnits(std::uint8_t times) const {
+    return static_cast<float>(GetValue(times)) / RAW_TO_GRAMMS;
+  }
+
+  [[nodiscard]] float ToUnits(std::uint32_t raw) const {
+    return static_cast<float>((raw > m_offset) ? (raw - m_offset) : 0UL) /
+           RAW_TO_GRAMMS;
+  }
+
+private:
+  static constexpr std::chrono::milliseconds POLL_PERIOD{10};
+
+  gpio_num_t m_dout;
+  gpio_num_t m_pd_sck;
+  Gain m_gain;
+  std::uint32_t m_offset{}; // used for tare weight
+
+  /// Clock the ready conversion out
+  [[nodiscard]] std::uint32_t m_ShiftIn() const {
     std::uint32_t ret{};
     portDISABLE_INTERRUPTS();
 
@@ -78,27 +135,4 @@ public:
 
     return ret;
   }
-
-  [[nodiscard]] std::uint32_t ReadAverage(std::uint8_t times) const {
-    std::uint32_t sum{};
-    for (std::uint8_t i{}; i < times; i++) {
-      sum += Read();
-    }
-    return sum / static_cast<std::uint32_t>(times);
-  }
-
-  [[nodiscard]] std::uint32_t GetValue(std::uint8_t times) const {
-    std::uint32_t avg = ReadAverage(times);
-    return (avg > m_offset) ? (avg - m_offset) : 0UL;
-  }
-
-  [[nodiscard]] float GetUnits(std::uint8_t times) const {
-    return static_cast<float>(GetValue(times)) / RAW_TO_GRAMMS;
-  }
-
-private:
-  gpio_num_t m_dout;
-  gpio_num_t m_pd_sck;
-  Gain m_gain;
-  std::uint32_t m_offset{}; // used for tare weight
 };
@@ -0,0 +1,310 @@
+#pragma once
+#include "logger/logger.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <gsl/span>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utils/crc.hpp>
+#include <utils/utils.hpp>
+#ifdef ESP_PLATFORM
+#include <esp_system.h>
+#else
+#include <random>
+#endif
+
+/// @brief Crash-consistent records on top of a #Logger
+///
+/// Every record describes itself with a header:
+///
+/// | offset | size | field                                           |
+/// |--------|------|-------------------------------------------------|
+/// | 0      | 2    | #MAGIC                                          |
+/// | 2      | 1    | the type, #Type                                 |
+/// | 4      | 2    | the payload length                              |
+/// | 8      | 4    | the sequence number, one more than the last one |
+/// | 12     | 4    | CRC-32 of the first 12 bytes and the payload    |
+///
+/// The other bytes are zero and all the fields are little-endian. A
+/// checkpoint record starts every run and follows every
+/// #Config::checkpointInterval bytes. It holds its own file offset as u64
+/// and a random number of the run as u32, the CRC of the data records
+/// continues from it.
+///
+/// A power loss may leave a torn record or stale clusters at the end of the
+/// file. #Recover, run at mount time before the journal is opened, searches
+/// back from the end for the last valid checkpoint, validates the records
+/// after it and truncates the file after the last valid one, so it takes a
+/// time proportional to the tail, not to the file. The offsets, the sequence
+/// numbers and the number of the run tell the stale records of another file
+/// or run from the new ones. A file without a checkpoint is not a journal
+/// and it is kept as it is.
+///
+/// The durability is set by the #Logger::Config: with
+/// #Logger::Config::flushPartial, a power loss loses at most the sync
+/// interval of records.
+class Journal {
+public:
+  static constexpr std::uint16_t MAGIC = 0x4C4AU; // "JL"
+  static constexpr std::size_t HEADER_SIZE = 16U;
+  static constexpr std::size_t MAX_PAYLOAD = UINT16_MAX;
+
+  enum class Type : std::uint8_t {
+    eData,
+    eCheckpoint, ///< the offset of the record and the run
+  };
+
+  struct Config {
+    Logger::Config logger;          ///< always appends
+    std::size_t checkpointInterval; ///< in bytes
+  };
+  static constexpr Config DEFAULT_CONFIG{
+      {Logger::CLUSTER_SIZE, 2U, std::chrono::seconds{1}, 1, false, true},
+      Logger::CLUSTER_SIZE};
+
+  struct Recovery {
+    std::uint64_t size;    ///< of the valid records
+    std::uint64_t dropped; ///< the bytes truncated after them
+    std::uint64_t scanned; ///< the bytes read by the recovery
+    std::uint32_t nextSequence;
+  };
+
+  /// @brief Recover the file, see #Recover, and append to it
+  Journal(const char *path, const Config &config)
+      : m_config{config}, m_recovery{Recover(path)},
+        m_offset{m_recovery.size}, m_sequence{m_recovery.nextSequence},
+        m_run{m_NewRun()}, m_logger{path, m_LoggerConfig(config.logger)} {
+    if (!config.checkpointInterval)
+      throw std::invalid_argument{"invalid checkpoint interval"};
+    std::scoped_lock lock{m_mutex};
+    m_Checkpoint();
+  }
+
+  /// @brief Get the outcome of the recovery of the file at the start
+  [[nodiscard]] const Recovery &GetRecovery() const noexcept {
+    return m_recovery;
+  }
+
+  /// @brief Append a data record, never waits for the file
+  ///
+  /// @return false if the record was dropped
+  bool Append(gsl::span<const std::uint8_t> payload) noexcept {
+    std::scoped_lock lock{m_mutex};
+    if (!m_lastCheckpoint ||
+        m_offset - *m_lastCheckpoint >= m_config.checkpointInterval)
+      m_Checkpoint();
+    return m_Append(Type::eData, payload);
+  }
+
+  [[nodiscard]] Logger::Stats GetStats() { return m_logger.GetStats(); }
+
+  /// @brief Write the buffered records, sync and close the file
+  Logger::Stats Stop() { return m_logger.Stop(); }
+
+  /// @brief Truncate the file after the last valid record
+  ///
+  /// @param path The file, it may not exist
+  static Recovery Recover(const char *path) {
+    Recovery recovery{};
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> file{
+        std::fopen(path, "rb"), &std::fclose};
+    if (!file)
+      return recovery;
+    const auto size = m_GetSize(file.get());
+    const auto checkpoint = m_FindCheckpoint(file.get(), size, recovery);
+    if (!checkpoint) {
+      recovery.size = size;
+      return recovery;
+    }
+    auto offset = checkpoint->offset;
+    auto sequence = checkpoint->sequence;
+    while (const auto record = m_ReadRecord(file.get(), offset, size,
+                                            sequence, checkpoint->run,
+                                            recovery)) {
+      if (record->type == Type::eCheckpoint &&
+          (record->checkpoint != offset || record->run != checkpoint->run))
+        break;
+      offset += HEADER_SIZE + record->length;
+      ++sequence;
+    }
+    file.reset();
+    recovery.size = offset;
+    recovery.dropped = size - offset;
+    recovery.nextSequence = sequence;
+    if (recovery.dropped && truncate(path, static_cast<off_t>(offset)))
+      throw std::runtime_error{"Failed to truncate the journal"};
+    return recovery;
+  }
+
+private:
+  struct Record {
+    Type type;
+    std::uint16_t length;
+    std::uint32_t sequence;
+    // the payload of a checkpoint
+    std::uint64_t checkpoint;
+    std::uint32_t run;
+  };
+  struct Checkpoint {
+    std::uint64_t offset;
+    std::uint32_t sequence;
+    std::uint32_t run;
+  };
+  static constexpr std::size_t CHECKPOINT_SIZE = 12U;
+  static constexpr std::size_t WINDOW = 4096U; // of the backward search
+
+  const Config m_config;
+  const Recovery m_recovery;
+  std::uint64_t m_offset;         // of the next record in the file
+  std::optional<std::uint64_t> m_lastCheckpoint;
+  std::uint32_t m_sequence;
+  const std::uint32_t m_run;
+  std::mutex m_mutex;
+  Logger m_logger; // the last member: its writer runs until it is destroyed
+
+  [[nodiscard]] static Logger::Config
+  m_LoggerConfig(Logger::Config config) noexcept {
+    config.truncate = false;
+    return config;
+  }
+
+  [[nodiscard]] static std::uint32_t m_NewRun() {
+#ifdef ESP_PLATFORM
+    return esp_random();
+#else
+    return std::random_device{}();
+#endif
+  }
+
+  void m_Checkpoint() noexcept {
+    std::array<std::uint8_t, CHECKPOINT_SIZE> payload{};
+    utils::StoreLittleEndian(payload.data(), m_offset);
+    utils::StoreLittleEndian(payload.data() + 8, m_run);
+    const auto offset = m_offset;
+    // a dropped checkpoint is retried with the next record
+    if (m_Append(Type::eCheckpoint, payload))
+      m_lastCheckpoint = offset;
+  }
+
+  bool m_Append(Type type, gsl::span<const std::uint8_t> payload) noexcept {
+    if (payload.size() > MAX_PAYLOAD)
+      return false;
+    std::array<std::uint8_t, HEADER_SIZE> header{};
+    utils::StoreLittleEndian(header.data(), MAGIC);
+    header[2] = utils::EnumValue(type);
+    utils::StoreLittleEndian(header.data() + 4,
+                             static_cast<std::uint16_t>(payload.size()));
+    utils::StoreLittleEndian(header.data() + 8, m_sequence);
+    utils::StoreLittleEndian(
+        header.data() + 12,
+        crc::Crc32(payload, crc::Crc32(gsl::span{header}.first(12U),
+                                       m_Salt(type, m_run))));
+    const std::array<gsl::span<const std::uint8_t>, 2U> parts{header,
+                                                              payload};
+    if (!m_logger.Append(parts))
+      return false;
+    m_offset += HEADER_SIZE + payload.size();
+    ++m_sequence;
+    return true;
+  }
+
+  /// The checkpoints are found without knowing the run
+  [[nodiscard]] static std::uint32_t m_Salt(Type type,
+                                            std::uint32_t run) noexcept {
+    return type == Type::eCheckpoint ? 0U : run;
+  }
+
+  /// In off_t, a journal read on the host may outgrow a long
+  static std::uint64_t m_GetSize(std::FILE *file) {
+    if (fseeko(file, 0, SEEK_END))
+      return 0U;
+    return static_cast<std::uint64_t>(std::max<off_t>(ftello(file), 0));
+  }
+
+  static bool m_Read(std::FILE *file, std::uint64_t offset,
+                     gsl::span<std::uint8_t> out, Recovery &recovery) {
+    recovery.scanned += out.size();
+    return !fseeko(file, static_cast<off_t>(offset), SEEK_SET) &&
+           std::fread(out.data(), 1U, out.size(), file) == out.size();
+  }
+
+  /// Read and check the record, the sequence number is not checked if it is
+  /// not given
+  static std::optional<Record>
+  m_ReadRecord(std::FILE *file, std::uint64_t offset, std::uint64_t size,
+               std::optional<std::uint32_t> sequence, std::uint32_t run,
+               Recovery &recovery) {
+    std::array<std::uint8_t, HEADER_SIZE> header{};
+    if (size - offset < HEADER_SIZE ||
+        !m_Read(file, offset, header, recovery))
+      return std::nullopt;
+    auto record =
+        Record{Type{header[2]},
+               utils::LoadLittleEndian<std::uint16_t>(header.data() + 4),
+               utils::LoadLittleEndian<std::uint32_t>(header.data() + 8), 0U,
+               0U};
+    if (utils::LoadLittleEndian<std::uint16_t>(header.data()) != MAGIC ||
+        record.type > Type::eCheckpoint ||
+        (record.type == Type::eCheckpoint &&
+         record.length != CHECKPOINT_SIZE) ||
+        (sequence && record.sequence != *sequence) ||
+        size - offset - HEADER_SIZE < record.length)
+      return std::nullopt;
+    // the payload is checked in pieces, it is not needed as a whole
+    auto crc = crc::Crc32(gsl::span{header}.first(12U),
+                          m_Salt(record.type, run));
+    std::array<std::uint8_t, 256U> buffer{};
+    for (std::size_t done{}; done < record.length;) {
+      const auto piece = gsl::span{buffer}.first(
+          std::min<std::size_t>(buffer.size(), record.length - done));
+      if (!m_Read(file, offset + HEADER_SIZE + done, piece, recovery))
+        return std::nullopt;
+      if (!done && record.type == Type::eCheckpoint) {
+        record.checkpoint =
+            utils::LoadLittleEndian<std::uint64_t>(piece.data());
+        record.run = utils::LoadLittleEndian<std::uint32_t>(piece.data() + 8);
+      }
+      crc = crc::Crc32(piece, crc);
+      done += piece.size();
+    }
+    if (utils::LoadLittleEndian<std::uint32_t>(header.data() + 12) != crc)
+      return std::nullopt;
+    return record;
+  }
+
+  /// The last valid checkpoint, searched back from the end
+  static std::optional<Checkpoint>
+  m_FindCheckpoint(std::FILE *file, std::uint64_t size, Recovery &recovery) {
+    std::array<std::uint8_t, WINDOW + 2U> window{};
+    for (auto end = size; end;) {
+      const auto start = end > WINDOW ? end - WINDOW : 0U;
+      // the magic and the type of a record at the last offsets too
+      const auto read = std::min<std::uint64_t>(size, end + 2U) - start;
+      if (!m_Read(file, start, gsl::span{window}.first(read), recovery))
+        return std::nullopt;
+      for (auto i = end - start; i--;) {
+        if (i + 3U > read ||
+            utils::LoadLittleEndian<std::uint16_t>(window.data() + i) !=
+                MAGIC ||
+            window[i + 2U] != utils::EnumValue(Type::eCheckpoint))
+          continue;
+        const auto offset = start + i;
+        if (const auto record =
+                m_ReadRecord(file, offset, size, std::nullopt, 0U, recovery);
+            record && record->checkpoint == offset)
+          return Checkpoint{offset, record->sequence, record->run};
+      }
+      end = start;
+    }
+    return std::nullopt;
+  }
+};
@@ -0,0 +1,285 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <gsl/span>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+#ifdef ESP_PLATFORM
+#include <esp_pthread.h>
+#endif
+
+/// @brief An append-only log file which never blocks the producer on the
+/// storage
+///
+/// The records are copied into a ring of blocks of the cluster size while a
+/// low priority writer thread writes the full blocks, one `fwrite` per
+/// block, so FAT always gets whole clusters and never has to read, modify
+/// and write one back. An appended file is realigned by a shorter first
+/// block. The writer syncs the file at most once per the sync interval, so
+/// the cost of the FAT updates is explicit. The producer takes a short lock
+/// to copy a record. If the card stalls long enough for all the blocks to
+/// fill up, the new records are dropped and counted instead. A record may
+/// span several blocks. With #Config::flushPartial, the partial block is also
+/// written at every sync, so at most the sync interval of records is lost on
+/// a power loss at the cost of a cluster rewrite per sync.
+class Logger {
+public:
+  /// @brief The `allocation_unit_size` the card is formatted with
+  static constexpr std::size_t CLUSTER_SIZE = 16U * 1024U;
+
+  struct Config {
+    std::size_t blockSize; ///< the cluster size for a FAT volume
+    std::size_t blocks;    ///< at least 2
+    /// the maximum time the written blocks wait for a sync, zero to sync
+    /// every block
+    std::chrono::milliseconds syncInterval;
+    int writerPriority; ///< of the FreeRTOS task of the writer
+    bool truncate;      ///< start the file over instead of appending
+    bool flushPartial;  ///< write the partial block at a sync too
+  };
+  static constexpr Config DEFAULT_CONFIG{
+      CLUSTER_SIZE, 2U, std::chrono::seconds{1}, 1, false, false};
+
+  struct Stats {
+    std::uint64_t bytes;  ///< written to the file
+    std::uint32_t drops;  ///< the number of dropped records
+    std::uint32_t errors; ///< the number of failed writes and syncs
+    /// the maximum number of full blocks waiting for the writer
+    std::uint32_t maxQueued;
+    /// the longest write or sync of the file
+    std::chrono::microseconds maxWrite;
+  };
+
+  /// @param path The file to append to, created if it does not exist
+  Logger(const char *path, const Config &config)
+      : m_config{config},
+        m_file{std::fopen(path, config.truncate ? "wb" : "ab"), &std::fclose} {
+    if (config.blocks < 2U || !config.blockSize)
+      throw std::invalid_argument{"invalid logger blocks"};
+    if (!m_file)
+      throw std::runtime_error{"Failed to open the log file"};
+    // the blocks are written whole, the stdio buffer would only copy them
+    std::setvbuf(m_file.get(), nullptr, _IONBF, 0);
+    if (!fseeko(m_file.get(), 0, SEEK_END))
+      if (const auto size = ftello(m_file.get()); size > 0)
+        m_limit = config.blockSize -
+                  static_cast<std::size_t>(
+                      size % static_cast<off_t>(config.blockSize));
+    m_data = std::make_unique<std::uint8_t[]>(config.blocks *
+                                              config.blockSize);
+    m_sizes = std::make_unique<std::size_t[]>(config.blocks);
+    m_starts = std::make_unique<std::size_t[]>(config.blocks);
+    m_writer = m_StartWriter();
+  }
+
+  Logger(const Logger &) = delete;
+  Logger &operator=(const Logger &) = delete;
+  Logger(Logger &&) = delete;
+  Logger &operator=(Logger &&) = delete;
+  ~Logger() { Stop(); }
+
+  /// @brief Copy the record into the blocks, never waits for the file
+  ///
+  /// @return false if the record was dropped
+  bool Append(gsl::span<const std::uint8_t> record) noexcept {
+    return Append(gsl::span<const gsl::span<const std::uint8_t>>{&record, 1U});
+  }
+
+  /// @brief Append a record gathered from several parts, all or nothing
+  bool Append(gsl::span<const gsl::span<const std::uint8_t>> parts) noexcept {
+    std::size_t total{};
+    for (const auto &part : parts)
+      total += part.size();
+    std::scoped_lock lock{m_mutex};
+    if (m_stopping || total > m_Room()) {
+      ++m_stats.drops;
+      return false;
+    }
+    // the writer waits for the first record after a flush
+    if (m_config.flushPartial && total && m_size == m_written)
+      m_cv.notify_one();
+    for (auto part : parts)
+      while (!part.empty()) {
+        const auto size = std::min(part.size(), m_limit - m_size);
+        std::memcpy(m_Block(m_active) + m_size, part.data(), size);
+        m_size += size;
+        part = part.subspan(size);
+        if (m_size == m_limit)
+          m_Seal();
+      }
+    return true;
+  }
+
+  /// @brief Get the statistics so far
+  [[nodiscard]] Stats GetStats() {
+    std::scoped_lock lock{m_mutex};
+    return m_stats;
+  }
+
+  /// @brief Write the buffered records, sync and close the file
+  Stats Stop() {
+    {
+      std::scoped_lock lock{m_mutex};
+      m_stopping = true;
+      m_cv.notify_one();
+    }
+    if (m_writer.joinable())
+      m_writer.join();
+    m_file.reset();
+    return m_stats;
+  }
+
+private:
+  const Config m_config;
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> m_file;
+  std::unique_ptr<std::uint8_t[]> m_data;
+  std::unique_ptr<std::size_t[]> m_sizes;  // of the full blocks
+  std::unique_ptr<std::size_t[]> m_starts; // already written of them
+  std::size_t m_active{};                  // the block being filled
+  std::size_t m_size{};                    // of the active block
+  std::size_t m_written{}; // of the active block, by #Config::flushPartial
+  std::size_t m_limit{m_config.blockSize}; // the size of the active block
+  std::size_t m_queued{}; // the full blocks before the active one
+  bool m_stopping{};
+  Stats m_stats{};
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::thread m_writer; // the last member: it uses all the others
+
+  [[nodiscard]] std::uint8_t *m_Block(std::size_t index) noexcept {
+    return m_data.get() + index * m_config.blockSize;
+  }
+
+  /// The number of bytes which can be appended now
+  [[nodiscard]] std::size_t m_Room() const noexcept {
+    // all the blocks are full, the active one is the oldest of them
+    if (m_queued == m_config.blocks)
+      return 0U;
+    return m_limit - m_size +
+           (m_config.blocks - 1U - m_queued) * m_config.blockSize;
+  }
+
+  /// Hand the active block over to the writer
+  void m_Seal() noexcept {
+    m_sizes[m_active] = m_size;
+    m_starts[m_active] = m_written;
+    m_active = (m_active + 1U) % m_config.blocks;
+    m_size = 0U;
+    m_written = 0U;
+    m_limit = m_config.blockSize;
+    ++m_queued;
+    m_stats.maxQueued =
+        std::max(m_stats.maxQueued, static_cast<std::uint32_t>(m_queued));
+    m_cv.notify_one();
+  }
+
+  std::thread m_StartWriter() {
+#ifdef ESP_PLATFORM
+    auto config = esp_pthread_get_default_config();
+    config.prio = m_config.writerPriority;
+    config.thread_name = "logger";
+    esp_pthread_set_cfg(&config);
+    std::thread writer{[this] { m_Write(); }};
+    config = esp_pthread_get_default_config();
+    esp_pthread_set_cfg(&config);
+    return writer;
+#else
+    return std::thread{[this] { m_Write(); }};
+#endif
+  }
+
+  /// Run the file operation and account for it, without the lock
+  template <typename Operation> void m_Timed(Operation &&operation) {
+    const auto start = std::chrono::steady_clock::now();
+    const bool ok = operation();
+    const auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::scoped_lock lock{m_mutex};
+    m_stats.maxWrite = std::max(m_stats.maxWrite, time);
+    if (!ok)
+      ++m_stats.errors;
+  }
+
+  void m_WriteBlock(const std::uint8_t *block, std::size_t size) {
+    m_Timed([&] {
+      const auto written = std::fwrite(block, 1U, size, m_file.get());
+      std::scoped_lock lock{m_mutex};
+      m_stats.bytes += written;
+      return written == size;
+    });
+  }
+
+  void m_Sync() {
+    m_Timed([this] {
+      return !std::fflush(m_file.get()) && !fsync(fileno(m_file.get()));
+    });
+  }
+
+  /// The records of the active block to be written at a sync
+  [[nodiscard]] bool m_Unflushed() const noexcept {
+    return m_config.flushPartial && m_size > m_written;
+  }
+
+  void m_Write() {
+    using Clock = std::chrono::steady_clock;
+    auto lastSync = Clock::now();
+    bool dirty{}; // written but not synced
+    std::unique_lock lock{m_mutex};
+    for (;;) {
+      if (m_queued) {
+        const auto index =
+            (m_active + m_config.blocks - m_queued) % m_config.blocks;
+        lock.unlock();
+        m_WriteBlock(m_Block(index) + m_starts[index],
+                     m_sizes[index] - m_starts[index]);
+        dirty = true;
+        lock.lock();
+        --m_queued;
+        // a backlog of blocks must not hold the sync back
+        if (Clock::now() - lastSync < m_config.syncInterval)
+          continue;
+      } else if (m_stopping) {
+        lock.unlock();
+        m_WriteBlock(m_Block(m_active) + m_written, m_size - m_written);
+        m_Sync();
+        return;
+      } else if (!dirty && !m_Unflushed()) {
+        m_cv.wait(lock, [this] {
+          return m_queued || m_stopping || m_Unflushed();
+        });
+        continue;
+      } else if (m_cv.wait_until(lock, lastSync + m_config.syncInterval,
+                                 [this] { return m_queued || m_stopping; })) {
+        continue;
+      }
+
+      // the sync is due. The full blocks go first to keep the file order
+      if (!m_queued && m_Unflushed()) {
+        // claimed before the write, the producer may seal the block meanwhile
+        const auto *const block = m_Block(m_active) + m_written;
+        const auto size = m_size - m_written;
+        m_written = m_size;
+        lock.unlock();
+        m_WriteBlock(block, size);
+        dirty = true;
+        lock.lock();
+      }
+      if (dirty) {
+        lock.unlock();
+        m_Sync();
+        lastSync = Clock::now();
+        dirty = false;
+        lock.lock();
+      }
+    }
+  }
+};
@@ -1,37 +1,307 @@
 #pragma once
 #include "esp_log.h"
+#include <algorithm>
+#include <any>
+#include <array>
 #include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <cstdio>
+#include <iterator>
 #include <memory>
 #include <message-queue/interfaces.hpp>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <telemetry/frame.hpp>
+#include <utils/text-writer.hpp>
 #include <utils/utils.hpp>
 #include <mqtt-helper/mqtt-helper.hpp>
+#include <mqtt-helper/outbox.hpp>
+#include <vector>
 #include <weight-meter/weight-meter.hpp>
 
 class Logic final : public mq::ISystem {
   static constexpr const char *TAG = "Logic";
   static constexpr auto CHECK_TIME{std::chrono::seconds{5}};
+  static constexpr WeightMeter::Subscription SUBSCRIPTION{
+      std::chrono::milliseconds{200}, CHECK_TIME, 5.f};
+  static constexpr std::size_t MAX_JSON_HEADER = 40U;
+  // "[<dt>,<meter>,<gramms>]," with the worst case widths
+  static constexpr std::size_t MAX_JSON_READING = 48U;
 
-  mq::IContext &m_ctx;
-  mq::IScheduler &m_scheduler;
-  std::shared_ptr<mqtt::Client> m_mqttClient;
 public:
   enum class Event : decltype(mq::Addr::ev) {
     eStartReadWeight,
     eGotWeight,
+    eConfigureTelemetry, ///< #Telemetry
+    eFlushTelemetry,
+    eDrainOutbox,
+  };
+
+  enum class Mode {
+    ePoll,      ///< read the weight at the #Polling interval
+    eSubscribe, ///< get the weight pushed when it changes
+  };
+
+  /// @brief The bounds of the adaptive polling interval
+  ///
+  /// The interval drops to the minimum as soon as a meter reports a change
+  /// of at least the activity threshold or an unstable weight, and doubles
+  /// after every poll round without activity up to the maximum.
+  struct Polling {
+    std::chrono::milliseconds minInterval;
+    std::chrono::milliseconds maxInterval;
+    float activityThreshold; // gramms
+  };
+  static constexpr Polling DEFAULT_POLLING{std::chrono::milliseconds{250},
+                                           std::chrono::minutes{1}, 5.f};
+
+  /// @brief The weight uplink settings, the uplink is off until configured
+  ///
+  /// The readings are coalesced into one publish of
+  /// `{"t":<ms>,"w":[[<dt ms>,<meter>,<gramms>],...]}` when the batch gets
+  /// #maxReadings readings or #window after its first reading, whichever
+  /// comes first. `t` is the time of the first reading since the boot.
+  /// With #Format::eBinary every meter of the batch is published as a
+  /// #telemetry frame instead: the channel is the meter instance, the time
+  /// is in ms since the boot and the scale is #BINARY_SCALE.
+  ///
+  /// With an #outbox, the messages that can't be published are stored and
+  /// sent oldest first, one per #drainInterval, once the broker is
+  /// reachable again. The new messages queue up behind the stored ones.
+  struct Telemetry {
+    enum class Format : std::uint8_t { eJson, eBinary };
+
+    std::string topic; ///< no uplink if empty
+    std::size_t maxReadings;
+    std::chrono::milliseconds window;
+    mqtt::QoS qos;
+    Format format{Format::eJson};
+    std::uint32_t device{}; ///< the device field of the binary frames
+    std::shared_ptr<mqtt::Outbox> outbox{};
+    std::chrono::milliseconds drainInterval{100};
+  };
+  static constexpr float BINARY_SCALE = 0.1f; // gramms
+
+private:
+  struct Meter {
+    mq::Id id;
+    WeightMeter::Reading last{};
+  };
+
+  mq::IContext &m_ctx;
+  mq::IScheduler &m_scheduler;
+  std::shared_ptr<mqtt::Client> m_mqttClient;
+  std::vector<Meter> m_meters;
+  const Polling m_polling;
+  std::chrono::milliseconds m_pollInterval;
+  std::uint32_t m_pollGeneration{}; // invalidates the scheduled polls
+  bool m_activity{};
+
+  struct BatchedReading {
+    mq::IClock::time_point time;
+    std::uint8_t meter;
+    float grams;
   };
+  Telemetry m_telemetry{};
+  std::vector<BatchedReading> m_batch;
+  std::optional<mqtt::Topic> m_topic; // the interned telemetry topic
+  std::vector<char> m_text;           // the JSON buffer
+  std::vector<std::uint8_t> m_frame;  // the binary frame buffer
+  std::uint32_t m_batchGeneration{}; // invalidates the scheduled flushes
+  bool m_draining{};                 // an outbox drain is scheduled
+
+  static long long m_ToMs(mq::IClock::duration duration) {
+    return static_cast<long long>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(duration)
+            .count());
+  }
+
+  void m_Publish(std::string_view payload) {
+    const auto &outbox = m_telemetry.outbox;
+    if ((!outbox || outbox->IsEmpty()) &&
+        (m_topic ? m_mqttClient->PublishAsync(*m_topic, payload,
+                                              m_telemetry.qos)
+                 : m_mqttClient->PublishAsync(m_telemetry.topic, payload,
+                                              m_telemetry.qos)) !=
+            mqtt::Client::ERROR_ID)
+      return;
+    if (outbox && outbox->Push(m_telemetry.topic, payload, m_telemetry.qos)) {
+      m_ScheduleDrain();
+      return;
+    }
+    ESP_LOGW(TAG, "Failed to publish %u readings",
+             static_cast<unsigned>(m_batch.size()));
+  }
+
+  void m_ScheduleDrain() {
+    if (m_draining)
+      return;
+    m_draining = true;
+    m_scheduler.ScheduleAfter(
+        mq::Message{mq::NONE,
+                    mq::Addr{GetId(), utils::EnumValue(Event::eDrainOutbox)},
+                    {}},
+        m_ctx.GetNumPriorities() - 1, m_telemetry.drainInterval);
+  }
 
+  void m_DrainOutbox() {
+    m_draining = false;
+    const auto &outbox = m_telemetry.outbox;
+    if (!outbox || !m_mqttClient)
+      return;
+    // the message leaves the outbox before the client takes it, so it is
+    // never sent again after a reboot, and returns if the client refuses it
+    if (m_mqttClient->IsConnected())
+      if (const auto message = outbox->Pop())
+        if (m_mqttClient->PublishAsync(message->topic, message->payload,
+                                       message->qos) ==
+            mqtt::Client::ERROR_ID) {
+          if (outbox->Restore())
+            ESP_LOGW(TAG, "Failed to publish a stored message, retrying");
+          else
+            ESP_LOGE(TAG, "Failed to publish a stored message, dropped it");
+        }
+    if (!outbox->IsEmpty())
+      m_ScheduleDrain();
+  }
+
+  void m_PublishJson() {
+    const auto t0 = m_batch.front().time;
+    utils::TextWriter text{m_text};
+    utils::JsonWriter json{text};
+    json.BeginObject().Key("t").Value(m_ToMs(t0.time_since_epoch()));
+    json.Key("w").BeginArray();
+    for (const auto &reading : m_batch)
+      json.BeginArray()
+          .Value(m_ToMs(reading.time - t0))
+          .Value(reading.meter)
+          .Fixed(reading.grams, 1U)
+          .EndArray();
+    json.EndArray().EndObject();
+    if (text.IsOverflow())
+      ESP_LOGW(TAG, "Failed to format %u readings",
+               static_cast<unsigned>(m_batch.size()));
+    else
+      m_Publish(text.View());
+  }
+
+  /// One frame per meter, in the order of their first readings
+  void m_PublishBinary() {
+    const auto ms = [](mq::IClock::time_point time) {
+      return static_cast<std::uint64_t>(m_ToMs(time.time_since_epoch()));
+    };
+    for (auto first = m_batch.cbegin(); first != m_batch.cend(); ++first) {
+      if (std::any_of(m_batch.cbegin(), first, [first](const auto &r) {
+            return r.meter == first->meter;
+          }))
+        continue;
+      telemetry::Encoder encoder{
+          m_frame,
+          telemetry::Header{m_telemetry.device, first->meter, ms(first->time),
+                            BINARY_SCALE}};
+      for (auto it = first; it != m_batch.cend(); ++it)
+        if (it->meter == first->meter)
+          // the buffer holds the worst case of a whole batch
+          static_cast<void>(encoder.Add(telemetry::Sample{
+              ms(it->time), telemetry::Quantize(it->grams, BINARY_SCALE)}));
+      const auto frame = encoder.Finish();
+      m_Publish(std::string_view{reinterpret_cast<const char *>(frame.data()),
+                                 frame.size()});
+    }
+  }
+
+  void m_SendToMeters(WeightMeter::Event event, std::any data) {
+    for (const auto &meter : m_meters)
+      m_ctx.Push(mq::Message{
+          mq::Addr{GetId(), utils::EnumValue(Event::eGotWeight)},
+          mq::Addr{meter.id, utils::EnumValue(event)}, data});
+  }
+
+  void m_SchedulePoll() {
+    ESP_LOGD(TAG, "Next poll in %u ms",
+             static_cast<unsigned>(m_pollInterval.count()));
+    m_scheduler.ScheduleAfter(
+        mq::Message{
+            mq::NONE,
+            mq::Addr{GetId(), utils::EnumValue(Event::eStartReadWeight)},
+            m_pollGeneration},
+        m_ctx.GetNumPriorities() - 1, m_pollInterval);
+  }
+
+  void m_AdaptPolling(const WeightMeter::Reading &previous,
+                      const WeightMeter::Reading &current) {
+    if (std::abs(current.grams - previous.grams) <
+            m_polling.activityThreshold &&
+        current.quality != WeightMeter::Quality::eUnstable)
+      return;
+    m_activity = true;
+    if (m_pollInterval > m_polling.minInterval) {
+      // replace the scheduled slow poll with a fast one
+      m_pollInterval = m_polling.minInterval;
+      ++m_pollGeneration;
+      m_SchedulePoll();
+    }
+  }
+
+  void m_AddToBatch(std::uint8_t meter, float grams) {
+    if (m_telemetry.topic.empty() || !m_mqttClient)
+      return;
+    const auto now = m_scheduler.GetClock().Now();
+    if (m_batch.empty())
+      m_scheduler.ScheduleAfter(
+          mq::Message{
+              mq::NONE,
+              mq::Addr{GetId(), utils::EnumValue(Event::eFlushTelemetry)},
+              m_batchGeneration},
+          m_ctx.GetNumPriorities() - 1, m_telemetry.window);
+    m_batch.push_back(BatchedReading{now, meter, grams});
+    if (m_batch.size() >= m_telemetry.maxReadings)
+      m_FlushBatch();
+  }
+
+  void m_FlushBatch() {
+    ++m_batchGeneration;
+    if (m_batch.empty())
+      return;
+
+    if (m_telemetry.format == Telemetry::Format::eBinary)
+      m_PublishBinary();
+    else
+      m_PublishJson();
+    m_batch.clear();
+  }
+
+public:
+  /// @param meters The IDs of the weight meter instances to serve
+  /// @param polling The polling interval bounds for #Mode::ePoll
   Logic(mq::IContext& ctx, 
         mq::IScheduler& scheduler,
-        std::shared_ptr<mqtt::Client> mqttClient)
+        std::shared_ptr<mqtt::Client> mqttClient,
+        Mode mode = Mode::eSubscribe,
+        const std::vector<mq::Id> &meters = {mq::Id::eWeightMeter},
+        const Polling &polling = DEFAULT_POLLING)
       : m_ctx{ctx}, 
         m_scheduler{scheduler}, 
-        m_mqttClient{std::move(mqttClient)} 
+        m_mqttClient{std::move(mqttClient)},
+        m_polling{polling},
+        m_pollInterval{polling.minInterval}
   {
-    m_ctx.Push(mq::Message{
-        mq::NONE,
-        mq::Addr{GetId(), utils::EnumValue(Event::eStartReadWeight)},
-        {}});
+    if (polling.minInterval.count() <= 0 ||
+        polling.maxInterval < polling.minInterval)
+      throw std::invalid_argument{"invalid polling interval bounds"};
+    std::transform(meters.cbegin(), meters.cend(),
+                   std::back_inserter(m_meters),
+                   [](mq::Id id) { return Meter{id}; });
+    if (mode == Mode::eSubscribe)
+      m_SendToMeters(WeightMeter::Event::eSubscribe, SUBSCRIPTION);
+    else
+      m_ctx.Push(mq::Message{
+          mq::NONE,
+          mq::Addr{GetId(), utils::EnumValue(Event::eStartReadWeight)},
+          {}});
   }
 
   void Process(const mq::Message &msg) {
@@ -39,21 +309,59 @@ public:
       return;
     switch (msg.to.ev) {
     case utils::EnumValue(Event::eStartReadWeight): {
-      m_ctx.Push(mq::Message{
-          mq::Addr{GetId(), utils::EnumValue(Event::eGotWeight)},
-          mq::Addr{mq::Id::eWeightMeter, utils::EnumValue(WeightMeter::Event::eReadCmd)},
-          {}});
-      m_scheduler.ScheduleAfter(
-        mq::Message{ 
-        mq::NONE,
-        mq::Addr{GetId(), utils::EnumValue(Event::eStartReadWeight)},
-        {}}, 
-        m_ctx.GetNumPriorities() - 1,
-        std::chrono::seconds{CHECK_TIME});
+      if (const auto *generation = std::any_cast<std::uint32_t>(&msg.data);
+          generation && *generation != m_pollGeneration)
+        break;
+      m_SendToMeters(WeightMeter::Event::eReadCmd, {});
+      if (!m_activity)
+        m_pollInterval = std::min(m_pollInterval * 2, m_polling.maxInterval);
+      m_activity = false;
+      m_SchedulePoll();
     } break;
     case utils::EnumValue(Event::eGotWeight): {
-      ESP_LOGI(TAG, "GotWeight");
+      const auto *reading = std::any_cast<WeightMeter::Reading>(&msg.data);
+      auto meter = std::find_if(
+          m_meters.begin(), m_meters.end(),
+          [&msg](const auto &m) { return m.id == msg.from.sys; });
+      if (!reading || meter == m_meters.end())
+        break;
+      if (msg.from.ev == utils::EnumValue(WeightMeter::Event::eReadCmd))
+        m_AdaptPolling(meter->last, *reading);
+      meter->last = *reading;
+      ESP_LOGI(TAG, "GotWeight #%u: %u g, age %u ms, quality %u",
+               mq::GetInstance(meter->id),
+               static_cast<unsigned>(reading->grams),
+               static_cast<unsigned>(reading->age.count()),
+               utils::EnumValue(reading->quality));
+      if (reading->quality != WeightMeter::Quality::eNoData)
+        m_AddToBatch(mq::GetInstance(meter->id), reading->grams);
+    } break;
+    case utils::EnumValue(Event::eConfigureTelemetry): {
+      if (const auto *telemetry = std::any_cast<Telemetry>(&msg.data)) {
+        m_FlushBatch();
+        m_telemetry = *telemetry;
+        m_telemetry.maxReadings = std::max<std::size_t>(
+            m_telemetry.maxReadings, 1U);
+        m_batch.reserve(m_telemetry.maxReadings);
+        if (m_telemetry.format == Telemetry::Format::eBinary)
+          m_frame.resize(telemetry::MaxFrameSize(m_telemetry.maxReadings));
+        else
+          m_text.resize(MAX_JSON_HEADER + m_telemetry.maxReadings *
+                                              MAX_JSON_READING);
+        m_topic = m_mqttClient ? m_mqttClient->InternTopic(m_telemetry.topic)
+                               : std::nullopt;
+        if (m_telemetry.outbox && !m_telemetry.outbox->IsEmpty())
+          m_ScheduleDrain(); // left over from before a reboot
+      }
+    } break;
+    case utils::EnumValue(Event::eFlushTelemetry): {
+      if (const auto *generation = std::any_cast<std::uint32_t>(&msg.data);
+          !generation || *generation == m_batchGeneration)
+        m_FlushBatch();
     } break;
+    case utils::EnumValue(Event::eDrainOutbox):
+      m_DrainOutbox();
+      break;
     }
   }
 
@@ -0,0 +1,210 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mq {
+/// @brief A pool of fixed-size blocks for passing bulk data between systems
+///
+/// A block is filled through a #Writer, then sealed into an immutable,
+/// intrusively reference-counted #Ref. The #Ref is as cheap to copy as a
+/// pointer and fits into the small-object storage of `std::any`, so the same
+/// block is shared by every recipient of an #mq::Message without copying the
+/// data. The block returns to the pool when the last #Ref is released.
+/// The pool must outlive all the handles.
+///
+/// @tparam T The element type
+/// @tparam CAPACITY The number of elements in a block
+template<typename T, std::size_t CAPACITY>
+class BlockPool {
+  static_assert(std::is_trivially_copyable_v<T>);
+  static_assert(CAPACITY > 0U);
+
+  struct Block {
+    std::array<T, CAPACITY> data;
+    std::size_t size;
+    std::atomic<unsigned> refs;
+    BlockPool* pool;
+  };
+
+  std::unique_ptr<Block[]> m_blocks;
+  std::vector<Block*> m_free;
+  std::mutex m_mutex;
+  std::atomic<std::size_t> m_exhaustedCount{};
+
+  void m_Release(Block* block)
+  {
+    std::scoped_lock lock{m_mutex};
+    m_free.push_back(block);
+  }
+
+public:
+  /// @brief A shared read-only handle to a sealed block
+  class Ref {
+    friend BlockPool;
+    Block* m_block{};
+
+    explicit Ref(Block* block) noexcept : m_block{block} {}
+
+  public:
+    Ref() noexcept = default;
+    Ref(const Ref& other) noexcept : m_block{other.m_block}
+    {
+      if (m_block)
+        m_block->refs.fetch_add(1U, std::memory_order_relaxed);
+    }
+    Ref(Ref&& other) noexcept : m_block{std::exchange(other.m_block, nullptr)}
+    {
+    }
+    Ref& operator=(Ref other) noexcept
+    {
+      std::swap(m_block, other.m_block);
+      return *this;
+    }
+    ~Ref() { Reset(); }
+
+    /// @brief Drop the reference, the last one returns the block to the pool
+    void Reset() noexcept
+    {
+      if (auto* block = std::exchange(m_block, nullptr);
+          block &&
+          block->refs.fetch_sub(1U, std::memory_order_acq_rel) == 1U)
+        block->pool->m_Release(block);
+    }
+
+    [[nodiscard]] explicit operator bool() const noexcept { return m_block; }
+    [[nodiscard]] const T* data() const noexcept
+    {
+      return m_block ? m_block->data.data() : nullptr;
+    }
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+      return m_block ? m_block->size : 0U;
+    }
+    [[nodiscard]] const T* begin() const noexcept { return data(); }
+    [[nodiscard]] const T* end() const noexcept { return data() + size(); }
+    [[nodiscard]] const T& operator[](std::size_t i) const noexcept
+    {
+      return m_block->data[i];
+    }
+  };
+
+  /// @brief An exclusive handle to a block being filled
+  class Writer {
+    friend BlockPool;
+    Block* m_block{};
+
+    explicit Writer(Block* block) noexcept : m_block{block} {}
+
+  public:
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+    Writer(Writer&& other) noexcept
+      : m_block{std::exchange(other.m_block, nullptr)}
+    {
+    }
+    Writer& operator=(Writer&& other) noexcept
+    {
+      std::swap(m_block, other.m_block);
+      return *this;
+    }
+    /// @brief An unsealed block goes back to the pool
+    ~Writer()
+    {
+      if (m_block)
+        m_block->pool->m_Release(m_block);
+    }
+
+    /// @return false if the block is full
+    [[nodiscard]] bool Push(const T& value) noexcept
+    {
+      if (IsFull())
+        return false;
+      m_block->data[m_block->size++] = value;
+      return true;
+    }
+    /// @brief Append as many of the values as fit
+    ///
+    /// @return The number of the appended values
+    std::size_t Push(const T* values, std::size_t count) noexcept
+    {
+      const auto n = std::min(count, CAPACITY - m_block->size);
+      std::copy_n(values, n, m_block->data.data() + m_block->size);
+      m_block->size += n;
+      return n;
+    }
+    [[nodiscard]] bool IsFull() const noexcept
+    {
+      return m_block->size == CAPACITY;
+    }
+    [[nodiscard]] std::size_t size() const noexcept { return m_block->size; }
+    [[nodiscard]] static constexpr std::size_t capacity() noexcept
+    {
+      return CAPACITY;
+    }
+
+    /// @brief Make the block immutable and shareable
+    [[nodiscard]] Ref Seal() && noexcept
+    {
+      auto* block = std::exchange(m_block, nullptr);
+      block->refs.store(1U, std::memory_order_relaxed);
+      return Ref{block};
+    }
+  };
+
+  /// @param numBlocks The number of preallocated blocks
+  explicit BlockPool(std::size_t numBlocks)
+    : m_blocks{std::make_unique<Block[]>(numBlocks)}
+  {
+    if (!numBlocks)
+      throw std::invalid_argument{"numBlocks must be greater than 0"};
+    m_free.reserve(numBlocks);
+    for (std::size_t i{}; i < numBlocks; ++i) {
+      m_blocks[i].pool = this;
+      m_free.push_back(&m_blocks[i]);
+    }
+  }
+  BlockPool(const BlockPool&) = delete;
+  BlockPool& operator=(const BlockPool&) = delete;
+  BlockPool(BlockPool&&) = delete;
+  BlockPool& operator=(BlockPool&&) = delete;
+  ~BlockPool() = default;
+
+  /// @brief Get an empty block
+  ///
+  /// @return std::nullopt if all the blocks are in use: the producer is
+  /// expected to drop or hold its data back until the consumers catch up
+  [[nodiscard]] std::optional<Writer> TryAcquire()
+  {
+    std::scoped_lock lock{m_mutex};
+    if (m_free.empty()) {
+      m_exhaustedCount.fetch_add(1U, std::memory_order_relaxed);
+      return std::nullopt;
+    }
+    auto* block = m_free.back();
+    m_free.pop_back();
+    block->size = 0U;
+    return Writer{block};
+  }
+
+  [[nodiscard]] std::size_t GetNumFree()
+  {
+    std::scoped_lock lock{m_mutex};
+    return m_free.size();
+  }
+
+  /// @brief Get the number of failed #TryAcquire calls
+  [[nodiscard]] std::size_t GetExhaustedCount() const noexcept
+  {
+    return m_exhaustedCount.load(std::memory_order_relaxed);
+  }
+};
+} // namespace mq
@@ -1,38 +1,119 @@
 #pragma once
 #include "message-queue/interfaces.hpp"
 
-#include <algorithm>
+#include <cstdint>
 #include <esp_log.h>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <queue>
 #include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <utils/utils.hpp>
 #include <vector>
 
 namespace mq {
+/// @brief The message queue with up to #MAX_PRIORITIES priority levels
+///
+/// The priority 0 is the highest one. Non-empty levels are tracked in a
+/// bitmap, so picking the next message takes one count-leading-zeros
+/// instruction regardless of the number of levels. With the aging enabled, a
+/// message which waited longer than the bound is served before the higher
+/// priority ones, so a steady high priority stream can not starve the lower
+/// levels. The messages are then also kept in their arrival order, the
+/// oldest one is at its front, so an aged pick does not walk the levels.
+///
+/// A message is dispatched to the systems with the destination ID and to the
+/// observers (the systems with #mq::Id::eNone), a message to #mq::Id::eAll is
+/// dispatched to all the systems.
 class Context : public IContext {
-  std::vector<std::queue<Message>> m_queues;
+public:
+  static constexpr unsigned MAX_PRIORITIES = 32U;
+
+private:
+  struct QueuedMessage {
+    Message message;
+    std::uint64_t seq; ///< the arrival number
+  };
+  struct Arrival {
+    std::uint64_t seq;
+    IClock::time_point since;
+    unsigned priority;
+  };
+
+  std::vector<std::queue<QueuedMessage>> m_queues;
+  std::uint32_t m_occupied{}; ///< the MSB is the priority 0
+  /// The queued messages in the arrival order, the popped ones are dropped
+  /// from the front lazily
+  std::queue<Arrival> m_arrivals;
+  std::uint64_t m_pushed{};
   std::vector<std::shared_ptr<ISystem>> m_systems;
+  std::vector<std::shared_ptr<ISystem>> m_observers;
+  std::unordered_map<std::underlying_type_t<Id>,
+                     std::vector<std::shared_ptr<ISystem>>>
+    m_routes;
   std::mutex m_mutex;
+  const std::optional<IClock::duration> m_agingBound;
+  const IClock& m_clock;
+
+  [[nodiscard]] static constexpr std::uint32_t
+  m_Bit(unsigned priority) noexcept
+  {
+    return 0x80000000UL >> priority;
+  }
+
+  /// Pick the longest waiting message if it waited longer than the aging
+  /// bound, otherwise keep the highest priority one
+  [[nodiscard]] unsigned m_PickAged(unsigned highest)
+  {
+    // the oldest queued message is the head of its level
+    for (;;) {
+      const auto& arrival = m_arrivals.front();
+      const auto& queue = m_queues[arrival.priority];
+      if (!queue.empty() && queue.front().seq == arrival.seq)
+        break;
+      m_arrivals.pop();
+    }
+    const auto& oldest = m_arrivals.front();
+    return oldest.since < m_clock.Now() - *m_agingBound ? oldest.priority
+                                                        : highest;
+  }
 
   [[nodiscard]] bool m_TryPop(Message& out)
   {
     std::scoped_lock lock{m_mutex};
-    for (auto& queue : m_queues)
-      if (!queue.empty()) {
-        out = std::move(queue.front());
-        queue.pop();
-        return true;
-      }
-    return false;
+    if (!m_occupied)
+      return false;
+
+    auto priority = static_cast<unsigned>(__builtin_clz(m_occupied));
+    if (m_agingBound)
+      priority = m_PickAged(priority);
+
+    auto& queue = m_queues[priority];
+    out = std::move(queue.front().message);
+    queue.pop();
+    if (queue.empty())
+      m_occupied &= ~m_Bit(priority);
+    return true;
   }
 
 public:
-  explicit Context(unsigned numPriorities = 2)
-    : IContext(numPriorities), m_queues(m_numPriorities)
+  /// @param numPriorities The number of priority levels
+  /// @param agingBound The maximum waiting time before a message is served
+  /// regardless of its priority, no aging if empty
+  /// @param clock The clock to measure the waiting time
+  explicit Context(unsigned numPriorities = 2,
+                   std::optional<IClock::duration> agingBound = std::nullopt,
+                   const IClock& clock = SteadyClock::Instance())
+    : IContext(numPriorities)
+    , m_queues(m_numPriorities)
+    , m_agingBound{agingBound}
+    , m_clock{clock}
   {
+    if (numPriorities > MAX_PRIORITIES)
+      throw std::invalid_argument{"too many priorities"};
   }
 
   void Push(Message message, unsigned priority) override
@@ -42,14 +123,24 @@ public:
              utils::EnumValue(message.to.sys), message.to.ev,
              message.data.has_value());
     std::scoped_lock lock{m_mutex};
-    m_queues.at(priority).push(std::move(message));
+    auto& queue = m_queues.at(priority);
+    const auto seq = m_pushed++;
+    if (m_agingBound)
+      m_arrivals.push(Arrival{seq, m_clock.Now(), priority});
+    queue.push(QueuedMessage{std::move(message), seq});
+    m_occupied |= m_Bit(priority);
   }
+  using IContext::Push;
 
   void AddSystem(std::shared_ptr<ISystem> system) override
   {
     if (!system)
       throw std::invalid_argument{"the system can not be null"};
-    m_systems.push_back(system);
+    if (const auto id = system->GetId(); id == Id::eNone)
+      m_observers.push_back(system);
+    else
+      m_routes[utils::EnumValue(id)].push_back(system);
+    m_systems.push_back(std::move(system));
   }
 
   [[nodiscard]] bool ProcessOneMessage() override
@@ -62,8 +153,18 @@ public:
                utils::EnumValue(message.to.sys), message.to.ev,
                message.data.has_value());
 
-      std::for_each(m_systems.begin(), m_systems.end(),
-                    [&message](auto& system) { system->Process(message); });
+      const auto dispatch = [&message](const auto& systems) {
+        for (const auto& system : systems)
+          system->Process(message);
+      };
+      if (message.to.sys == Id::eAll)
+        dispatch(m_systems);
+      else {
+        if (auto it = m_routes.find(utils::EnumValue(message.to.sys));
+            it != m_routes.end())
+          dispatch(it->second);
+        dispatch(m_observers);
+      }
     }
     return ret;
   }
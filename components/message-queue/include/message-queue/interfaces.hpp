@@ -3,18 +3,48 @@
 #include <chrono>
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <stdexcept>
+#include <thread>
 #include <type_traits>
 #include <utility>
 
 namespace mq {
+/// @brief A system ID
+///
+/// The low byte is the kind of the system, the high byte is the index of its
+/// instance, see #mq::MakeId. The enumerators are the instances 0.
 enum class Id : std::uint16_t {
   eNone, // use as source id
   eAll,  // use as destination id
   eWeightMeter,
-  eLogic
+  eLogic,
+  eMqttBridge,
+  eCommandServer
 };
 
+/// @brief Get the ID of an instance of a system
+[[nodiscard]] constexpr Id MakeId(Id base, std::uint8_t instance) noexcept
+{
+  return static_cast<Id>(
+    static_cast<std::uint16_t>(instance << 8U) |
+    (static_cast<std::underlying_type_t<Id>>(base) & 0xFFU));
+}
+/// @brief Get the kind of a system from its ID
+[[nodiscard]] constexpr Id GetBaseId(Id id) noexcept
+{
+  return static_cast<Id>(static_cast<std::underlying_type_t<Id>>(id) & 0xFFU);
+}
+/// @brief Get the instance index of a system from its ID
+[[nodiscard]] constexpr std::uint8_t GetInstance(Id id) noexcept
+{
+  return static_cast<std::uint8_t>(
+    static_cast<std::underlying_type_t<Id>>(id) >> 8U);
+}
+static_assert(MakeId(Id::eWeightMeter, 0) == Id::eWeightMeter);
+static_assert(GetBaseId(MakeId(Id::eWeightMeter, 3)) == Id::eWeightMeter);
+static_assert(GetInstance(MakeId(Id::eWeightMeter, 3)) == 3);
+
 struct Addr {
   Id sys;
   std::uint16_t ev;
@@ -50,6 +80,9 @@ public:
   /// @brief Process a #mq::Message in the message queue
   virtual void Process(const Message&) = 0;
   /// @brief Get a system ID to match the #mq::Message addresses
+  ///
+  /// The ID must not change after the system is added to a context. The
+  /// systems with #mq::Id::eNone observe all the messages.
   [[nodiscard]] virtual Id GetId() const noexcept = 0;
 
   /// @brief A factory function for creating new instances
@@ -91,23 +124,67 @@ public:
   }
 };
 
+/// @brief A source of the current time for the scheduling
+class IClock {
+public:
+  using time_point = std::chrono::steady_clock::time_point;
+  using duration = std::chrono::steady_clock::duration;
+
+  virtual ~IClock() = default;
+  [[nodiscard]] virtual time_point Now() const noexcept = 0;
+  /// @brief Wait until the time, a virtual clock jumps to it instead
+  virtual void SleepUntil(time_point when) = 0;
+};
+
+/// @brief The system monotonic clock
+class SteadyClock final : public IClock {
+public:
+  [[nodiscard]] time_point Now() const noexcept override
+  {
+    return std::chrono::steady_clock::now();
+  }
+
+  void SleepUntil(time_point when) override
+  {
+    std::this_thread::sleep_until(when);
+  }
+
+  [[nodiscard]] static SteadyClock& Instance() noexcept
+  {
+    static SteadyClock clock;
+    return clock;
+  }
+};
+
 class IScheduler {
+protected:
+  const IClock& m_clock;
+
 public:
+  explicit IScheduler(const IClock& clock = SteadyClock::Instance()) noexcept
+    : m_clock{clock}
+  {
+  }
   virtual ~IScheduler() = default;
 
+  [[nodiscard]] const IClock& GetClock() const noexcept { return m_clock; }
+
   template<typename Rep, typename Period>
   void ScheduleAfter(Message message, unsigned priority,
                      const std::chrono::duration<Rep, Period>& timeout)
   {
-    Schedule(std::move(message), priority,
-             std::chrono::steady_clock::now() + timeout);
+    Schedule(std::move(message), priority, m_clock.Now() + timeout);
   }
 
   virtual void Schedule(Message message, unsigned priority,
-                        std::chrono::steady_clock::time_point when) = 0;
+                        IClock::time_point when) = 0;
 
   virtual void ProcessSchedule(mq::IContext& ctx) = 0;
 
+  /// @brief Get the time of the earliest scheduled message if any
+  [[nodiscard]] virtual std::optional<IClock::time_point>
+  GetNextDeadline() = 0;
+
   template<
     typename Scheduler, typename... Args,
     typename = std::enable_if_t<std::is_base_of_v<IScheduler, Scheduler>>>
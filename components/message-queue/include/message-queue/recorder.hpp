@@ -0,0 +1,265 @@
+#pragma once
+#include "message-queue/interfaces.hpp"
+
+#include <any>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <esp_log.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <utils/utils.hpp>
+#include <vector>
+
+namespace mq {
+/// @brief Converts #mq::Message payloads to bytes and back
+///
+/// `std::any` can not be serialized generically (and RTTI is disabled on the
+/// target), so every payload type that has to survive a record/replay round
+/// trip is registered here under a one-byte tag.
+class PayloadCodec {
+public:
+  using Bytes = std::vector<std::uint8_t>;
+  using Encoder = std::function<bool(const std::any&, Bytes&)>;
+  using Decoder = std::function<std::any(const Bytes&)>;
+
+  static constexpr std::uint8_t TAG_NONE = 0x00U;     ///< no payload
+  static constexpr std::uint8_t TAG_UNKNOWN = 0xFFU;  ///< unregistered type
+
+  /// @brief Register a payload type with custom conversion functions
+  ///
+  /// @param tag A unique tag written to the log
+  /// @param encoder Returns false if the payload is not of its type
+  /// @param decoder Rebuilds the payload from the recorded bytes
+  void Add(std::uint8_t tag, Encoder encoder, Decoder decoder)
+  {
+    if (tag == TAG_NONE || tag == TAG_UNKNOWN)
+      throw std::invalid_argument{"the payload tag is reserved"};
+    if (!encoder || !decoder)
+      throw std::invalid_argument{"the payload codec can not be null"};
+    m_entries.push_back(Entry{tag, std::move(encoder), std::move(decoder)});
+  }
+
+  /// @brief Register a trivially copyable payload type stored as raw bytes
+  template<typename T,
+           typename = std::enable_if_t<std::is_trivially_copyable_v<T>>>
+  void Add(std::uint8_t tag)
+  {
+    Add(
+      tag,
+      [](const std::any& any, Bytes& out) {
+        const auto* value = std::any_cast<T>(&any);
+        if (!value)
+          return false;
+        out.resize(sizeof(T));
+        std::memcpy(out.data(), value, sizeof(T));
+        return true;
+      },
+      [](const Bytes& in) {
+        if (in.size() != sizeof(T))
+          throw std::invalid_argument{"the payload size mismatch"};
+        T value;
+        std::memcpy(&value, in.data(), sizeof(T));
+        return std::any{value};
+      });
+  }
+
+  /// @brief Serialize a payload
+  ///
+  /// @return The tag of the matched type, #TAG_NONE or #TAG_UNKNOWN
+  [[nodiscard]] std::uint8_t Encode(const std::any& data, Bytes& out) const
+  {
+    out.clear();
+    if (!data.has_value())
+      return TAG_NONE;
+    for (const auto& entry : m_entries)
+      if (entry.encoder(data, out))
+        return entry.tag;
+    out.clear();
+    return TAG_UNKNOWN;
+  }
+
+  /// @brief Deserialize a payload, an unknown tag yields an empty payload
+  [[nodiscard]] std::any Decode(std::uint8_t tag, const Bytes& in) const
+  {
+    for (const auto& entry : m_entries)
+      if (entry.tag == tag)
+        return entry.decoder(in);
+    return {};
+  }
+
+private:
+  struct Entry {
+    std::uint8_t tag;
+    Encoder encoder;
+    Decoder decoder;
+  };
+  std::vector<Entry> m_entries;
+};
+
+/// @brief A single entry of the message log
+struct Record {
+  enum class Kind : std::uint8_t {
+    ePush,     ///< the message was pushed into the context
+    eDispatch, ///< the message was dispatched to the systems
+  };
+  static constexpr unsigned NO_PRIORITY = 0xFFU; ///< dispatch records
+
+  Kind kind{Kind::ePush};
+  unsigned priority{NO_PRIORITY};
+  Addr from{NONE};
+  Addr to{NONE};
+  std::chrono::microseconds timestamp{}; ///< since the start of recording
+  std::uint8_t tag{PayloadCodec::TAG_NONE};
+  PayloadCodec::Bytes payload;
+};
+
+/// @brief Binary layout of the message log
+///
+/// The file starts with #MAGIC and #VERSION followed by records, every record
+/// is a little-endian #HEADER_SIZE bytes header followed by the payload:
+/// kind(1) priority(1) from.sys(2) from.ev(2) to.sys(2) to.ev(2)
+/// timestamp_us(8) tag(1) payload_size(2)
+namespace record_format {
+constexpr std::array<std::uint8_t, 4> MAGIC{'M', 'Q', 'R', 'L'};
+constexpr std::uint8_t VERSION = 1U;
+constexpr std::size_t HEADER_SIZE = 21U;
+constexpr std::size_t MAX_PAYLOAD = 0xFFFFU;
+} // namespace record_format
+
+/// @brief An #mq::IContext decorator writing every pushed and dispatched
+/// message to a binary log
+///
+/// The systems must be constructed with the recorder (not the decorated
+/// context) to have their pushes recorded. The recorder installs a tap system
+/// into the decorated context, so it must outlive the decorated context. The
+/// log is a plain file, so the same code writes to the SD card on the target
+/// and to a regular file on the host; the log is read back by #mq::LogReader.
+class Recorder : public IContext {
+  /// Sees every dispatched message as an observer (#mq::Id::eNone) system
+  class Tap final : public ISystem {
+    Recorder& m_recorder;
+
+  public:
+    explicit Tap(Recorder& recorder) noexcept : m_recorder{recorder} {}
+    void Process(const Message& message) override
+    {
+      m_recorder.m_Write(Record::Kind::eDispatch, message,
+                         Record::NO_PRIORITY);
+    }
+    [[nodiscard]] Id GetId() const noexcept override { return Id::eNone; }
+  };
+
+  static constexpr const char* TAG = "RECORDER";
+
+  IContext& m_ctx;
+  const PayloadCodec& m_codec;
+  const IClock& m_clock;
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> m_file;
+  const IClock::time_point m_start;
+  std::mutex m_mutex;
+  PayloadCodec::Bytes m_buffer;
+
+  void m_Write(Record::Kind kind, const Message& message, unsigned priority)
+  {
+    using namespace record_format;
+    const auto timestamp = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(m_clock.Now() -
+                                                            m_start)
+        .count());
+
+    std::scoped_lock lock{m_mutex};
+    auto tag = m_codec.Encode(message.data, m_buffer);
+    if (m_buffer.size() > MAX_PAYLOAD) {
+      ESP_LOGW(TAG, "The payload is too big to be recorded: %u bytes",
+               static_cast<unsigned>(m_buffer.size()));
+      tag = PayloadCodec::TAG_UNKNOWN;
+      m_buffer.clear();
+    }
+    const auto size = static_cast<std::uint16_t>(m_buffer.size());
+
+    const std::array<std::uint8_t, HEADER_SIZE> header{
+      utils::EnumValue(kind),
+      static_cast<std::uint8_t>(priority),
+      utils::GetByteByIndex<0>(utils::EnumValue(message.from.sys)),
+      utils::GetByteByIndex<1>(utils::EnumValue(message.from.sys)),
+      utils::GetByteByIndex<0>(message.from.ev),
+      utils::GetByteByIndex<1>(message.from.ev),
+      utils::GetByteByIndex<0>(utils::EnumValue(message.to.sys)),
+      utils::GetByteByIndex<1>(utils::EnumValue(message.to.sys)),
+      utils::GetByteByIndex<0>(message.to.ev),
+      utils::GetByteByIndex<1>(message.to.ev),
+      utils::GetByteByIndex<0>(timestamp),
+      utils::GetByteByIndex<1>(timestamp),
+      utils::GetByteByIndex<2>(timestamp),
+      utils::GetByteByIndex<3>(timestamp),
+      utils::GetByteByIndex<4>(timestamp),
+      utils::GetByteByIndex<5>(timestamp),
+      utils::GetByteByIndex<6>(timestamp),
+      utils::GetByteByIndex<7>(timestamp),
+      tag,
+      utils::GetByteByIndex<0>(size),
+      utils::GetByteByIndex<1>(size)};
+
+    if (std::fwrite(header.data(), 1U, header.size(), m_file.get()) !=
+          header.size() ||
+        std::fwrite(m_buffer.data(), 1U, m_buffer.size(), m_file.get()) !=
+          m_buffer.size())
+      ESP_LOGE(TAG, "Failed to write a record");
+  }
+
+public:
+  /// @param ctx The decorated context
+  /// @param codec Payload types to serialize, must outlive the recorder
+  /// @param path The log file, it is truncated if exists
+  /// @param clock The source of the record timestamps
+  Recorder(IContext& ctx, const PayloadCodec& codec, const char* path,
+           const IClock& clock = SteadyClock::Instance())
+    : IContext(ctx.GetNumPriorities())
+    , m_ctx{ctx}
+    , m_codec{codec}
+    , m_clock{clock}
+    , m_file{std::fopen(path, "wb"), &std::fclose}
+    , m_start{m_clock.Now()}
+  {
+    if (!m_file)
+      throw std::runtime_error{"Failed to open the message log"};
+    if (std::fwrite(record_format::MAGIC.data(), 1U,
+                    record_format::MAGIC.size(),
+                    m_file.get()) != record_format::MAGIC.size() ||
+        std::fputc(record_format::VERSION, m_file.get()) == EOF)
+      throw std::runtime_error{"Failed to write the message log header"};
+    m_ctx.AddSystem(std::make_shared<Tap>(*this));
+  }
+
+  void Push(Message message, unsigned priority) override
+  {
+    m_Write(Record::Kind::ePush, message, priority);
+    m_ctx.Push(std::move(message), priority);
+  }
+  using IContext::Push;
+
+  void AddSystem(std::shared_ptr<ISystem> system) override
+  {
+    m_ctx.AddSystem(std::move(system));
+  }
+
+  [[nodiscard]] bool ProcessOneMessage() override
+  {
+    return m_ctx.ProcessOneMessage();
+  }
+
+  /// @brief Flush the buffered records to the file
+  void Flush()
+  {
+    std::scoped_lock lock{m_mutex};
+    std::fflush(m_file.get());
+  }
+};
+} // namespace mq
@@ -0,0 +1,135 @@
+#pragma once
+#include "message-queue/interfaces.hpp"
+#include "message-queue/recorder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <utils/utils.hpp>
+
+namespace mq {
+/// @brief Sequential reader of a log written by #mq::Recorder
+class LogReader {
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> m_file;
+
+public:
+  explicit LogReader(const char* path)
+    : m_file{std::fopen(path, "rb"), &std::fclose}
+  {
+    if (!m_file)
+      throw std::runtime_error{"Failed to open the message log"};
+    std::array<std::uint8_t, record_format::MAGIC.size() + 1U> header{};
+    if (std::fread(header.data(), 1U, header.size(), m_file.get()) !=
+          header.size() ||
+        !std::equal(record_format::MAGIC.cbegin(), record_format::MAGIC.cend(),
+                    header.cbegin()) ||
+        header.back() != record_format::VERSION)
+      throw std::runtime_error{"Not a message log"};
+  }
+
+  /// @brief Read the next record
+  ///
+  /// @return std::nullopt at the end of the log, a truncated trailing record
+  /// (e.g. after a power loss) is treated as the end of the log
+  [[nodiscard]] std::optional<Record> Next()
+  {
+    std::array<std::uint8_t, record_format::HEADER_SIZE> h{};
+    if (std::fread(h.data(), 1U, h.size(), m_file.get()) != h.size())
+      return std::nullopt;
+
+    Record record;
+    record.kind = static_cast<Record::Kind>(h[0]);
+    record.priority = h[1];
+    record.from =
+      Addr{static_cast<Id>(utils::AssembleBytes<std::uint16_t>(h[2], h[3])),
+           utils::AssembleBytes<std::uint16_t>(h[4], h[5])};
+    record.to =
+      Addr{static_cast<Id>(utils::AssembleBytes<std::uint16_t>(h[6], h[7])),
+           utils::AssembleBytes<std::uint16_t>(h[8], h[9])};
+    record.timestamp =
+      std::chrono::microseconds{utils::AssembleBytes<std::uint64_t>(
+        h[10], h[11], h[12], h[13], h[14], h[15], h[16], h[17])};
+    record.tag = h[18];
+    record.payload.resize(utils::AssembleBytes<std::uint16_t>(h[19], h[20]));
+    if (std::fread(record.payload.data(), 1U, record.payload.size(),
+                   m_file.get()) != record.payload.size())
+      return std::nullopt;
+    return record;
+  }
+};
+
+/// @brief Feeds a recorded message stream back into a context
+///
+/// Only the records accepted by the filter are pushed, by default all the
+/// #mq::Record::Kind::ePush ones. A filter sees the records of every kind.
+/// Messages which the systems under replay generate themselves (e.g.
+/// replies) should be filtered out to avoid duplicates.
+///
+/// The recorded timing is kept on the given clock: with a #VirtualClock the
+/// replay jumps over the gaps, so hours of traffic replay at the CPU speed.
+class Replayer {
+public:
+  enum class Speed {
+    eRealTime,         ///< keep the recorded inter-message timing
+    eAsFastAsPossible, ///< drain the context before every next message
+  };
+  using Filter = std::function<bool(const Record&)>;
+
+  /// @param clock The clock the recorded timing is kept on
+  Replayer(IContext& ctx, const PayloadCodec& codec, Filter filter = nullptr,
+           IClock& clock = SteadyClock::Instance())
+    : m_ctx{ctx}, m_codec{codec}, m_filter{std::move(filter)}, m_clock{clock}
+  {
+  }
+
+  /// @brief Replay the whole log
+  ///
+  /// @return The number of pushed messages
+  std::size_t Run(LogReader& reader, Speed speed)
+  {
+    std::size_t count{};
+    const auto start = m_clock.Now();
+
+    while (auto record = reader.Next()) {
+      if (m_filter ? !m_filter(*record)
+                   : record->kind != Record::Kind::ePush)
+        continue;
+
+      if (speed == Speed::eRealTime) {
+        const auto due = start + record->timestamp;
+        // the other threads may push meanwhile
+        while (m_clock.Now() < due)
+          if (!m_ctx.ProcessOneMessage())
+            m_clock.SleepUntil(std::min<IClock::time_point>(
+              due, m_clock.Now() + std::chrono::milliseconds{1}));
+      }
+      else
+        while (m_ctx.ProcessOneMessage()) {}
+
+      const auto priority = record->priority < m_ctx.GetNumPriorities()
+                              ? record->priority
+                              : m_ctx.GetNumPriorities() - 1;
+      m_ctx.Push(Message{record->from, record->to,
+                         m_codec.Decode(record->tag, record->payload)},
+                 priority);
+      ++count;
+    }
+
+    while (m_ctx.ProcessOneMessage()) {}
+    return count;
+  }
+
+private:
+  IContext& m_ctx;
+  const PayloadCodec& m_codec;
+  Filter m_filter;
+  IClock& m_clock;
+};
+} // namespace mq
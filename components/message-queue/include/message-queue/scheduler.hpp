@@ -5,6 +5,7 @@
 #include <chrono>
 #include <esp_log.h>
 #include <mutex>
+#include <optional>
 #include <set>
 #include <utils/utils.hpp>
 
@@ -13,7 +14,7 @@ class Scheduler : public IScheduler {
   struct ScheduledMessage {
     Message message;
     unsigned priority;
-    std::chrono::steady_clock::time_point when;
+    IClock::time_point when;
   };
 
   struct Comparator {
@@ -43,8 +44,13 @@ class Scheduler : public IScheduler {
   std::mutex m_mutex;
 
 public:
+  explicit Scheduler(const IClock& clock = SteadyClock::Instance()) noexcept
+    : IScheduler(clock)
+  {
+  }
+
   void Schedule(Message message, unsigned priority,
-                std::chrono::steady_clock::time_point when) override
+                IClock::time_point when) override
   {
     ESP_LOGV("SCHEDULER",
              "Planing: sys %d, ev %d | sys %d, ev %d | has value %d",
@@ -59,7 +65,7 @@ public:
   {
     std::scoped_lock lock{m_mutex};
     auto first = m_messages.begin();
-    auto last = m_messages.upper_bound(std::chrono::steady_clock::now());
+    auto last = m_messages.upper_bound(m_clock.Now());
     auto it = first;
     try {
       for (; it != last; std::advance(it, 1)) {
@@ -78,5 +84,13 @@ public:
     }
     m_messages.erase(first, last);
   }
+
+  [[nodiscard]] std::optional<IClock::time_point> GetNextDeadline() override
+  {
+    std::scoped_lock lock{m_mutex};
+    if (m_messages.empty())
+      return std::nullopt;
+    return m_messages.begin()->when;
+  }
 };
 } // namespace mq
@@ -0,0 +1,76 @@
+#pragma once
+#include "message-queue/interfaces.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+namespace mq {
+/// @brief A manually driven clock for the discrete-event simulation
+///
+/// The time never moves by itself, it only jumps forward by #Advance and
+/// #AdvanceTo, so hours of schedules run at the CPU speed on the host.
+class VirtualClock final : public IClock {
+  std::atomic<time_point::rep> m_now;
+
+public:
+  explicit VirtualClock(time_point start = {}) noexcept
+    : m_now{start.time_since_epoch().count()}
+  {
+  }
+
+  [[nodiscard]] time_point Now() const noexcept override
+  {
+    return time_point{time_point::duration{m_now.load()}};
+  }
+
+  /// @brief Jump to the time at once, see #AdvanceTo
+  void SleepUntil(time_point when) override { AdvanceTo(when); }
+
+  /// @brief Move the time forward, a time point in the past is ignored
+  void AdvanceTo(time_point when) noexcept
+  {
+    auto now = m_now.load();
+    const auto target = when.time_since_epoch().count();
+    while (now < target && !m_now.compare_exchange_weak(now, target)) {}
+  }
+
+  template<typename Rep, typename Period>
+  void Advance(const std::chrono::duration<Rep, Period>& duration) noexcept
+  {
+    AdvanceTo(Now() + duration);
+  }
+};
+
+/// @brief Run the systems in the virtual time
+///
+/// Drains the context, then jumps the clock straight to the next scheduled
+/// message, until nothing is scheduled before the end of the period.
+///
+/// @param ctx The context the scheduled messages are pushed into
+/// @param scheduler The scheduler driven by the clock
+/// @param clock The clock of the scheduler
+/// @param period The virtual time to simulate
+/// @return The number of processed messages
+template<typename Rep, typename Period>
+std::size_t Simulate(IContext& ctx, IScheduler& scheduler, VirtualClock& clock,
+                     const std::chrono::duration<Rep, Period>& period)
+{
+  const auto end = clock.Now() + period;
+  std::size_t count{};
+
+  for (;;) {
+    scheduler.ProcessSchedule(ctx);
+    while (ctx.ProcessOneMessage())
+      ++count;
+
+    const auto next = scheduler.GetNextDeadline();
+    if (!next || *next > end)
+      break;
+    clock.AdvanceTo(*next);
+  }
+
+  clock.AdvanceTo(end);
+  return count;
+}
+} // namespace mq
@@ -0,0 +1,140 @@
+#pragma once
+#include "esp_log.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <message-queue/interfaces.hpp>
+#include <mqtt-helper/mqtt-helper.hpp>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <utils/utils.hpp>
+#include <vector>
+
+/// @brief Connects the MQTT topics to the message queue addresses
+///
+/// An inbound publish matching a route filter is pushed to the route address
+/// as an #Inbound message, so the MQTT task only assembles and enqueues the
+/// message and the handling runs in the message loop.
+/// A slow handler can then delay other systems but not the keepalives or the
+/// rest of the inbound stream. In the other direction, a payload sent to an
+/// event of the bridge is published to the topic of the route of that event.
+class MqttBridge final : public mq::ISystem {
+  static constexpr const char *TAG = "MQTT-BRIDGE";
+
+public:
+  /// @brief The payload of the inbound messages, the topic and the payload
+  /// are shared with the other routes without copying
+  using Inbound = mqtt::InboundMessage;
+
+  /// @brief The publishes matching #filter go to #to
+  struct InboundRoute {
+    std::string filter;
+    mq::Addr to;
+    mqtt::QoS qos; ///< of the subscription
+    unsigned priority;
+  };
+
+  /// @brief A `std::string` sent to the bridge event #ev is published to
+  /// #topic
+  struct OutboundRoute {
+    decltype(mq::Addr::ev) ev;
+    std::string topic;
+    mqtt::QoS qos;
+    bool retain;
+  };
+
+  /// @throws std::invalid_argument if a filter is already handled by the
+  /// client, an inbound priority is not one of the context or an event has
+  /// several outbound routes
+  MqttBridge(mq::IContext &ctx, std::shared_ptr<mqtt::Client> mqttClient,
+             std::vector<InboundRoute> inbound,
+             std::vector<OutboundRoute> outbound, std::uint8_t instance = 0)
+      : m_ctx{ctx}, m_mqttClient{std::move(mqttClient)},
+        m_id{mq::MakeId(mq::Id::eMqttBridge, instance)},
+        m_inbound{std::move(inbound)} {
+    if (!m_mqttClient)
+      throw std::invalid_argument{"the MQTT client can not be null"};
+    for (const auto &route : m_inbound)
+      if (route.priority >= m_ctx.GetNumPriorities())
+        throw std::invalid_argument{"invalid inbound route priority"};
+
+    for (auto &route : outbound) {
+      if (m_FindOutbound(route.ev))
+        throw std::invalid_argument{"duplicate outbound route"};
+      auto topic = m_mqttClient->InternTopic(route.topic);
+      m_outbound.push_back(Outbound{std::move(route), topic});
+    }
+
+    for (auto it = m_inbound.cbegin(); it != m_inbound.cend(); ++it) {
+      const auto &route = *it;
+      // a handler may still be running when the bridge is destroyed, so it
+      // captures only the context
+      const bool added = m_mqttClient->AddFilterHandler(
+          route.filter,
+          [&ctx = m_ctx, from = mq::Addr{m_id, 0}, to = route.to,
+           priority = route.priority](const Inbound &message) {
+            ctx.Push(mq::Message{from, to, message}, priority);
+          });
+      if (!added) {
+        m_RemoveInbound(it);
+        throw std::invalid_argument{"the topic filter is already handled"};
+      }
+      m_mqttClient->Subscribe(route.filter, route.qos);
+    }
+  }
+
+  ~MqttBridge() override { m_RemoveInbound(m_inbound.cend()); }
+
+  void Process(const mq::Message &msg) override {
+    if (msg.to.sys != GetId())
+      return;
+    const auto *outbound = m_FindOutbound(msg.to.ev);
+    const auto *payload = std::any_cast<std::string>(&msg.data);
+    if (!outbound || !payload) {
+      ESP_LOGW(TAG, "No outbound route for event %u",
+               static_cast<unsigned>(msg.to.ev));
+      return;
+    }
+    const auto &route = outbound->route;
+    if ((outbound->topic
+             ? m_mqttClient->PublishAsync(*outbound->topic, *payload,
+                                          route.qos, route.retain)
+             : m_mqttClient->PublishAsync(route.topic, *payload, route.qos,
+                                          route.retain)) ==
+        mqtt::Client::ERROR_ID)
+      ESP_LOGW(TAG, "Failed to publish to %s", route.topic.c_str());
+  }
+
+  [[nodiscard]] mq::Id GetId() const noexcept final { return m_id; }
+
+private:
+  struct Outbound {
+    OutboundRoute route;
+    std::optional<mqtt::Topic> topic; // interned if the cache had space
+  };
+
+  mq::IContext &m_ctx;
+  std::shared_ptr<mqtt::Client> m_mqttClient;
+  const mq::Id m_id;
+  const std::vector<InboundRoute> m_inbound;
+  std::vector<Outbound> m_outbound;
+
+  [[nodiscard]] const Outbound *
+  m_FindOutbound(decltype(mq::Addr::ev) ev) const {
+    const auto it =
+        std::find_if(m_outbound.cbegin(), m_outbound.cend(),
+                     [ev](const auto &o) { return o.route.ev == ev; });
+    return it == m_outbound.cend() ? nullptr : &*it;
+  }
+
+  /// Remove the handlers and the subscriptions of the routes before last
+  void m_RemoveInbound(std::vector<InboundRoute>::const_iterator last) {
+    for (auto it = m_inbound.cbegin(); it != last; ++it) {
+      m_mqttClient->RemoveFilterHandler(it->filter);
+      m_mqttClient->Unsubscribe(it->filter);
+    }
+  }
+};
@@ -0,0 +1,209 @@
+#pragma once
+#include "mqtt-helper/transport.hpp"
+
+#include <cstring>
+#include <esp_log.h>
+#include <esp_tls.h>
+#include <memory>
+#include <mqtt_client.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace mqtt {
+/// @brief The esp-mqtt client as an #ITransport
+class EspTransport final : public ITransport {
+public:
+  static constexpr int DEFAULT_BUFFER_SIZE = 8192;
+  static constexpr int KEEP_ALIVE = 30; // seconds
+
+  /// @param clientId esp-mqtt derives one from the MAC address if empty
+  /// @param rootCert The PEM of the CA of the broker for the TLS, it is
+  /// parsed once into the esp-tls global CA store shared by the
+  /// reconnections. The store is process-wide: a different CA replaces the
+  /// one of every other connection using the store.
+  /// @param clientCert, privateKey The PEMs for the client authentication,
+  /// both or none. esp-tls parses them on every handshake, esp-mqtt takes
+  /// no parsed ones.
+  /// @param persistentSession Ask the broker to keep the session (the
+  /// subscriptions and the undelivered QoS 1 messages) over a reconnection,
+  /// so nothing needs to be resubscribed. Requires a stable client ID.
+  EspTransport(std::string_view url, std::string_view clientId,
+               std::string_view rootCert, std::string_view clientCert,
+               std::string_view privateKey,
+               unsigned bufferSize = DEFAULT_BUFFER_SIZE,
+               bool persistentSession = false)
+    : m_clientCert{clientCert}
+    , m_privateKey{privateKey}
+    , m_pClient{nullptr, &esp_mqtt_client_destroy}
+  {
+    if (persistentSession && clientId.empty())
+      throw std::invalid_argument{"a persistent session needs a client ID"};
+    if (m_clientCert.empty() != m_privateKey.empty())
+      throw std::invalid_argument{"the client certificate needs its key"};
+
+    // the configuration strings are copied by esp_mqtt_client_init
+    const std::string uri{url};
+    const std::string id{clientId};
+    esp_mqtt_client_config_t mqttCfg{};
+    mqttCfg.uri = uri.c_str();
+    if (!id.empty())
+      mqttCfg.client_id = id.c_str();
+    mqttCfg.disable_clean_session = persistentSession;
+    if (!rootCert.empty()) {
+      m_LoadCaStore(rootCert);
+      mqttCfg.use_global_ca_store = true;
+    }
+    // esp-mqtt keeps the pointers, the PEM lengths are implied by the
+    // null terminators
+    if (!m_clientCert.empty()) {
+      mqttCfg.client_cert_pem = m_clientCert.c_str();
+      mqttCfg.client_key_pem = m_privateKey.c_str();
+    }
+    mqttCfg.event_handle = m_MqttEventHandler;
+    mqttCfg.buffer_size = bufferSize;
+    mqttCfg.keepalive = KEEP_ALIVE;
+    mqttCfg.user_context = this;
+
+    if (esp_mqtt_client_handle_t pClient = esp_mqtt_client_init(&mqttCfg);
+        pClient)
+      m_pClient.reset(pClient);
+    else
+      throw std::runtime_error{"Failed to connect to the MQTT broker"};
+  }
+  EspTransport(const EspTransport&) = delete;
+  EspTransport& operator=(const EspTransport&) = delete;
+  EspTransport(EspTransport&&) = delete;
+  EspTransport& operator=(EspTransport&&) = delete;
+  ~EspTransport() override = default;
+
+  void Start(ITransportHandler& handler) override
+  {
+    m_handler = &handler;
+    esp_mqtt_client_start(m_pClient.get());
+  }
+
+  int Subscribe(const char* filter, QoS qos) override
+  {
+    return esp_mqtt_client_subscribe(m_pClient.get(), filter,
+                                     qos == QoS::e0 ? 0 : 1);
+  }
+
+  int Unsubscribe(const char* filter) override
+  {
+    return esp_mqtt_client_unsubscribe(m_pClient.get(), filter);
+  }
+
+  int Publish(const char* topic, std::string_view data, QoS qos,
+              bool retain) override
+  {
+    return esp_mqtt_client_publish(m_pClient.get(), topic, data.data(),
+                                   static_cast<int>(data.size()),
+                                   qos == QoS::e0 ? 0 : 1, retain ? 1 : 0);
+  }
+
+  int Enqueue(const char* topic, std::string_view data, QoS qos, bool retain,
+              bool store) override
+  {
+    return esp_mqtt_client_enqueue(m_pClient.get(), topic, data.data(),
+                                   static_cast<int>(data.size()),
+                                   qos == QoS::e0 ? 0 : 1, retain ? 1 : 0,
+                                   store);
+  }
+
+private:
+  static constexpr const char* TAG = "MQTT";
+
+  // referred to by the esp-mqtt configuration, must outlive the client
+  const std::string m_clientCert;
+  const std::string m_privateKey;
+
+  ITransportHandler* m_handler{};
+
+  std::unique_ptr<std::remove_pointer_t<esp_mqtt_client_handle_t>,
+                  decltype(&esp_mqtt_client_destroy)>
+    m_pClient;
+
+  /// Parse the CA certificate into the process-wide esp-tls global CA store
+  /// unless it is already there, so neither the reconnections nor other
+  /// clients with the same broker parse it again. A different CA replaces
+  /// the store, esp_tls_set_global_ca_store would append to the chain.
+  static void m_LoadCaStore(std::string_view rootCert)
+  {
+    static std::mutex mutex;
+    static std::string loaded;
+    std::scoped_lock lock{mutex};
+    if (loaded == rootCert)
+      return;
+    loaded.assign(rootCert);
+    esp_tls_free_global_ca_store();
+    // the length of a PEM includes the null terminator
+    if (esp_tls_set_global_ca_store(
+          reinterpret_cast<const unsigned char*>(loaded.c_str()),
+          static_cast<unsigned>(loaded.size() + 1U)) != ESP_OK) {
+      loaded.clear();
+      throw std::invalid_argument{"Failed to parse the root certificate"};
+    }
+  }
+
+  static esp_err_t m_MqttEventHandler(esp_mqtt_event_handle_t pEvent)
+  {
+    auto& self = *static_cast<EspTransport*>(pEvent->user_context);
+    auto& handler = *self.m_handler;
+
+    switch (pEvent->event_id) {
+    case MQTT_EVENT_BEFORE_CONNECT: ESP_LOGD(TAG, "BEFORE_CONNECT"); break;
+    case MQTT_EVENT_CONNECTED:
+      ESP_LOGI(TAG, "CONNECTED");
+      handler.OnConnected(pEvent->session_present);
+      break;
+    case MQTT_EVENT_DISCONNECTED:
+      ESP_LOGI(TAG, "DISCONNECTED");
+      handler.OnDisconnected();
+      break;
+    case MQTT_EVENT_SUBSCRIBED:
+      ESP_LOGD(TAG, "SUBSCRIBED");
+      handler.OnSubscribed(pEvent->msg_id);
+      break;
+    case MQTT_EVENT_UNSUBSCRIBED: ESP_LOGD(TAG, "UNSUBSCRIBED"); break;
+    case MQTT_EVENT_PUBLISHED: ESP_LOGD(TAG, "PUBLISHED"); break;
+    case MQTT_EVENT_DATA:
+      ESP_LOGD(TAG, "DATA");
+      handler.OnData(DataChunk{
+        std::string_view{
+          pEvent->topic,
+          static_cast<std::string_view::size_type>(pEvent->topic_len)},
+        static_cast<std::size_t>(pEvent->current_data_offset),
+        std::string_view{
+          pEvent->data,
+          static_cast<std::string_view::size_type>(pEvent->data_len)},
+        static_cast<std::size_t>(pEvent->total_data_len)});
+      break;
+    case MQTT_EVENT_ERROR:
+      ESP_LOGD(TAG, "MQTT_EVENT_ERROR");
+      if (pEvent->error_handle->error_type == MQTT_ERROR_TYPE_TCP_TRANSPORT) {
+        ESP_LOGD(TAG, "Last error code reported from esp-tls: 0x%x",
+                 pEvent->error_handle->esp_tls_last_esp_err);
+        ESP_LOGD(TAG, "Last tls stack error number: 0x%x",
+                 pEvent->error_handle->esp_tls_stack_err);
+        ESP_LOGD(TAG, "Last captured errno : %d (%s)",
+                 pEvent->error_handle->esp_transport_sock_errno,
+                 std::strerror(pEvent->error_handle->esp_transport_sock_errno));
+      }
+      else if (pEvent->error_handle->error_type ==
+               MQTT_ERROR_TYPE_CONNECTION_REFUSED)
+        ESP_LOGW(TAG, "Connection refused error: 0x%x",
+                 pEvent->error_handle->connect_return_code);
+      else
+        ESP_LOGW(TAG, "Unknown error type: 0x%x",
+                 pEvent->error_handle->error_type);
+      break;
+    default: ESP_LOGD(TAG, "Other event: %d", pEvent->event_id); break;
+    }
+
+    return ESP_OK;
+  }
+};
+} // namespace mqtt
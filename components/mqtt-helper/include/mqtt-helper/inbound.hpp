@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <message-queue/block-pool.hpp>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace mqtt {
+/// @brief A received message, the topic and the payload in a pooled block
+///
+/// It is as cheap to copy as a pointer and fits into the small-object storage
+/// of `std::any`, so it is passed on to the message queue without copying the
+/// payload. The block returns to the pool of the #Client when the last copy
+/// is released, the client must outlive the copies.
+///
+/// Block layout: the topic length u16 in the native byte order, the topic,
+/// the payload.
+class InboundMessage {
+  static constexpr std::size_t HEADER_SIZE = sizeof(std::uint16_t);
+
+public:
+  /// the topic and the payload of the biggest message: as much as a full
+  /// buffer of the esp-mqtt client of the default size holds
+  static constexpr std::size_t MAX_MESSAGE_SIZE = 8192U;
+  static constexpr std::size_t BLOCK_SIZE = HEADER_SIZE + MAX_MESSAGE_SIZE;
+  using Pool = mq::BlockPool<char, BLOCK_SIZE>;
+
+  InboundMessage() noexcept = default;
+
+  /// @brief Get a block and write the topic into it, the payload is pushed
+  /// to the writer next
+  ///
+  /// @return std::nullopt if the message doesn't fit into a block or the
+  /// pool is exhausted
+  [[nodiscard]] static std::optional<Pool::Writer>
+  Begin(Pool& pool, std::string_view topic, std::size_t payloadSize)
+  {
+    if (topic.size() + payloadSize > MAX_MESSAGE_SIZE)
+      return std::nullopt;
+    auto writer = pool.TryAcquire();
+    if (!writer)
+      return std::nullopt;
+    const auto size = static_cast<std::uint16_t>(topic.size());
+    char header[HEADER_SIZE];
+    std::memcpy(header, &size, HEADER_SIZE);
+    writer->Push(header, HEADER_SIZE);
+    writer->Push(topic.data(), topic.size());
+    return writer;
+  }
+
+  /// @param block A block started with #Begin
+  explicit InboundMessage(Pool::Ref block) noexcept : m_block{std::move(block)}
+  {
+  }
+
+  [[nodiscard]] explicit operator bool() const noexcept
+  {
+    return static_cast<bool>(m_block);
+  }
+
+  [[nodiscard]] std::string_view GetTopic() const noexcept
+  {
+    return m_Get().substr(0, m_GetTopicSize());
+  }
+
+  [[nodiscard]] std::string_view GetPayload() const noexcept
+  {
+    return m_Get().substr(m_GetTopicSize());
+  }
+
+private:
+  Pool::Ref m_block;
+
+  /// The topic and the payload
+  [[nodiscard]] std::string_view m_Get() const noexcept
+  {
+    if (m_block.size() < HEADER_SIZE)
+      return {};
+    return std::string_view{m_block.data() + HEADER_SIZE,
+                            m_block.size() - HEADER_SIZE};
+  }
+
+  [[nodiscard]] std::size_t m_GetTopicSize() const noexcept
+  {
+    std::uint16_t size{};
+    if (m_block.size() >= HEADER_SIZE)
+      std::memcpy(&size, m_block.data(), HEADER_SIZE);
+    return size;
+  }
+};
+static_assert(sizeof(InboundMessage) == sizeof(void*));
+} // namespace mqtt
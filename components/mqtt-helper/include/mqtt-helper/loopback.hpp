@@ -0,0 +1,287 @@
+#pragma once
+#include "mqtt-helper/mqtt-helper.hpp"
+#include "mqtt-helper/transport.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mqtt {
+class LoopbackTransport;
+
+/// @brief An in-process MQTT broker to run a #Client off-target, e.g. in
+/// benchmarks, with a #LoopbackTransport per client
+///
+/// A worker thread plays the role of the esp-mqtt task: the sessions live on
+/// it and every event is delivered from it, one at a time. The messages are
+/// routed to the sessions with a matching filter in the order they are
+/// published, payloads longer than the buffer of a transport are delivered
+/// in several chunks like esp-mqtt does. Retained messages are kept, the QoS
+/// makes no difference since nothing is lost in the process.
+class LoopbackBroker {
+public:
+  LoopbackBroker() : m_worker{[this] { m_Run(); }} {}
+  LoopbackBroker(const LoopbackBroker&) = delete;
+  LoopbackBroker& operator=(const LoopbackBroker&) = delete;
+  LoopbackBroker(LoopbackBroker&&) = delete;
+  LoopbackBroker& operator=(LoopbackBroker&&) = delete;
+
+  /// The transports must be destroyed before
+  ~LoopbackBroker()
+  {
+    {
+      std::scoped_lock lock{m_mutex};
+      m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_worker.join();
+  }
+
+  /// @brief Wait until all the messages and events posted so far are
+  /// delivered, not to be called from a handler
+  void WaitIdle()
+  {
+    std::unique_lock lock{m_mutex};
+    m_idle.wait(lock, [this] { return m_tasks.empty() && !m_busy; });
+  }
+
+private:
+  friend class LoopbackTransport;
+
+  struct Session {
+    ITransportHandler* handler;
+    std::size_t bufferSize;
+    bool connected;
+    std::vector<std::string> filters;
+  };
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_idle;
+  std::deque<std::function<void(void)>> m_tasks;
+  bool m_busy{};
+  bool m_stopping{};
+  std::atomic_int m_lastId{};
+
+  // only used by the worker
+  std::map<const LoopbackTransport*, Session> m_sessions;
+  std::map<std::string, std::string, std::less<>> m_retained;
+
+  std::thread m_worker; // the last member: it uses all the others
+
+  /// Run the task on the worker
+  ///
+  /// @return The message ID of the operation
+  int m_Post(std::function<void(void)> task)
+  {
+    {
+      std::scoped_lock lock{m_mutex};
+      m_tasks.push_back(std::move(task));
+    }
+    m_wake.notify_one();
+    return m_NextId();
+  }
+
+  int m_NextId() noexcept
+  {
+    return m_lastId.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  void m_Run()
+  {
+    std::unique_lock lock{m_mutex};
+    for (;;) {
+      m_wake.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+      if (m_tasks.empty())
+        return;
+      auto task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+      m_busy = true;
+      lock.unlock();
+      task();
+      lock.lock();
+      m_busy = false;
+      if (m_tasks.empty())
+        m_idle.notify_all();
+    }
+  }
+
+  Session* m_FindSession(const LoopbackTransport* transport)
+  {
+    auto it = m_sessions.find(transport);
+    return it != m_sessions.end() ? &it->second : nullptr;
+  }
+
+  void m_Subscribe(const LoopbackTransport* transport, std::string filter,
+                   int msgId)
+  {
+    auto* session = m_FindSession(transport);
+    if (!session || !session->connected)
+      return;
+    if (std::find(session->filters.cbegin(), session->filters.cend(),
+                  filter) == session->filters.cend())
+      session->filters.push_back(filter);
+    // the SUBACK comes before the retained messages
+    session->handler->OnSubscribed(msgId);
+    for (const auto& [topic, payload] : m_retained)
+      if (MatchTopic(filter, topic))
+        m_Deliver(*session, topic, payload);
+  }
+
+  void m_Unsubscribe(const LoopbackTransport* transport,
+                     std::string_view filter)
+  {
+    if (auto* session = m_FindSession(transport); session)
+      session->filters.erase(std::remove(session->filters.begin(),
+                                         session->filters.end(), filter),
+                             session->filters.end());
+  }
+
+  void m_Route(const std::string& topic, const std::string& payload,
+               bool retain)
+  {
+    if (retain && payload.empty())
+      m_retained.erase(topic);
+    else if (retain)
+      m_retained.insert_or_assign(topic, payload);
+
+    for (auto& [transport, session] : m_sessions)
+      if (session.connected &&
+          std::any_of(session.filters.cbegin(), session.filters.cend(),
+                      [&topic](const auto& filter) {
+                        return MatchTopic(filter, topic);
+                      }))
+        m_Deliver(session, topic, payload);
+  }
+
+  static void m_Deliver(Session& session, std::string_view topic,
+                        std::string_view payload)
+  {
+    std::size_t offset{};
+    do {
+      const auto chunk = payload.substr(offset, session.bufferSize);
+      session.handler->OnData(DataChunk{offset ? std::string_view{} : topic,
+                                        offset, chunk, payload.size()});
+      offset += chunk.size();
+    } while (offset < payload.size());
+  }
+};
+
+/// @brief A connection to a #LoopbackBroker
+///
+/// Both #Publish and #Enqueue return at once, the message is routed by the
+/// worker of the broker. The connection can be dropped and restored to
+/// exercise the reconnection logic of the client.
+class LoopbackTransport final : public ITransport {
+public:
+  static constexpr std::size_t DEFAULT_BUFFER_SIZE = 8192U;
+
+  /// @param bufferSize The maximum size of a DATA chunk
+  explicit LoopbackTransport(LoopbackBroker& broker,
+                             std::size_t bufferSize = DEFAULT_BUFFER_SIZE)
+    : m_broker{broker}, m_bufferSize{bufferSize}
+  {
+    if (!bufferSize)
+      throw std::invalid_argument{"the buffer size can not be zero"};
+  }
+  LoopbackTransport(const LoopbackTransport&) = delete;
+  LoopbackTransport& operator=(const LoopbackTransport&) = delete;
+  LoopbackTransport(LoopbackTransport&&) = delete;
+  LoopbackTransport& operator=(LoopbackTransport&&) = delete;
+
+  /// Not to be destroyed from a handler, it waits for the broker
+  ~LoopbackTransport() override
+  {
+    m_broker.m_Post([&broker = m_broker, this] {
+      broker.m_sessions.erase(this);
+    });
+    m_broker.WaitIdle();
+  }
+
+  void Start(ITransportHandler& handler) override
+  {
+    m_broker.m_Post([&broker = m_broker, this, &handler] {
+      broker.m_sessions.insert_or_assign(
+        this, LoopbackBroker::Session{&handler, m_bufferSize, true, {}});
+      handler.OnConnected(false);
+    });
+  }
+
+  int Subscribe(const char* filter, QoS) override
+  {
+    const auto msgId = m_broker.m_NextId();
+    m_broker.m_Post([&broker = m_broker, this, filter = std::string{filter},
+                     msgId]() mutable {
+      broker.m_Subscribe(this, std::move(filter), msgId);
+    });
+    return msgId;
+  }
+
+  int Unsubscribe(const char* filter) override
+  {
+    return m_broker.m_Post(
+      [&broker = m_broker, this, filter = std::string{filter}] {
+        broker.m_Unsubscribe(this, filter);
+      });
+  }
+
+  int Publish(const char* topic, std::string_view data, QoS,
+              bool retain) override
+  {
+    return m_broker.m_Post([&broker = m_broker, topic = std::string{topic},
+                            data = std::string{data}, retain] {
+      broker.m_Route(topic, data, retain);
+    });
+  }
+
+  int Enqueue(const char* topic, std::string_view data, QoS qos, bool retain,
+              bool) override
+  {
+    return Publish(topic, data, qos, retain);
+  }
+
+  /// @brief Drop the connection, the session stays on the broker
+  void Disconnect()
+  {
+    m_broker.m_Post([&broker = m_broker, this] {
+      if (auto* session = broker.m_FindSession(this);
+          session && session->connected) {
+        session->connected = false;
+        session->handler->OnDisconnected();
+      }
+    });
+  }
+
+  /// @brief Restore the connection after #Disconnect
+  ///
+  /// @param sessionPresent Resume the session with its subscriptions,
+  /// otherwise start a clean one
+  void Reconnect(bool sessionPresent)
+  {
+    m_broker.m_Post([&broker = m_broker, this, sessionPresent] {
+      auto* session = broker.m_FindSession(this);
+      if (!session || session->connected)
+        return;
+      if (!sessionPresent)
+        session->filters.clear();
+      session->connected = true;
+      session->handler->OnConnected(sessionPresent);
+    });
+  }
+
+private:
+  LoopbackBroker& m_broker;
+  const std::size_t m_bufferSize;
+};
+} // namespace mqtt
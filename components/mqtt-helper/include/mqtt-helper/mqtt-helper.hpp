@@ -1,17 +1,30 @@
 #pragma once
+#include "mqtt-helper/inbound.hpp"
+#include "mqtt-helper/topic-cache.hpp"
+#include "mqtt-helper/topic-trie.hpp"
+#include "mqtt-helper/transport.hpp"
+#ifdef ESP_PLATFORM
+#include "mqtt-helper/esp-transport.hpp"
+#endif
+
 #include <algorithm>
+#include <array>
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <esp_log.h>
 #include <functional>
 #include <memory>
-#include <mqtt_client.h>
 #include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <stdexcept>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 namespace mqtt {
 constexpr bool MatchTopic(std::string_view filter,
@@ -19,29 +32,32 @@ constexpr bool MatchTopic(std::string_view filter,
 {
   using namespace std::literals::string_view_literals;
 
-  if (filter.empty() && topic.empty())
-    return true;
-
+  // only the empty filter matches the empty topic
   if (filter.empty() || topic.empty())
-    return false;
-
-  if (filter == "#"sv)
-    return topic.front() != '$';
+    return filter.empty() && topic.empty();
 
-  if (filter.front() == '+' && topic.front() == '$')
+  // the wildcards do not match the topics starting with '$'
+  if (topic.front() == '$' && (filter.front() == '+' || filter.front() == '#'))
     return false;
 
-  if (auto plus = filter.find('+'), slash = topic.find('/', plus);
-      plus != std::string_view::npos &&
-      topic.substr(0, plus) == filter.substr(0, plus))
-    return MatchTopic(plus < filter.length() ? filter.substr(plus + 1) : ""sv,
-                      slash < topic.length() ? topic.substr(slash) : ""sv);
-
-  if (filter.back() == '#')
-    return topic.substr(0, filter.length() - 2) ==
-           filter.substr(0, filter.length() - 2);
-
-  return filter == topic;
+  // level by level
+  for (;;) {
+    const auto filterSlash = filter.find('/');
+    const auto level = filter.substr(0, filterSlash);
+    if (level == "#"sv)
+      return true;
+    const auto topicSlash = topic.find('/');
+    if (level != "+"sv && level != topic.substr(0, topicSlash))
+      return false;
+    if (topicSlash == std::string_view::npos)
+      // "a/#" matches "a" as well
+      return filterSlash == std::string_view::npos ||
+             filter.substr(filterSlash + 1) == "#"sv;
+    if (filterSlash == std::string_view::npos)
+      return false;
+    filter.remove_prefix(filterSlash + 1);
+    topic.remove_prefix(topicSlash + 1);
+  }
 }
 // some tests according to
 // http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718106
@@ -79,214 +95,416 @@ static_assert(MatchTopic("/+", "/finance"));
 static_assert(!MatchTopic("+", "/finance"));
 static_assert(!MatchTopic("+/monitor/Clients", "$SYS/monitor/Clients"));
 static_assert(MatchTopic("$SYS/monitor/+", "$SYS/monitor/Clients"));
-
-enum class QoS : std::uint8_t {
-  e0,
-  e1,
-};
-
-class Client {
+static_assert(!MatchTopic("a/#", "a$/x"));
+static_assert(MatchTopic("a/+/#", "a/b"));
+static_assert(MatchTopic("a/+/#", "a/"));
+static_assert(!MatchTopic("a/+/#", "a"));
+static_assert(MatchTopic("a//b", "a//b"));
+static_assert(!MatchTopic("a/b", "a/b/"));
+
+class Client final : private ITransportHandler {
 public:
-  static constexpr int ERROR_ID = -1;
-  static constexpr int DEFAULT_BUFFER_SIZE = 8192;
-  static constexpr int KEEP_ALIVE = 30; // seconds
+  static constexpr int ERROR_ID = ITransport::ERROR_ID;
+  static constexpr std::size_t TOPIC_CACHE_SIZE = 1024U;
+  static constexpr std::size_t DEFAULT_INBOUND_BLOCKS = 4U;
+
+  /// @param transport The connection to the broker, it is started here
+  /// @param inboundBlocks The number of the messages the filter handlers may
+  /// hold at a time, see #AddFilterHandler
+  explicit Client(std::unique_ptr<ITransport> transport,
+                  std::function<void(void)> connectCallback = nullptr,
+                  std::function<void(void)> disconnectCallback = nullptr,
+                  std::size_t inboundBlocks = DEFAULT_INBOUND_BLOCKS)
+    : m_inboundPool{inboundBlocks}
+    , m_connectCallback{connectCallback}
+    , m_disconnectCallback{disconnectCallback}
+    , m_transport{std::move(transport)}
+  {
+    if (!m_transport)
+      throw std::invalid_argument{"the transport can not be null"};
+    m_transport->Start(*this);
+  }
+
+#ifdef ESP_PLATFORM
+  static constexpr int DEFAULT_BUFFER_SIZE = EspTransport::DEFAULT_BUFFER_SIZE;
+  static_assert(InboundMessage::MAX_MESSAGE_SIZE >= DEFAULT_BUFFER_SIZE,
+                "a full buffer must fit into an inbound block");
 
+  /// @brief Connect through esp-mqtt, see #EspTransport for the parameters
   Client(std::string_view url, std::string_view clientId,
          std::string_view rootCert, std::string_view clientCert,
          std::string_view privateKey,
          std::function<void(void)> connectCallback = nullptr,
          std::function<void(void)> disconnectCallback = nullptr,
-         unsigned bufferSize = DEFAULT_BUFFER_SIZE)
-    : m_pClient{nullptr, &esp_mqtt_client_destroy}
-    , m_connectCallback{connectCallback}
-    , m_disconnectCallback{disconnectCallback}
+         unsigned bufferSize = DEFAULT_BUFFER_SIZE,
+         bool persistentSession = false,
+         std::size_t inboundBlocks = DEFAULT_INBOUND_BLOCKS)
+    : Client{std::make_unique<EspTransport>(url, clientId, rootCert,
+                                            clientCert, privateKey,
+                                            bufferSize, persistentSession),
+             std::move(connectCallback), std::move(disconnectCallback),
+             inboundBlocks}
   {
-    esp_mqtt_client_config_t mqttCfg{};
-    mqttCfg.uri = url.data();
-    // mqttCfg.client_id = clientId.data();
-    // mqttCfg.cert_pem = rootCert.data();
-    // mqttCfg.client_cert_pem = clientCert.data();
-    // mqttCfg.client_key_pem = privateKey.data();
-    mqttCfg.event_handle = m_MqttEventHandler;
-    mqttCfg.buffer_size = bufferSize;
-    mqttCfg.keepalive = KEEP_ALIVE;
-    mqttCfg.user_context = this;
-
-    if (esp_mqtt_client_handle_t pClient = esp_mqtt_client_init(&mqttCfg);
-        pClient)
-      m_pClient.reset(pClient);
-    else
-      throw std::runtime_error{"Failed to connect to the MQTT broker"};
-
-    esp_mqtt_client_start(m_pClient.get());
   }
+#endif
+
   Client(const Client&) = delete;
   Client& operator=(const Client&) = delete;
   Client(Client&&) = delete;
   Client& operator=(Client&&) = delete;
   ~Client() = default;
 
-  bool AddFilterHandler(
-    std::string_view topicFilter,
-    std::function<void(std::string&&, std::string&&)> callback)
+  /// @brief Register a handler of the messages matching the filter
+  ///
+  /// All the handlers of the overlapping filters get the same message. It is
+  /// assembled in a pooled block, a handler keeps the block by keeping a copy
+  /// of the message. A message bigger than
+  /// #InboundMessage::MAX_MESSAGE_SIZE or one which arrives when all the
+  /// blocks are held is dropped and counted, a bigger payload needs a chunk
+  /// handler.
+  bool AddFilterHandler(std::string_view topicFilter,
+                        std::function<void(const InboundMessage&)> callback)
   {
     std::scoped_lock lock{m_topicHandlersMutex};
-    return m_topicHandlers.emplace(topicFilter, std::move(callback)).second;
+    return m_topicHandlers.Insert(
+      topicFilter, std::make_shared<TopicHandler>(std::move(callback)));
   }
 
   void RemoveFilterHandler(std::string_view topicFilter)
   {
     std::scoped_lock lock{m_topicHandlersMutex};
-    m_topicHandlers.erase(std::string{topicFilter});
+    m_topicHandlers.Erase(topicFilter);
+  }
+
+  /// @brief Register a handler getting the messages chunk by chunk as they
+  /// arrive from the broker, without buffering the whole payload
+  ///
+  /// The handler gets (topic, offset, chunk, total payload length) for every
+  /// chunk, e.g. to write a big payload straight to a file.
+  bool AddChunkHandler(std::string_view topicFilter,
+                       std::function<void(std::string_view, std::size_t,
+                                          std::string_view, std::size_t)>
+                         callback)
+  {
+    std::scoped_lock lock{m_topicHandlersMutex};
+    return m_chunkHandlers.Insert(
+      topicFilter, std::make_shared<ChunkHandler>(std::move(callback)));
+  }
+
+  void RemoveChunkHandler(std::string_view topicFilter)
+  {
+    std::scoped_lock lock{m_topicHandlersMutex};
+    m_chunkHandlers.Erase(topicFilter);
   }
 
   int Subscribe(std::string_view topicFilter, QoS qos)
   {
+    std::string filter{topicFilter};
     {
       std::scoped_lock lock{m_subscriptionListMutex};
-      m_subscriptionList.emplace(std::string{topicFilter}, qos);
+      m_subscriptionList.insert_or_assign(filter,
+                                          Subscription{qos, false, ERROR_ID});
+      m_pendingUnsubscriptions.erase(filter);
     }
-    ESP_LOGI(TAG, "Subscribing to '%s'", topicFilter.data());
-    return m_isConnected.load(std::memory_order_relaxed)
-             ? esp_mqtt_client_subscribe(
-                 m_pClient.get(), topicFilter.data(), qos == QoS::e0 ? 0 : 1)
-             : ERROR_ID;
+    ESP_LOGI(TAG, "Subscribing to '%s'", filter.c_str());
+    const auto msgId =
+      m_isConnected.load(std::memory_order_relaxed)
+        ? m_transport->Subscribe(filter.c_str(), qos)
+        : ERROR_ID;
+    if (msgId != ERROR_ID) {
+      std::scoped_lock lock{m_subscriptionListMutex};
+      m_Track(filter, msgId);
+    }
+    return msgId;
   }
 
   int Unsubscribe(std::string_view topic)
   {
-    {
-      std::scoped_lock lock{m_subscriptionListMutex};
-      m_subscriptionList.erase(std::string{topic});
+    std::string filter{topic};
+    const auto msgId =
+      m_isConnected.load(std::memory_order_relaxed)
+        ? m_transport->Unsubscribe(filter.c_str())
+        : ERROR_ID;
+    std::scoped_lock lock{m_subscriptionListMutex};
+    if (auto it = m_subscriptionList.find(filter);
+        it != m_subscriptionList.end()) {
+      // a persistent session keeps the subscription until it is cancelled,
+      // one in flight may be kept too
+      if ((it->second.sent || it->second.msgId != ERROR_ID) &&
+          msgId == ERROR_ID)
+        m_pendingUnsubscriptions.insert(filter);
+      m_subscriptionList.erase(it);
     }
-    return m_isConnected.load(std::memory_order_relaxed)
-             ? esp_mqtt_client_unsubscribe(m_pClient.get(), topic.data())
-             : ERROR_ID;
+    return msgId;
+  }
+
+  /// @brief Store the topic for the publishing without allocations
+  ///
+  /// @return std::nullopt if the topic cache is full
+  [[nodiscard]] std::optional<Topic> InternTopic(std::string_view topic)
+  {
+    return m_topicCache.Intern(topic);
   }
 
   int Publish(std::string_view topic, std::string_view data, QoS qos,
               bool retain = 0)
   {
-    return m_isConnected.load(std::memory_order_relaxed)
-             ? esp_mqtt_client_publish(
-                 m_pClient.get(), topic.data(), data.data(), data.size(),
-                 qos == QoS::e0 ? 0 : 1, retain)
-             : ERROR_ID;
+    return m_WithCStr(topic, [&](const char* cTopic) {
+      return m_Publish(cTopic, data, qos, retain);
+    });
+  }
+
+  int Publish(const Topic& topic, std::string_view data, QoS qos,
+              bool retain = false)
+  {
+    return m_Publish(topic.c_str(), data, qos, retain);
   }
 
   int PublishAsync(std::string_view topic, std::string_view data, QoS qos,
                    bool retain = false, bool store = false)
   {
-    return m_isConnected.load(std::memory_order_relaxed)
-             ? esp_mqtt_client_enqueue(
-                 m_pClient.get(), topic.data(), data.data(), data.size(),
-                 qos == QoS::e0 ? 0 : 1, retain ? 1 : 0, store)
-             : ERROR_ID;
+    return m_WithCStr(topic, [&](const char* cTopic) {
+      return m_PublishAsync(cTopic, data, qos, retain, store);
+    });
+  }
+
+  int PublishAsync(const Topic& topic, std::string_view data, QoS qos,
+                   bool retain = false, bool store = false)
+  {
+    return m_PublishAsync(topic.c_str(), data, qos, retain, store);
+  }
+
+  [[nodiscard]] bool IsConnected() const noexcept
+  {
+    return m_isConnected.load(std::memory_order_relaxed);
+  }
+
+  /// @brief Get the number of the messages the filter handlers didn't get
+  [[nodiscard]] std::size_t GetInboundDrops() const noexcept
+  {
+    return m_inboundDrops.load(std::memory_order_relaxed);
   }
 
 private:
   static constexpr const char* TAG = "MQTT";
 
-  // topicFilter -> topicHandler(topic, payload)
-  std::unordered_map<std::string,
-                     std::function<void(std::string&&, std::string&&)>>
-    m_topicHandlers;
+  using TopicHandler = std::function<void(const InboundMessage&)>;
+  TopicTrie<std::shared_ptr<TopicHandler>> m_topicHandlers;
   std::mutex m_topicHandlersMutex;
-
-  std::pair<std::string, std::string> m_messageInFlight; // {topic, payload}
-
+  // chunkHandler(topic, offset, chunk, total)
+  using ChunkHandler = std::function<void(std::string_view, std::size_t,
+                                          std::string_view, std::size_t)>;
+  TopicTrie<std::shared_ptr<ChunkHandler>> m_chunkHandlers;
+  // the handlers matching the message in flight, only used by the MQTT task
+  std::vector<std::shared_ptr<TopicHandler>> m_matchedHandlers;
+  std::vector<std::shared_ptr<ChunkHandler>> m_matchedChunkHandlers;
+
+  InboundMessage::Pool m_inboundPool;
+  std::atomic<std::size_t> m_inboundDrops{};
+  // the message in flight, only used by the MQTT task
+  std::string m_topicInFlight;
+  std::optional<InboundMessage::Pool::Writer> m_payloadInFlight;
+
+  struct Subscription {
+    QoS qos;
+    bool sent; ///< acknowledged, kept by the broker if the session is resumed
+    int msgId; ///< of the SUBSCRIBE waiting for its SUBACK, or #ERROR_ID
+  };
+  static constexpr std::size_t MAX_EARLY_ACKS = 8U;
   std::mutex m_subscriptionListMutex;
-  std::unordered_map<std::string, QoS> m_subscriptionList;
-
-  std::unique_ptr<std::remove_pointer_t<esp_mqtt_client_handle_t>,
-                  decltype(&esp_mqtt_client_destroy)>
-    m_pClient;
+  std::unordered_map<std::string, Subscription> m_subscriptionList;
+  std::unordered_set<std::string> m_pendingUnsubscriptions;
+  // SUBACKs which came before the message ID was recorded
+  std::vector<int> m_earlyAcks;
 
   std::function<void(void)> m_connectCallback{};
   std::function<void(void)> m_disconnectCallback{};
 
   std::atomic_bool m_isConnected{};
 
-  static esp_err_t m_MqttEventHandler(esp_mqtt_event_handle_t pEvent)
+  TopicCache<TOPIC_CACHE_SIZE> m_topicCache;
+
+  /// Restore the subscriptions after a connection. The ones acknowledged in
+  /// a resumed session are skipped. The rest are sent back to back from a
+  /// snapshot of the list: the broker acknowledges them in parallel and the
+  /// list is not locked meanwhile. esp-mqtt doesn't support several topics in
+  /// one SUBSCRIBE packet. The unsubscriptions which fail to be sent stay
+  /// pending for the next connection.
+  void m_Resubscribe(bool sessionPresent)
   {
-    auto& self = *static_cast<Client*>(pEvent->user_context);
-
-    switch (pEvent->event_id) {
-    case MQTT_EVENT_BEFORE_CONNECT: ESP_LOGD(TAG, "BEFORE_CONNECT"); break;
-    case MQTT_EVENT_CONNECTED: {
-      ESP_LOGI(TAG, "CONNECTED");
-      self.m_isConnected.store(true, std::memory_order_relaxed);
-      std::scoped_lock lock{self.m_subscriptionListMutex};
-      for (const auto& [topic, qos] : self.m_subscriptionList)
-        esp_mqtt_client_subscribe(
-          self.m_pClient.get(), topic.data(), qos == QoS::e0 ? 0 : 1);
-      if (self.m_connectCallback) {
-        self.m_connectCallback();
-      }
-    } break;
-    case MQTT_EVENT_DISCONNECTED:
-      ESP_LOGI(TAG, "DISCONNECTED");
-      self.m_isConnected.store(false, std::memory_order_relaxed);
-      if (self.m_disconnectCallback) {
-        self.m_disconnectCallback();
-      }
-      break;
-    case MQTT_EVENT_SUBSCRIBED: ESP_LOGD(TAG, "SUBSCRIBED"); break;
-    case MQTT_EVENT_UNSUBSCRIBED: ESP_LOGD(TAG, "UNSUBSCRIBED"); break;
-    case MQTT_EVENT_PUBLISHED: ESP_LOGD(TAG, "PUBLISHED"); break;
-    case MQTT_EVENT_DATA: {
-      ESP_LOGD(TAG, "DATA");
-      auto [topic, payload] = self.m_messageInFlight;
-
-      // the first message block event includes the topic
-      if (pEvent->topic) {
-        topic =
-          std::string{pEvent->topic,
-                      static_cast<std::string::size_type>(pEvent->topic_len)};
-        payload.reserve(pEvent->total_data_len);
+    std::vector<std::pair<std::string, QoS>> subscriptions;
+    std::vector<std::string> unsubscriptions;
+    {
+      std::scoped_lock lock{m_subscriptionListMutex};
+      m_earlyAcks.clear();
+      for (auto& [filter, subscription] : m_subscriptionList)
+        if (!sessionPresent || !subscription.sent) {
+          subscriptions.emplace_back(filter, subscription.qos);
+          subscription.sent = false;
+          subscription.msgId = ERROR_ID;
+        }
+      if (sessionPresent)
+        unsubscriptions.assign(m_pendingUnsubscriptions.cbegin(),
+                               m_pendingUnsubscriptions.cend());
+      m_pendingUnsubscriptions.clear();
+    }
+    ESP_LOGI(TAG, "Session %s, %u subscriptions to restore",
+             sessionPresent ? "resumed" : "new",
+             static_cast<unsigned>(subscriptions.size()));
+
+    std::vector<std::pair<std::string, int>> sent;
+    for (const auto& [filter, qos] : subscriptions)
+      if (const auto msgId = m_transport->Subscribe(filter.c_str(), qos);
+          msgId != ERROR_ID)
+        sent.emplace_back(filter, msgId);
+    std::vector<std::string> failed;
+    for (auto& filter : unsubscriptions)
+      if (m_transport->Unsubscribe(filter.c_str()) == ERROR_ID)
+        failed.push_back(std::move(filter));
+
+    std::scoped_lock lock{m_subscriptionListMutex};
+    for (const auto& [filter, msgId] : sent)
+      m_Track(filter, msgId);
+    // unless the filter was subscribed to again meanwhile
+    for (auto& filter : failed)
+      if (!m_subscriptionList.count(filter))
+        m_pendingUnsubscriptions.insert(std::move(filter));
+  }
+
+  /// Record the SUBSCRIBE in flight, its SUBACK may have come first. Called
+  /// with the list locked.
+  void m_Track(const std::string& filter, int msgId)
+  {
+    const auto ack = std::find(m_earlyAcks.begin(), m_earlyAcks.end(), msgId);
+    const bool acknowledged = ack != m_earlyAcks.end();
+    if (acknowledged)
+      m_earlyAcks.erase(ack);
+    if (auto it = m_subscriptionList.find(filter);
+        it != m_subscriptionList.end()) {
+      it->second.sent = acknowledged;
+      it->second.msgId = acknowledged ? ERROR_ID : msgId;
+    }
+  }
+
+  /// Call the function with a null-terminated copy of the topic, on the
+  /// stack unless it is unusually long
+  template<typename Function>
+  static int m_WithCStr(std::string_view topic, Function&& function)
+  {
+    constexpr std::size_t MAX_STACK_TOPIC = 127U;
+    if (topic.size() > MAX_STACK_TOPIC)
+      return function(std::string{topic}.c_str());
+    std::array<char, MAX_STACK_TOPIC + 1U> cTopic;
+    *std::copy(topic.cbegin(), topic.cend(), cTopic.begin()) = '\0';
+    return function(cTopic.data());
+  }
+
+  int m_Publish(const char* topic, std::string_view data, QoS qos,
+                bool retain)
+  {
+    return m_isConnected.load(std::memory_order_relaxed)
+             ? m_transport->Publish(topic, data, qos, retain)
+             : ERROR_ID;
+  }
+
+  int m_PublishAsync(const char* topic, std::string_view data, QoS qos,
+                     bool retain, bool store)
+  {
+    return m_isConnected.load(std::memory_order_relaxed)
+             ? m_transport->Enqueue(topic, data, qos, retain, store)
+             : ERROR_ID;
+  }
+
+  void OnConnected(bool sessionPresent) override
+  {
+    m_isConnected.store(true, std::memory_order_relaxed);
+    m_Resubscribe(sessionPresent);
+    if (m_connectCallback) {
+      m_connectCallback();
+    }
+  }
+
+  void OnSubscribed(int msgId) override
+  {
+    std::scoped_lock lock{m_subscriptionListMutex};
+    for (auto& [filter, subscription] : m_subscriptionList)
+      if (subscription.msgId == msgId) {
+        subscription.sent = true;
+        subscription.msgId = ERROR_ID;
+        return;
       }
+    // an unsubscribed filter leaves its SUBACK here, the oldest goes first
+    if (m_earlyAcks.size() == MAX_EARLY_ACKS)
+      m_earlyAcks.erase(m_earlyAcks.begin());
+    m_earlyAcks.push_back(msgId);
+  }
+
+  void OnDisconnected() override
+  {
+    m_isConnected.store(false, std::memory_order_relaxed);
+    if (m_disconnectCallback) {
+      m_disconnectCallback();
+    }
+  }
 
-      payload.append(pEvent->data,
-                     static_cast<std::string::size_type>(pEvent->data_len));
-
-      if (static_cast<int>(payload.length()) == pEvent->total_data_len) {
-        std::scoped_lock lock{self.m_topicHandlersMutex};
-        // see https://dev.to/maniowy/capture-structured-bindings-in-c-17-4hlb
-        if (auto it = std::find_if(
-              self.m_topicHandlers.begin(), self.m_topicHandlers.end(),
-              [&topic = topic](const auto& element) {
-                return MatchTopic(element.first, topic);
-              });
-            it != self.m_topicHandlers.end())
-          it->second(std::move(topic), std::move(payload));
-        else
-          ESP_LOGD(TAG, "A message from %.*s topic is ignored",
-                   pEvent->topic_len, pEvent->topic);
+  /// A message bigger than the MQTT buffer comes in several DATA events: the
+  /// payload is assembled in a pooled block and only if there are
+  /// whole-message handlers, the chunk handlers get every chunk in place
+  void OnData(const DataChunk& data) override
+  {
+    const auto offset = data.offset;
+    const auto total = data.total;
+    const auto chunk = data.data;
+
+    // the first message block event includes the topic
+    if (!offset) {
+      m_topicInFlight.assign(data.topic);
+      m_payloadInFlight.reset();
+      m_matchedHandlers.clear();
+      m_matchedChunkHandlers.clear();
+      {
+        std::scoped_lock lock{m_topicHandlersMutex};
+        m_topicHandlers.Match(m_topicInFlight, [this](const auto& h) {
+          m_matchedHandlers.push_back(h);
+        });
+        m_chunkHandlers.Match(m_topicInFlight, [this](const auto& h) {
+          m_matchedChunkHandlers.push_back(h);
+        });
       }
-    } break;
-    case MQTT_EVENT_ERROR:
-      ESP_LOGD(TAG, "MQTT_EVENT_ERROR");
-      if (pEvent->error_handle->error_type == MQTT_ERROR_TYPE_TCP_TRANSPORT) {
-        ESP_LOGD(TAG, "Last error code reported from esp-tls: 0x%x",
-                 pEvent->error_handle->esp_tls_last_esp_err);
-        ESP_LOGD(TAG, "Last tls stack error number: 0x%x",
-                 pEvent->error_handle->esp_tls_stack_err);
-        ESP_LOGD(TAG, "Last captured errno : %d (%s)",
-                 pEvent->error_handle->esp_transport_sock_errno,
-                 std::strerror(pEvent->error_handle->esp_transport_sock_errno));
+      if (m_matchedHandlers.empty() && m_matchedChunkHandlers.empty())
+        ESP_LOGD(TAG, "A message from %s topic is ignored",
+                 m_topicInFlight.c_str());
+      if (!m_matchedHandlers.empty()) {
+        m_payloadInFlight =
+          InboundMessage::Begin(m_inboundPool, m_topicInFlight, total);
+        if (!m_payloadInFlight) {
+          m_inboundDrops.fetch_add(1U, std::memory_order_relaxed);
+          ESP_LOGW(TAG, "Dropped a message of %u bytes from %s",
+                   static_cast<unsigned>(total), m_topicInFlight.c_str());
+        }
       }
-      else if (pEvent->error_handle->error_type ==
-               MQTT_ERROR_TYPE_CONNECTION_REFUSED)
-        ESP_LOGW(TAG, "Connection refused error: 0x%x",
-                 pEvent->error_handle->connect_return_code);
-      else
-        ESP_LOGW(TAG, "Unknown error type: 0x%x",
-                 pEvent->error_handle->error_type);
-      break;
-    default: ESP_LOGD(TAG, "Other event: %d", pEvent->event_id); break;
     }
 
-    return ESP_OK;
+    for (const auto& handler : m_matchedChunkHandlers)
+      (*handler)(m_topicInFlight, offset, chunk, total);
+    if (m_payloadInFlight)
+      m_payloadInFlight->Push(chunk.data(), chunk.size());
+
+    if (offset + chunk.size() < total)
+      return;
+
+    // the handlers are called without the lock
+    if (m_payloadInFlight) {
+      const InboundMessage message{std::move(*m_payloadInFlight).Seal()};
+      m_payloadInFlight.reset();
+      for (const auto& handler : m_matchedHandlers)
+        (*handler)(message);
+    }
+    m_matchedHandlers.clear();
+    m_matchedChunkHandlers.clear();
   }
+
+  // the last member: the transport calls back until it is destroyed
+  std::unique_ptr<ITransport> m_transport;
 };
 } // namespace mqtt
@@ -0,0 +1,352 @@
+#pragma once
+#include "mqtt-helper/mqtt-helper.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <esp_log.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utility>
+#include <utils/crc.hpp>
+#include <utils/utils.hpp>
+
+namespace mqtt {
+/// @brief A persistent FIFO of messages to publish once the broker is back
+///
+/// The messages are appended to a ring log in a file of a fixed size, e.g.
+/// on the SD card or a flash partition. When the ring is full, the oldest
+/// messages are dropped. The read and write cursors are kept in two header
+/// slots written alternately, each with a sequence number and a CRC, so a
+/// torn header write leaves the previous cursors intact. A message is
+/// synced to the file before the write cursor covers it. #Pop commits the
+/// read cursor before it returns the message, so no message is sent twice,
+/// even across a reboot, and a crash before the client takes the message
+/// loses it. #Restore puts back the message the client refuses.
+///
+/// File layout: two 32-byte header slots, then the ring of records. A record
+/// is a little-endian header (topic length u16, payload length u32, QoS u8,
+/// CRC-32 u32 of the preceding fields, the topic and the payload) followed by
+/// the topic and the payload, and it may wrap around the end of the ring.
+class Outbox {
+public:
+  struct Message {
+    std::string topic;
+    std::string payload;
+    QoS qos;
+  };
+
+  /// @param path The log file, created if it does not exist
+  /// @param capacity The size of the ring in bytes for a new file, an
+  /// existing file keeps its size
+  Outbox(const char* path, std::size_t capacity)
+    : m_file{std::fopen(path, "r+b"), &std::fclose}
+  {
+    if (m_file && m_Open())
+      return;
+
+    ESP_LOGI(TAG, "Creating %s", path);
+    if (capacity <= RECORD_HEADER_SIZE || capacity > UINT32_MAX)
+      throw std::invalid_argument{"invalid outbox capacity"};
+    m_file.reset(std::fopen(path, "w+b"));
+    if (!m_file)
+      throw std::runtime_error{"Failed to create the outbox file"};
+    m_capacity = static_cast<std::uint32_t>(capacity);
+    // reserve the whole ring to not run out of space while offline
+    const std::array<std::uint8_t, 512> zeros{};
+    for (std::size_t size = DATA_OFFSET + capacity; size;) {
+      const auto chunk = std::min(size, zeros.size());
+      if (std::fwrite(zeros.data(), 1U, chunk, m_file.get()) != chunk)
+        throw std::runtime_error{"Failed to allocate the outbox file"};
+      size -= chunk;
+    }
+    m_Commit();
+  }
+  Outbox(const Outbox&) = delete;
+  Outbox& operator=(const Outbox&) = delete;
+  Outbox(Outbox&&) = delete;
+  Outbox& operator=(Outbox&&) = delete;
+  ~Outbox() = default;
+
+  /// @brief Append a message, dropping the oldest ones if the ring is full
+  ///
+  /// @return false if the message can't fit the ring or the write failed
+  bool Push(std::string_view topic, std::string_view payload, QoS qos)
+  {
+    const auto size = RECORD_HEADER_SIZE + topic.size() + payload.size();
+    if (size > m_capacity || topic.size() > UINT16_MAX)
+      return false;
+
+    std::scoped_lock lock{m_mutex};
+    if (m_write - m_read + size > m_capacity) {
+      while (m_write - m_read + size > m_capacity)
+        m_read += m_ReadRecordSize(m_read);
+      ESP_LOGW(TAG, "The outbox is full, dropped the oldest messages");
+      // the dropped records are overwritten below, so the new read cursor
+      // must be durable before
+      if (!m_Commit())
+        return false;
+    }
+
+    RecordHeader header{};
+    const auto topicSize = static_cast<std::uint16_t>(topic.size());
+    const auto payloadSize = static_cast<std::uint32_t>(payload.size());
+    utils::StoreLittleEndian(header.data(), topicSize);
+    utils::StoreLittleEndian(header.data() + 2, payloadSize);
+    header[6] = static_cast<std::uint8_t>(qos);
+    auto crc = crc::Crc32(gsl::span<const std::uint8_t>{header.data(), 7U});
+    crc = crc::Crc32(payload, crc::Crc32(topic, crc));
+    utils::StoreLittleEndian(header.data() + 7, crc);
+
+    auto position = m_write;
+    const bool written =
+      m_WriteAt(position, header.data(), header.size()) &&
+      m_WriteAt(position += header.size(), topic.data(), topic.size()) &&
+      m_WriteAt(position += topic.size(), payload.data(), payload.size()) &&
+      m_Sync();
+    if (!written)
+      return false;
+    m_write += size;
+    return m_Commit();
+  }
+
+  /// @brief Remove the oldest message and return it, see #Restore
+  ///
+  /// @return std::nullopt if the outbox is empty, the cursor could not be
+  /// written or the log is corrupted, the whole content is dropped in the
+  /// latter case
+  [[nodiscard]] std::optional<Message> Pop()
+  {
+    std::scoped_lock lock{m_mutex};
+    auto message = m_Peek();
+    if (!message)
+      return std::nullopt;
+    m_read += m_popped->size;
+    if (m_Commit())
+      return message;
+    m_read = std::exchange(m_popped, std::nullopt)->position;
+    return std::nullopt;
+  }
+
+  /// @brief Put the message returned by the last #Pop back to the front,
+  /// e.g. when the client refuses it
+  ///
+  /// @return false if the message is gone, i.e. a #Push has overwritten it
+  /// meanwhile, or the cursor could not be written
+  bool Restore()
+  {
+    std::scoped_lock lock{m_mutex};
+    const auto popped = std::exchange(m_popped, std::nullopt);
+    if (!popped || popped->position + popped->size != m_read ||
+        m_write - popped->position > m_capacity)
+      return false;
+    m_read = popped->position;
+    if (m_Commit())
+      return true;
+    m_read += popped->size;
+    return false;
+  }
+
+  [[nodiscard]] bool IsEmpty()
+  {
+    std::scoped_lock lock{m_mutex};
+    return m_read == m_write;
+  }
+
+  /// @brief Get the number of bytes used by the stored messages
+  [[nodiscard]] std::size_t GetSize()
+  {
+    std::scoped_lock lock{m_mutex};
+    return static_cast<std::size_t>(m_write - m_read);
+  }
+
+private:
+  static constexpr const char* TAG = "MQTT-OUTBOX";
+  static constexpr std::uint32_t MAGIC = 0x424F514DU; // "MQOB"
+  static constexpr std::size_t SLOT_SIZE = 32U;
+  static constexpr std::size_t DATA_OFFSET = 2U * SLOT_SIZE;
+  static constexpr std::size_t RECORD_HEADER_SIZE = 11U;
+
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> m_file;
+  std::mutex m_mutex;
+  std::uint32_t m_capacity{};
+  std::uint32_t m_sequence{}; // of the last committed header slot
+  // the cursors only grow, the ring offset is the cursor modulo the capacity
+  std::uint64_t m_read{};
+  std::uint64_t m_write{};
+  struct Popped {
+    std::uint64_t position;
+    std::uint64_t size;
+  };
+  std::optional<Popped> m_popped;
+
+  using RecordHeader = std::array<std::uint8_t, RECORD_HEADER_SIZE>;
+
+  [[nodiscard]] static std::uint16_t
+  m_TopicSize(const RecordHeader& header) noexcept
+  {
+    return utils::LoadLittleEndian<std::uint16_t>(header.data());
+  }
+
+  [[nodiscard]] static std::uint32_t
+  m_PayloadSize(const RecordHeader& header) noexcept
+  {
+    return utils::LoadLittleEndian<std::uint32_t>(header.data() + 2);
+  }
+
+  /// Read the oldest message and note where it is, the mutex is held
+  [[nodiscard]] std::optional<Message> m_Peek()
+  {
+    m_popped.reset();
+    if (m_read == m_write)
+      return std::nullopt;
+
+    RecordHeader header{};
+    Message message{};
+    auto position = m_read;
+    bool valid = m_ReadAt(position, header.data(), header.size());
+    if (valid) {
+      message.topic.resize(m_TopicSize(header));
+      message.payload.resize(m_PayloadSize(header));
+      message.qos = static_cast<QoS>(header[6]);
+      valid = RECORD_HEADER_SIZE + message.topic.size() +
+                  message.payload.size() <=
+                m_write - m_read &&
+              m_ReadAt(position += header.size(), message.topic.data(),
+                       message.topic.size()) &&
+              m_ReadAt(position += message.topic.size(),
+                       message.payload.data(), message.payload.size());
+    }
+    if (valid) {
+      auto crc = crc::Crc32(gsl::span<const std::uint8_t>{header.data(), 7U});
+      crc = crc::Crc32(message.payload, crc::Crc32(message.topic, crc));
+      valid = crc == utils::LoadLittleEndian<std::uint32_t>(header.data() + 7);
+    }
+
+    if (!valid) {
+      ESP_LOGE(TAG, "The outbox is corrupted, dropping its content");
+      m_read = m_write;
+      m_Commit();
+      return std::nullopt;
+    }
+    m_popped = Popped{m_read, RECORD_HEADER_SIZE + message.topic.size() +
+                                  message.payload.size()};
+    return message;
+  }
+
+  [[nodiscard]] bool m_Seek(std::uint64_t offset)
+  {
+    return !fseeko(m_file.get(), static_cast<off_t>(offset), SEEK_SET);
+  }
+
+  [[nodiscard]] bool m_Sync()
+  {
+    return !std::fflush(m_file.get()) && !fsync(fileno(m_file.get()));
+  }
+
+  /// Read the newest valid header slot
+  [[nodiscard]] bool m_Open()
+  {
+    std::array<std::uint8_t, DATA_OFFSET> slots{};
+    if (std::fread(slots.data(), 1U, slots.size(), m_file.get()) !=
+        slots.size())
+      return false;
+    bool found{};
+    for (std::size_t i{}; i < 2U; ++i) {
+      const auto* slot = slots.data() + i * SLOT_SIZE;
+      const auto sequence = utils::LoadLittleEndian<std::uint32_t>(slot + 4);
+      if (utils::LoadLittleEndian<std::uint32_t>(slot) != MAGIC ||
+          utils::LoadLittleEndian<std::uint32_t>(slot + 28) !=
+            crc::Crc32(gsl::span<const std::uint8_t>{slot, 28U}) ||
+          (found && static_cast<std::int32_t>(sequence - m_sequence) < 0))
+        continue;
+      found = true;
+      m_sequence = sequence;
+      m_capacity = utils::LoadLittleEndian<std::uint32_t>(slot + 8);
+      m_read = utils::LoadLittleEndian<std::uint64_t>(slot + 12);
+      m_write = utils::LoadLittleEndian<std::uint64_t>(slot + 20);
+    }
+    if (found)
+      ESP_LOGI(TAG, "%u bytes to send",
+               static_cast<unsigned>(m_write - m_read));
+    return found && m_capacity > RECORD_HEADER_SIZE && m_read <= m_write &&
+           m_write - m_read <= m_capacity;
+  }
+
+  /// Write the cursors into the older header slot
+  bool m_Commit()
+  {
+    std::array<std::uint8_t, SLOT_SIZE> slot{};
+    ++m_sequence;
+    utils::StoreLittleEndian(slot.data(), MAGIC);
+    utils::StoreLittleEndian(slot.data() + 4, m_sequence);
+    utils::StoreLittleEndian(slot.data() + 8, m_capacity);
+    utils::StoreLittleEndian(slot.data() + 12, m_read);
+    utils::StoreLittleEndian(slot.data() + 20, m_write);
+    utils::StoreLittleEndian(slot.data() + 28,
+            crc::Crc32(gsl::span<const std::uint8_t>{slot.data(), 28U}));
+    const bool written =
+      m_Seek((m_sequence & 1U) * SLOT_SIZE) &&
+      std::fwrite(slot.data(), 1U, slot.size(), m_file.get()) == slot.size() &&
+      m_Sync();
+    if (!written)
+      ESP_LOGE(TAG, "Failed to write the cursors");
+    return written;
+  }
+
+  [[nodiscard]] bool m_WriteAt(std::uint64_t position, const void* data,
+                               std::size_t size)
+  {
+    const auto* bytes = static_cast<const std::uint8_t*>(data);
+    while (size) {
+      const auto offset = static_cast<std::size_t>(position % m_capacity);
+      const auto chunk = std::min<std::size_t>(size, m_capacity - offset);
+      if (!m_Seek(DATA_OFFSET + offset) ||
+          std::fwrite(bytes, 1U, chunk, m_file.get()) != chunk)
+        return false;
+      bytes += chunk;
+      position += chunk;
+      size -= chunk;
+    }
+    return true;
+  }
+
+  [[nodiscard]] bool m_ReadAt(std::uint64_t position, void* data,
+                              std::size_t size)
+  {
+    auto* bytes = static_cast<std::uint8_t*>(data);
+    while (size) {
+      const auto offset = static_cast<std::size_t>(position % m_capacity);
+      const auto chunk = std::min<std::size_t>(size, m_capacity - offset);
+      if (!m_Seek(DATA_OFFSET + offset) ||
+          std::fread(bytes, 1U, chunk, m_file.get()) != chunk)
+        return false;
+      bytes += chunk;
+      position += chunk;
+      size -= chunk;
+    }
+    return true;
+  }
+
+  /// The size of the record at the position, the rest of the ring if it
+  /// can't be read
+  [[nodiscard]] std::uint64_t m_ReadRecordSize(std::uint64_t position)
+  {
+    RecordHeader header{};
+    const auto size =
+      m_ReadAt(position, header.data(), header.size())
+        ? RECORD_HEADER_SIZE + m_TopicSize(header) +
+            std::uint64_t{m_PayloadSize(header)}
+        : m_write - position;
+    return std::clamp<std::uint64_t>(size, 1U, m_write - position);
+  }
+};
+} // namespace mqtt
@@ -0,0 +1,57 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <string_view>
+
+namespace mqtt {
+/// @brief A null-terminated topic stored in a #TopicCache
+///
+/// It is as cheap to copy as a pointer and it is valid as long as the cache.
+class Topic {
+  template<std::size_t>
+  friend class TopicCache;
+  std::string_view m_topic;
+
+  explicit Topic(std::string_view topic) noexcept : m_topic{topic} {}
+
+public:
+  [[nodiscard]] const char* c_str() const noexcept { return m_topic.data(); }
+  [[nodiscard]] std::string_view View() const noexcept { return m_topic; }
+};
+
+/// @brief Stores the topics once, e.g. at the startup, so the publishing
+/// doesn't need to build a null-terminated string for every message
+///
+/// @tparam CAPACITY The storage size in bytes, including the terminators
+template<std::size_t CAPACITY>
+class TopicCache {
+  std::array<char, CAPACITY> m_storage{};
+  std::size_t m_used{};
+  std::mutex m_mutex;
+
+public:
+  /// @brief Get the stored copy of the topic, store it if it is new
+  ///
+  /// @return std::nullopt if there is no space left
+  [[nodiscard]] std::optional<Topic> Intern(std::string_view topic)
+  {
+    std::scoped_lock lock{m_mutex};
+    for (std::size_t i{}; i < m_used;) {
+      const std::string_view stored{m_storage.data() + i};
+      if (stored == topic)
+        return Topic{stored};
+      i += stored.size() + 1U;
+    }
+    if (topic.size() + 1U > CAPACITY - m_used ||
+        topic.find('\0') != std::string_view::npos)
+      return std::nullopt;
+    auto* const first = m_storage.data() + m_used;
+    *std::copy(topic.cbegin(), topic.cend(), first) = '\0';
+    m_used += topic.size() + 1U;
+    return Topic{std::string_view{first, topic.size()}};
+  }
+};
+} // namespace mqtt
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mqtt {
+/// @brief An index of MQTT topic filters
+///
+/// The filters are split into levels and stored in a trie where `+` and `#`
+/// are ordinary nodes, so matching a topic visits only the nodes on its path
+/// (plus the wildcard branches) instead of testing every filter, and it finds
+/// all the matching filters. The matching rules are the ones of
+/// #mqtt::MatchTopic.
+template<typename Value>
+class TopicTrie {
+  struct Node {
+    std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+    std::optional<Value> value;
+  };
+
+  Node m_root;
+
+  [[nodiscard]] static std::string_view m_NextLevel(std::string_view& rest,
+                                                    bool& last) noexcept
+  {
+    const auto slash = rest.find('/');
+    last = slash == std::string_view::npos;
+    const auto level = rest.substr(0, slash);
+    rest = last ? std::string_view{} : rest.substr(slash + 1);
+    return level;
+  }
+
+  template<typename Callback>
+  static void m_Match(Node& node, std::string_view rest, bool end, bool first,
+                      Callback& callback)
+  {
+    if (end) {
+      if (node.value)
+        callback(*node.value);
+      // "a/#" matches "a" as well
+      if (auto it = node.children.find("#");
+          it != node.children.end() && it->second->value)
+        callback(*it->second->value);
+      return;
+    }
+
+    bool last{};
+    const auto level = m_NextLevel(rest, last);
+    const bool system = first && !level.empty() && level.front() == '$';
+
+    if (auto it = node.children.find(level); it != node.children.end())
+      m_Match(*it->second, rest, last, false, callback);
+    if (system)
+      return;
+    if (auto it = node.children.find("+"); it != node.children.end())
+      m_Match(*it->second, rest, last, false, callback);
+    if (auto it = node.children.find("#");
+        it != node.children.end() && it->second->value)
+      callback(*it->second->value);
+  }
+
+  static bool m_Erase(Node& node, std::string_view rest, bool end)
+  {
+    if (end) {
+      const bool erased = node.value.has_value();
+      node.value.reset();
+      return erased;
+    }
+    bool last{};
+    const auto level = m_NextLevel(rest, last);
+    auto it = node.children.find(level);
+    if (it == node.children.end() || !m_Erase(*it->second, rest, last))
+      return false;
+    if (!it->second->value && it->second->children.empty())
+      node.children.erase(it);
+    return true;
+  }
+
+public:
+  /// @return false if the filter is already in the index
+  bool Insert(std::string_view filter, Value value)
+  {
+    auto* node = &m_root;
+    for (bool last{}; !last;) {
+      const auto level = m_NextLevel(filter, last);
+      auto it = node->children.find(level);
+      if (it == node->children.end())
+        it = node->children
+               .emplace(std::string{level}, std::make_unique<Node>())
+               .first;
+      node = it->second.get();
+    }
+    if (node->value)
+      return false;
+    node->value.emplace(std::move(value));
+    return true;
+  }
+
+  /// @return false if the filter is not in the index
+  bool Erase(std::string_view filter) { return m_Erase(m_root, filter, false); }
+
+  /// @brief Call the callback with the value of every filter matching the
+  /// topic
+  template<typename Callback>
+  void Match(std::string_view topic, Callback&& callback)
+  {
+    // only the empty filter matches the empty topic
+    if (topic.empty()) {
+      if (auto it = m_root.children.find(""); it != m_root.children.end() &&
+                                              it->second->value)
+        callback(*it->second->value);
+      return;
+    }
+    m_Match(m_root, topic, false, true, callback);
+  }
+};
+} // namespace mqtt
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace mqtt {
+enum class QoS : std::uint8_t {
+  e0,
+  e1,
+};
+
+/// @brief A piece of an inbound message, a message bigger than the buffer of
+/// the transport comes in several chunks
+struct DataChunk {
+  std::string_view topic; ///< only in the first chunk
+  std::size_t offset;     ///< of the chunk in the payload
+  std::string_view data;
+  std::size_t total; ///< the payload length
+};
+
+/// @brief Gets the events of an #ITransport
+///
+/// The events come from the task of the transport, one at a time.
+class ITransportHandler {
+public:
+  virtual void OnConnected(bool sessionPresent) = 0;
+  virtual void OnDisconnected() = 0;
+  /// @brief The broker acknowledged the subscription with the message ID
+  virtual void OnSubscribed(int msgId) = 0;
+  virtual void OnData(const DataChunk& chunk) = 0;
+
+protected:
+  ~ITransportHandler() = default;
+};
+
+/// @brief A connection to an MQTT broker
+///
+/// The strings passed to the transport are null-terminated. The functions
+/// return a message ID or #ERROR_ID.
+class ITransport {
+public:
+  static constexpr int ERROR_ID = -1;
+
+  virtual ~ITransport() = default;
+
+  /// @brief Start connecting, the events go to the handler from now on
+  virtual void Start(ITransportHandler& handler) = 0;
+  virtual int Subscribe(const char* filter, QoS qos) = 0;
+  virtual int Unsubscribe(const char* filter) = 0;
+  /// @brief Send the message from the calling task
+  virtual int Publish(const char* topic, std::string_view data, QoS qos,
+                      bool retain) = 0;
+  /// @brief Send the message from the task of the transport
+  ///
+  /// @param store Keep a QoS 0 message until it is sent
+  virtual int Enqueue(const char* topic, std::string_view data, QoS qos,
+                      bool retain, bool store) = 0;
+};
+} // namespace mqtt
@@ -0,0 +1,376 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <gsl/span>
+#include <limits>
+#include <optional>
+#include <utils/crc.hpp>
+#include <utils/utils.hpp>
+#include <utils/varint.hpp>
+
+/// @brief A block-structured log of one stream of samples
+///
+/// The log is a file of #BLOCK_SIZE blocks, one FAT cluster each, holding
+/// the samples in time order. A block starts with a header:
+///
+/// | offset | size | field                                           |
+/// |--------|------|-------------------------------------------------|
+/// | 0      | 4    | #MAGIC                                          |
+/// | 4      | 1    | #VERSION                                        |
+/// | 5      | 1    | channel                                         |
+/// | 6      | 2    | the number of samples                           |
+/// | 8      | 4    | the block number in the log                     |
+/// | 12     | 4    | CRC-32 of the block without this field          |
+/// | 16     | 8    | the first timestamp, us                         |
+/// | 24     | 8    | the last timestamp, us                          |
+/// | 32     | 4    | the minimum value                               |
+/// | 36     | 4    | the maximum value                               |
+/// | 40     | 1    | the encoding, #Encoding                         |
+///
+/// The rest of the header is reserved. With #Encoding::eColumns, the
+/// timestamps follow as u32 offsets in us from the first one at
+/// #COLUMNS_OFFSET, then the values as i32 at #VALUES_OFFSET, so a reader
+/// can scan one column only. With #Encoding::ePacked, the samples follow the
+/// header as pairs of zigzag varints: the delta-of-delta of the timestamp
+/// and the delta of the value, starting from a zero delta and value in every
+/// block, so a block decodes on its own. All the fields are little-endian.
+///
+/// The sidecar index file holds an #IndexEntry per block, in the block
+/// order, so a time range is found with a binary search over the index. The
+/// index may lag behind the log after a power loss, the missing entries are
+/// then read from the block headers.
+namespace samplelog {
+constexpr std::uint32_t MAGIC = 0x31424C53U; // "SLB1"
+constexpr std::uint8_t VERSION = 1U;
+constexpr std::size_t BLOCK_SIZE = 16U * 1024U;
+constexpr std::size_t HEADER_SIZE = 64U;
+constexpr std::size_t COLUMNS_OFFSET = HEADER_SIZE;
+constexpr std::size_t BLOCK_CAPACITY = (BLOCK_SIZE - HEADER_SIZE) / 8U;
+constexpr std::size_t VALUES_OFFSET = COLUMNS_OFFSET + 4U * BLOCK_CAPACITY;
+constexpr std::size_t INDEX_ENTRY_SIZE = 32U;
+constexpr const char* INDEX_SUFFIX = ".idx";
+/// a packed sample takes 2 bytes at least
+constexpr std::size_t PACKED_CAPACITY = (BLOCK_SIZE - HEADER_SIZE) / 2U;
+static_assert(PACKED_CAPACITY <= UINT16_MAX);
+
+namespace detail {
+[[nodiscard]] inline std::int32_t LoadI32(const std::uint8_t* in) noexcept
+{
+  return static_cast<std::int32_t>(utils::LoadLittleEndian<std::uint32_t>(in));
+}
+} // namespace detail
+
+enum class Encoding : std::uint8_t {
+  eColumns, ///< the raw timestamp and value columns
+  ePacked,  ///< the varint coded deltas
+};
+
+struct Sample {
+  std::uint64_t timestampUs;
+  std::int32_t value;
+};
+
+/// @brief The summary of a block, also the index entry of the block
+struct IndexEntry {
+  std::uint64_t firstUs;
+  std::uint64_t lastUs;
+  std::int32_t minValue;
+  std::int32_t maxValue;
+  std::uint16_t count;
+  Encoding encoding;
+  std::uint8_t channel;
+
+  /// @brief Serialize into #INDEX_ENTRY_SIZE bytes
+  void Store(std::uint8_t* out) const noexcept
+  {
+    std::fill(out, out + INDEX_ENTRY_SIZE, std::uint8_t{});
+    utils::StoreLittleEndian(out, firstUs);
+    utils::StoreLittleEndian(out + 8, lastUs);
+    utils::StoreLittleEndian(out + 16, static_cast<std::uint32_t>(minValue));
+    utils::StoreLittleEndian(out + 20, static_cast<std::uint32_t>(maxValue));
+    utils::StoreLittleEndian(out + 24, count);
+    out[26] = utils::EnumValue(encoding);
+    out[27] = channel;
+  }
+
+  [[nodiscard]] static IndexEntry Load(const std::uint8_t* in) noexcept
+  {
+    return IndexEntry{
+      utils::LoadLittleEndian<std::uint64_t>(in),
+      utils::LoadLittleEndian<std::uint64_t>(in + 8),
+      detail::LoadI32(in + 16), detail::LoadI32(in + 20),
+      utils::LoadLittleEndian<std::uint16_t>(in + 24), Encoding{in[26]},
+      in[27]};
+  }
+};
+
+/// @brief The CRC of a block, the CRC field is skipped
+[[nodiscard]] inline std::uint32_t
+BlockCrc(gsl::span<const std::uint8_t> block) noexcept
+{
+  return crc::Crc32(block.subspan(16U), crc::Crc32(block.first(12U)));
+}
+
+/// @brief Read the summary of a block from its header
+///
+/// @return std::nullopt if the block is not valid
+[[nodiscard]] inline std::optional<IndexEntry>
+ReadHeader(gsl::span<const std::uint8_t> block,
+           std::uint32_t number) noexcept
+{
+  if (block.size() != BLOCK_SIZE)
+    return std::nullopt;
+  const auto* in = block.data();
+  if (utils::LoadLittleEndian<std::uint32_t>(in) != MAGIC ||
+      in[4] != VERSION ||
+      utils::LoadLittleEndian<std::uint32_t>(in + 8) != number ||
+      utils::LoadLittleEndian<std::uint32_t>(in + 12) != BlockCrc(block))
+    return std::nullopt;
+  const auto count = utils::LoadLittleEndian<std::uint16_t>(in + 6);
+  const auto capacity = in[40] == utils::EnumValue(Encoding::eColumns)
+                          ? BLOCK_CAPACITY
+                        : in[40] == utils::EnumValue(Encoding::ePacked)
+                          ? PACKED_CAPACITY
+                          : 0U;
+  if (!count || count > capacity)
+    return std::nullopt;
+  return IndexEntry{
+    utils::LoadLittleEndian<std::uint64_t>(in + 16),
+    utils::LoadLittleEndian<std::uint64_t>(in + 24),
+    detail::LoadI32(in + 32), detail::LoadI32(in + 36),
+    count, Encoding{in[40]}, in[5]};
+}
+
+/// @brief Get a sample of a valid block of #Encoding::eColumns
+[[nodiscard]] inline Sample GetSample(gsl::span<const std::uint8_t> block,
+                                      const IndexEntry& entry,
+                                      std::size_t i) noexcept
+{
+  const auto* in = block.data();
+  return Sample{
+    entry.firstUs +
+      utils::LoadLittleEndian<std::uint32_t>(in + COLUMNS_OFFSET + 4U * i),
+    detail::LoadI32(in + VALUES_OFFSET + 4U * i)};
+}
+
+/// @brief Reads the samples of a valid block in time order
+class BlockDecoder {
+public:
+  BlockDecoder(gsl::span<const std::uint8_t> block,
+               const IndexEntry& entry) noexcept
+    : m_block{block}, m_entry{entry}, m_lastUs{entry.firstUs}
+  {
+  }
+
+  /// @return false after the last sample or if a packed block is cut short
+  bool Next(Sample& sample) noexcept
+  {
+    if (m_index == m_entry.count)
+      return false;
+    if (m_entry.encoding == Encoding::eColumns)
+      sample = GetSample(m_block, m_entry, m_index);
+    else if (!m_Unpack(sample)) {
+      m_index = m_entry.count;
+      return false;
+    }
+    ++m_index;
+    return true;
+  }
+
+  /// @brief Skip the samples before the time
+  void Seek(std::uint64_t timeUs) noexcept
+  {
+    if (m_entry.encoding == Encoding::eColumns) {
+      // the timestamps are sorted
+      std::size_t high = m_entry.count;
+      while (m_index < high) {
+        const auto middle = m_index + (high - m_index) / 2U;
+        if (GetSample(m_block, m_entry, middle).timestampUs < timeUs)
+          m_index = middle + 1U;
+        else
+          high = middle;
+      }
+      return;
+    }
+    for (;;) {
+      const auto before = *this;
+      Sample sample{};
+      if (!Next(sample))
+        return;
+      if (sample.timestampUs >= timeUs) {
+        *this = before;
+        return;
+      }
+    }
+  }
+
+private:
+  gsl::span<const std::uint8_t> m_block;
+  IndexEntry m_entry;
+  std::size_t m_index{};
+  // of #Encoding::ePacked
+  std::size_t m_offset{HEADER_SIZE};
+  std::uint64_t m_lastUs;
+  std::uint64_t m_lastDeltaUs{};
+  std::int64_t m_lastValue{};
+
+  bool m_Unpack(Sample& sample) noexcept
+  {
+    const auto in = m_block.subspan(m_offset);
+    std::uint64_t deltaUs{};
+    const auto timeSize = varint::Decode(in, deltaUs);
+    std::uint64_t delta{};
+    const auto valueSize =
+      timeSize ? varint::Decode(in.subspan(timeSize), delta) : 0U;
+    if (!valueSize)
+      return false;
+    m_offset += timeSize + valueSize;
+    m_lastDeltaUs += static_cast<std::uint64_t>(varint::UnZigZag(deltaUs));
+    m_lastUs += m_lastDeltaUs;
+    m_lastValue += varint::UnZigZag(delta);
+    sample = Sample{m_lastUs, static_cast<std::int32_t>(m_lastValue)};
+    return true;
+  }
+};
+
+/// @brief Fills a block in a caller provided buffer
+class BlockBuilder {
+  gsl::span<std::uint8_t> m_block;
+  IndexEntry m_entry{};
+  // of #Encoding::ePacked
+  std::size_t m_size{HEADER_SIZE};
+  std::uint64_t m_lastDeltaUs{};
+  std::int32_t m_lastValue{};
+
+public:
+  /// @param block #BLOCK_SIZE bytes
+  BlockBuilder(gsl::span<std::uint8_t> block, std::uint8_t channel,
+               Encoding encoding = Encoding::eColumns) noexcept
+    : m_block{block}
+  {
+    m_entry.encoding = encoding;
+    m_entry.channel = channel;
+  }
+
+  /// @return false if the block is full or the sample is older than the
+  /// last one or too far from the first one, the block is unchanged then
+  [[nodiscard]] bool Add(const Sample& sample) noexcept
+  {
+    const auto firstUs = m_entry.count ? m_entry.firstUs : sample.timestampUs;
+    if (m_entry.count && (sample.timestampUs < m_entry.lastUs ||
+                          sample.timestampUs - firstUs >
+                            std::numeric_limits<std::uint32_t>::max()))
+      return false;
+    if (!(m_entry.encoding == Encoding::ePacked ? m_Pack(sample, firstUs)
+                                                : m_Store(sample, firstUs)))
+      return false;
+    if (!m_entry.count) {
+      m_entry.firstUs = sample.timestampUs;
+      m_entry.minValue = m_entry.maxValue = sample.value;
+    }
+    m_entry.lastUs = sample.timestampUs;
+    m_entry.minValue = std::min(m_entry.minValue, sample.value);
+    m_entry.maxValue = std::max(m_entry.maxValue, sample.value);
+    ++m_entry.count;
+    return true;
+  }
+
+  [[nodiscard]] std::size_t GetCount() const noexcept { return m_entry.count; }
+
+  /// @brief Get the number of the used bytes of the block
+  [[nodiscard]] std::size_t GetSize() const noexcept
+  {
+    return m_entry.encoding == Encoding::ePacked
+             ? m_size
+             : HEADER_SIZE + 8U * m_entry.count;
+  }
+
+  [[nodiscard]] Encoding GetEncoding() const noexcept
+  {
+    return m_entry.encoding;
+  }
+
+  /// @brief Change the encoding of an empty block
+  void SetEncoding(Encoding encoding) noexcept
+  {
+    if (!m_entry.count)
+      m_entry.encoding = encoding;
+  }
+
+  /// @brief Write the header and start over
+  ///
+  /// @param number The block number in the log
+  /// @return The summary of the finished block
+  IndexEntry Finish(std::uint32_t number) noexcept
+  {
+    auto* out = m_block.data();
+    // the unused part is zeroed, not to leak old data
+    if (m_entry.encoding == Encoding::ePacked)
+      std::fill(out + m_size, out + BLOCK_SIZE, std::uint8_t{});
+    else {
+      std::fill(out + COLUMNS_OFFSET + 4U * m_entry.count,
+                out + VALUES_OFFSET, std::uint8_t{});
+      std::fill(out + VALUES_OFFSET + 4U * m_entry.count, out + BLOCK_SIZE,
+                std::uint8_t{});
+    }
+    std::fill(out, out + HEADER_SIZE, std::uint8_t{});
+    utils::StoreLittleEndian(out, MAGIC);
+    out[4] = VERSION;
+    out[5] = m_entry.channel;
+    utils::StoreLittleEndian(out + 6, m_entry.count);
+    utils::StoreLittleEndian(out + 8, number);
+    utils::StoreLittleEndian(out + 16, m_entry.firstUs);
+    utils::StoreLittleEndian(out + 24, m_entry.lastUs);
+    utils::StoreLittleEndian(out + 32,
+                             static_cast<std::uint32_t>(m_entry.minValue));
+    utils::StoreLittleEndian(out + 36,
+                             static_cast<std::uint32_t>(m_entry.maxValue));
+    out[40] = utils::EnumValue(m_entry.encoding);
+    utils::StoreLittleEndian(out + 12, BlockCrc(m_block));
+    const auto entry = m_entry;
+    m_entry =
+      IndexEntry{0U, 0U, 0, 0, 0U, entry.encoding, entry.channel};
+    m_size = HEADER_SIZE;
+    m_lastDeltaUs = 0U;
+    m_lastValue = 0;
+    return entry;
+  }
+
+private:
+  bool m_Store(const Sample& sample, std::uint64_t firstUs) noexcept
+  {
+    if (m_entry.count == BLOCK_CAPACITY)
+      return false;
+    auto* out = m_block.data();
+    utils::StoreLittleEndian(
+      out + COLUMNS_OFFSET + 4U * m_entry.count,
+      static_cast<std::uint32_t>(sample.timestampUs - firstUs));
+    utils::StoreLittleEndian(out + VALUES_OFFSET + 4U * m_entry.count,
+                             static_cast<std::uint32_t>(sample.value));
+    return true;
+  }
+
+  bool m_Pack(const Sample& sample, std::uint64_t firstUs) noexcept
+  {
+    const auto deltaUs =
+      sample.timestampUs - (m_entry.count ? m_entry.lastUs : firstUs);
+    std::array<std::uint8_t, 2U * varint::MAX_SIZE> code{};
+    auto size = varint::Encode(
+      varint::ZigZag(static_cast<std::int64_t>(deltaUs - m_lastDeltaUs)),
+      code);
+    size += varint::Encode(
+      varint::ZigZag(std::int64_t{sample.value} - m_lastValue),
+      gsl::span<std::uint8_t>{code}.subspan(size));
+    if (size > BLOCK_SIZE - m_size)
+      return false;
+    std::memcpy(m_block.data() + m_size, code.data(), size);
+    m_size += size;
+    m_lastDeltaUs = deltaUs;
+    m_lastValue = sample.value;
+    return true;
+  }
+};
+} // namespace samplelog
@@ -0,0 +1,98 @@
+#pragma once
+#include "sample-log/reader.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <gsl/span>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace samplelog {
+/// @brief Maps a file read-only, empty if it can not be
+class Mapping {
+public:
+  explicit Mapping(const std::string& path)
+  {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat info {};
+    if (!fstat(fd, &info) && info.st_size > 0) {
+      auto* data = mmap(nullptr, static_cast<std::size_t>(info.st_size),
+                        PROT_READ, MAP_SHARED, fd, 0);
+      if (data != MAP_FAILED) {
+        m_data = static_cast<const std::uint8_t*>(data);
+        m_size = static_cast<std::size_t>(info.st_size);
+      }
+    }
+    close(fd);
+  }
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+  Mapping(Mapping&&) = delete;
+  Mapping& operator=(Mapping&&) = delete;
+  ~Mapping()
+  {
+    if (m_data)
+      munmap(const_cast<std::uint8_t*>(m_data), m_size);
+  }
+
+  [[nodiscard]] gsl::span<const std::uint8_t> Get() const noexcept
+  {
+    return gsl::span<const std::uint8_t>{m_data, m_size};
+  }
+
+private:
+  const std::uint8_t* m_data{};
+  std::size_t m_size{};
+};
+
+/// @brief Reads a log mapped into the memory, for the host tools
+///
+/// The blocks are used in place, a query copies nothing and the page cache
+/// keeps the hot part of a large log.
+class MappedSource {
+public:
+  /// @param path The log file, the index is the same path with #INDEX_SUFFIX
+  explicit MappedSource(const std::string& path)
+    : m_log{path}, m_index{path + INDEX_SUFFIX}
+  {
+    if (m_log.Get().empty())
+      throw std::runtime_error{"Failed to map the log file"};
+  }
+
+  [[nodiscard]] std::uint32_t GetBlockCount() const noexcept
+  {
+    return static_cast<std::uint32_t>(m_log.Get().size() / BLOCK_SIZE);
+  }
+
+  [[nodiscard]] std::uint32_t GetIndexCount() const noexcept
+  {
+    return static_cast<std::uint32_t>(std::min<std::size_t>(
+      m_index.Get().size() / INDEX_ENTRY_SIZE, GetBlockCount()));
+  }
+
+  [[nodiscard]] IndexEntry ReadIndex(std::uint32_t entry) const noexcept
+  {
+    return IndexEntry::Load(m_index.Get().data() +
+                            std::size_t{entry} * INDEX_ENTRY_SIZE);
+  }
+
+  [[nodiscard]] gsl::span<const std::uint8_t>
+  ReadBlock(std::uint32_t block) const noexcept
+  {
+    return m_log.Get().subspan(std::size_t{block} * BLOCK_SIZE, BLOCK_SIZE);
+  }
+
+private:
+  Mapping m_log;
+  Mapping m_index;
+};
+
+using MappedReader = BasicReader<MappedSource>;
+} // namespace samplelog
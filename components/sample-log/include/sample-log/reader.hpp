@@ -0,0 +1,220 @@
+#pragma once
+#include "sample-log/format.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <gsl/span>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+
+namespace samplelog {
+/// @brief The values of a time range
+struct Summary {
+  std::uint64_t count;
+  std::int32_t minValue;
+  std::int32_t maxValue;
+};
+
+/// @brief Queries a log by time ranges
+///
+/// The blocks of a range are found with a binary search over the index, so
+/// a query reads the index entries of the search and the blocks in the range
+/// only. The entries missing from the index are read from the block headers.
+/// A block failing its CRC is skipped and counted.
+///
+/// The Source provides:
+/// - `std::uint32_t GetBlockCount()`, the whole blocks in the log
+/// - `std::uint32_t GetIndexCount()`, the entries in the index
+/// - `IndexEntry ReadIndex(std::uint32_t)`, an entry of the index
+/// - `gsl::span<const std::uint8_t> ReadBlock(std::uint32_t)`, a block, valid
+///   until the next call, empty if it can not be read
+template<typename Source>
+class BasicReader {
+public:
+  template<typename... Args>
+  explicit BasicReader(Args&&... args) : m_source{std::forward<Args>(args)...}
+  {
+  }
+
+  [[nodiscard]] std::uint32_t GetBlockCount()
+  {
+    return m_source.GetBlockCount();
+  }
+
+  /// @brief Get the number of the blocks skipped so far because they are
+  /// not valid
+  [[nodiscard]] std::uint32_t GetErrors() const noexcept { return m_errors; }
+
+  /// @brief Call the callback with every sample in [fromUs, toUs], in time
+  /// order
+  ///
+  /// @return The number of the samples
+  template<typename Callback>
+  std::uint64_t Query(std::uint64_t fromUs, std::uint64_t toUs,
+                      Callback&& callback)
+  {
+    std::uint64_t samples{};
+    const auto blocks = m_source.GetBlockCount();
+    for (auto i = m_FindFirst(fromUs); i < blocks; ++i) {
+      const auto entry = m_GetEntry(i);
+      if (entry && entry->firstUs > toUs)
+        break;
+      const auto block = m_source.ReadBlock(i);
+      const auto header = ReadHeader(block, i);
+      if (!header) {
+        ++m_errors;
+        continue;
+      }
+      BlockDecoder decoder{block, *header};
+      decoder.Seek(fromUs);
+      for (Sample sample{}; decoder.Next(sample) && sample.timestampUs <= toUs;
+           ++samples)
+        callback(sample);
+    }
+    return samples;
+  }
+
+  /// @brief Summarize the values in [fromUs, toUs]
+  ///
+  /// The blocks within the range are summarized from the index, only the
+  /// two blocks at the edges are read.
+  [[nodiscard]] Summary Summarize(std::uint64_t fromUs, std::uint64_t toUs)
+  {
+    Summary summary{0U, std::numeric_limits<std::int32_t>::max(),
+                    std::numeric_limits<std::int32_t>::min()};
+    const auto add = [&summary](std::int32_t minValue,
+                                std::int32_t maxValue) {
+      summary.minValue = std::min(summary.minValue, minValue);
+      summary.maxValue = std::max(summary.maxValue, maxValue);
+    };
+    const auto blocks = m_source.GetBlockCount();
+    for (auto i = m_FindFirst(fromUs); i < blocks; ++i) {
+      const auto entry = m_GetEntry(i);
+      if (entry && entry->firstUs > toUs)
+        break;
+      if (entry && entry->firstUs >= fromUs && entry->lastUs <= toUs) {
+        summary.count += entry->count;
+        add(entry->minValue, entry->maxValue);
+        continue;
+      }
+      // an edge or a block without a summary
+      const auto block = m_source.ReadBlock(i);
+      const auto header = ReadHeader(block, i);
+      if (!header) {
+        ++m_errors;
+        continue;
+      }
+      BlockDecoder decoder{block, *header};
+      decoder.Seek(fromUs);
+      for (Sample sample{}; decoder.Next(sample) && sample.timestampUs <= toUs;
+           ++summary.count)
+        add(sample.value, sample.value);
+    }
+    return summary;
+  }
+
+private:
+  Source m_source;
+  std::uint32_t m_errors{};
+
+  /// The entry from the index or the header, std::nullopt if the block is
+  /// not valid
+  std::optional<IndexEntry> m_GetEntry(std::uint32_t block)
+  {
+    if (block < m_source.GetIndexCount())
+      return m_source.ReadIndex(block);
+    return ReadHeader(m_source.ReadBlock(block), block);
+  }
+
+  /// The first block which may hold samples from the time on
+  std::uint32_t m_FindFirst(std::uint64_t timeUs)
+  {
+    std::uint32_t low{};
+    std::uint32_t high = m_source.GetBlockCount();
+    while (low < high) {
+      const auto middle = low + (high - low) / 2U;
+      // a block without an entry can not be placed, it is read
+      if (const auto entry = m_GetEntry(middle);
+          entry && entry->lastUs < timeUs)
+        low = middle + 1U;
+      else
+        high = middle;
+    }
+    return low;
+  }
+};
+
+/// @brief Reads a log with stdio, a block and an index entry at a time, so
+/// the memory used does not depend on the size of the log
+class FileSource {
+public:
+  /// @param path The log file, the index is the same path with #INDEX_SUFFIX
+  explicit FileSource(const std::string& path)
+    : m_log{std::fopen(path.c_str(), "rb"), &std::fclose}
+    , m_index{std::fopen((path + INDEX_SUFFIX).c_str(), "rb"), &std::fclose}
+    , m_block{std::make_unique<std::uint8_t[]>(BLOCK_SIZE)}
+  {
+    if (!m_log)
+      throw std::runtime_error{"Failed to open the log file"};
+    m_blocks = static_cast<std::uint32_t>(m_GetSize(m_log.get()) / BLOCK_SIZE);
+    // the whole index is optional
+    if (m_index)
+      m_entries = static_cast<std::uint32_t>(std::min<std::uint64_t>(
+        m_GetSize(m_index.get()) / INDEX_ENTRY_SIZE, m_blocks));
+  }
+
+  [[nodiscard]] std::uint32_t GetBlockCount() const noexcept
+  {
+    return m_blocks;
+  }
+
+  [[nodiscard]] std::uint32_t GetIndexCount() const noexcept
+  {
+    return m_entries;
+  }
+
+  [[nodiscard]] IndexEntry ReadIndex(std::uint32_t entry)
+  {
+    std::array<std::uint8_t, INDEX_ENTRY_SIZE> in{};
+    if (fseeko(m_index.get(), static_cast<off_t>(entry) * INDEX_ENTRY_SIZE,
+               SEEK_SET) ||
+        std::fread(in.data(), in.size(), 1U, m_index.get()) != 1U)
+      throw std::runtime_error{"Failed to read the index"};
+    return IndexEntry::Load(in.data());
+  }
+
+  [[nodiscard]] gsl::span<const std::uint8_t> ReadBlock(std::uint32_t block)
+  {
+    if (fseeko(m_log.get(), static_cast<off_t>(block) * BLOCK_SIZE,
+               SEEK_SET) ||
+        std::fread(m_block.get(), BLOCK_SIZE, 1U, m_log.get()) != 1U)
+      return {};
+    return gsl::span<const std::uint8_t>{m_block.get(), BLOCK_SIZE};
+  }
+
+private:
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> m_log;
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> m_index;
+  std::unique_ptr<std::uint8_t[]> m_block;
+  std::uint32_t m_blocks{};
+  std::uint32_t m_entries{};
+
+  /// In off_t, a log read on the host may outgrow a long
+  static std::uint64_t m_GetSize(std::FILE* file)
+  {
+    if (fseeko(file, 0, SEEK_END))
+      return 0U;
+    return static_cast<std::uint64_t>(std::max<off_t>(ftello(file), 0));
+  }
+};
+
+using Reader = BasicReader<FileSource>;
+} // namespace samplelog
@@ -0,0 +1,282 @@
+#pragma once
+#include "sample-log/format.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <gsl/span>
+#include <logger/logger.hpp>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace samplelog {
+/// @brief Writes a log and its index through two #Logger objects, so adding
+/// a sample never waits for the storage
+///
+/// An existing log is recovered, see #Recover, and continued: the block
+/// numbers go on from its blocks. The index entries are small and kept in
+/// short blocks. An index lagging behind the log after a dropped entry or a
+/// bad block is completed by the readers from the block headers, the index
+/// is not written after a drop.
+///
+/// The blocks are packed unless packing does not pay: a block packed into
+/// more bytes than the raw columns or over the time budget is followed by
+/// #RAW_BLOCKS raw blocks before packing is tried again. The packing time is
+/// measured on one sample in #TIMED_SAMPLES.
+class Writer {
+public:
+  struct Compression {
+    bool enabled;
+    /// the maximum mean time to pack a sample, zero for no limit
+    std::chrono::nanoseconds budget;
+  };
+  static constexpr Compression DEFAULT_COMPRESSION{
+    true, std::chrono::microseconds{20}};
+  static constexpr std::size_t RAW_BLOCKS = 16U;
+  static constexpr std::uint32_t TIMED_SAMPLES = 16U;
+
+  /// @brief The result of #Recover
+  struct Recovery {
+    std::uint32_t blocks;  ///< in the log
+    std::uint32_t entries; ///< in the index, less if a block is bad
+  };
+
+  /// @param path The log file, appended to if it exists, the index is the
+  /// same path with #INDEX_SUFFIX. The samples must be newer than the ones
+  /// already in it.
+  /// @param config The buffering and the sync cadence of the log, the block
+  /// size is #BLOCK_SIZE
+  Writer(const std::string& path, std::uint8_t channel,
+         const Logger::Config& config,
+         const Compression& compression = DEFAULT_COMPRESSION)
+    : Writer{path, channel, config, compression, Recover(path)}
+  {
+  }
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
+  Writer(Writer&&) = delete;
+  Writer& operator=(Writer&&) = delete;
+  ~Writer() { Stop(); }
+
+  /// @return false if the sample is older than the last one or the block
+  /// was dropped by the logger
+  bool Add(const Sample& sample)
+  {
+    // a new block would take it
+    if (sample.timestampUs < m_lastUs)
+      return false;
+    m_lastUs = sample.timestampUs;
+    if (m_Add(sample))
+      return true;
+    if (!m_builder.GetCount())
+      return false;
+    const bool written = m_Seal();
+    return m_Add(sample) && written;
+  }
+
+  /// @brief Cut the log after its last valid block and the index after the
+  /// entry of that block, the missing entries are added from the headers
+  ///
+  /// A power loss may leave a torn or stale block at the end of the log, and
+  /// the index behind or ahead of it, so the appended blocks would not line
+  /// up. A bad block within the log is left to the readers to skip.
+  ///
+  /// @return Nothing for a log which doesn't exist
+  /// @throws std::runtime_error if the files could not be repaired
+  static Recovery Recover(const std::string& path)
+  {
+    File log{std::fopen(path.c_str(), "rb"), &std::fclose};
+    if (!log)
+      return Recovery{};
+    const auto block = std::make_unique<std::uint8_t[]>(BLOCK_SIZE);
+    const auto readHeader = [&log, &block](std::uint32_t number) {
+      return m_ReadAt(log.get(), number, block.get(), BLOCK_SIZE)
+               ? ReadHeader(gsl::span<const std::uint8_t>{block.get(),
+                                                          BLOCK_SIZE},
+                            number)
+               : std::nullopt;
+    };
+    auto blocks = m_CountWhole(log.get(), BLOCK_SIZE);
+    while (blocks && !readHeader(blocks - 1U))
+      --blocks;
+
+    // the entries at the end may be torn or stale too
+    const auto indexPath = path + INDEX_SUFFIX;
+    std::uint32_t entries{};
+    if (File index{std::fopen(indexPath.c_str(), "rb"), &std::fclose};
+        index) {
+      entries = std::min(m_CountWhole(index.get(), INDEX_ENTRY_SIZE), blocks);
+      std::array<std::uint8_t, INDEX_ENTRY_SIZE> stored{};
+      std::array<std::uint8_t, INDEX_ENTRY_SIZE> expected{};
+      for (; entries; --entries) {
+        const auto header = readHeader(entries - 1U);
+        if (!header || !m_ReadAt(index.get(), entries - 1U, stored.data(),
+                                 stored.size()))
+          continue;
+        header->Store(expected.data());
+        if (stored == expected)
+          break;
+      }
+    }
+    if (entries && truncate(indexPath.c_str(),
+                            static_cast<off_t>(entries) * INDEX_ENTRY_SIZE))
+      throw std::runtime_error{"Failed to truncate the sample index"};
+    File index{std::fopen(indexPath.c_str(), entries ? "ab" : "wb"),
+               &std::fclose};
+    bool written = static_cast<bool>(index);
+    // up to a bad block, the readers read the headers from there on
+    for (; written && entries < blocks; ++entries) {
+      const auto header = readHeader(entries);
+      if (!header)
+        break;
+      std::array<std::uint8_t, INDEX_ENTRY_SIZE> out{};
+      header->Store(out.data());
+      written = std::fwrite(out.data(), out.size(), 1U, index.get()) == 1U;
+    }
+    written = written && !std::fflush(index.get()) &&
+              !fsync(fileno(index.get()));
+    index.reset();
+    log.reset();
+    if (!written ||
+        truncate(path.c_str(), static_cast<off_t>(blocks) * BLOCK_SIZE))
+      throw std::runtime_error{"Failed to recover the sample log"};
+    return Recovery{blocks, entries};
+  }
+
+  /// @brief Write the last block even if it is not full and close the files
+  Logger::Stats Stop()
+  {
+    if (m_builder.GetCount())
+      m_Seal();
+    m_index.Stop();
+    return m_log.Stop();
+  }
+
+private:
+  static constexpr std::size_t INDEX_BLOCK_SIZE = 16U * INDEX_ENTRY_SIZE;
+  using File = std::unique_ptr<std::FILE, decltype(&std::fclose)>;
+
+  Writer(const std::string& path, std::uint8_t channel,
+         const Logger::Config& config, const Compression& compression,
+         const Recovery& recovery)
+    : m_compression{compression}
+    , m_block{std::make_unique<std::uint8_t[]>(BLOCK_SIZE)}
+    , m_builder{gsl::span<std::uint8_t>{m_block.get(), BLOCK_SIZE}, channel,
+                compression.enabled ? Encoding::ePacked : Encoding::eColumns}
+    , m_number{recovery.blocks}
+    , m_indexLost{recovery.entries != recovery.blocks}
+    , m_log{path.c_str(), m_LogConfig(config)}
+    , m_index{(path + INDEX_SUFFIX).c_str(), m_IndexConfig(config)}
+  {
+  }
+
+  const Compression m_compression;
+  std::unique_ptr<std::uint8_t[]> m_block;
+  BlockBuilder m_builder;
+  std::uint32_t m_number{};
+  std::uint64_t m_lastUs{};
+  std::size_t m_rawBlocks{}; // before packing again
+  std::uint32_t m_untimed{}; // the samples since the last timed one
+  std::uint32_t m_timed{};   // in the block
+  std::chrono::nanoseconds m_packTime{};
+  bool m_indexLost{}; // an entry was dropped
+  Logger m_log;
+  Logger m_index;
+
+  [[nodiscard]] static Logger::Config
+  m_LogConfig(Logger::Config config) noexcept
+  {
+    config.blockSize = BLOCK_SIZE;
+    config.truncate = false;
+    return config;
+  }
+
+  [[nodiscard]] static Logger::Config
+  m_IndexConfig(Logger::Config config) noexcept
+  {
+    config.blockSize = INDEX_BLOCK_SIZE;
+    config.truncate = false;
+    return config;
+  }
+
+  /// The number of the whole units in the file
+  [[nodiscard]] static std::uint32_t m_CountWhole(std::FILE* file,
+                                                  std::size_t unit)
+  {
+    if (fseeko(file, 0, SEEK_END))
+      return 0U;
+    const auto size = ftello(file);
+    return size > 0 ? static_cast<std::uint32_t>(
+                        static_cast<std::uint64_t>(size) / unit)
+                    : 0U;
+  }
+
+  [[nodiscard]] static bool m_ReadAt(std::FILE* file, std::uint32_t unit,
+                                     std::uint8_t* out, std::size_t size)
+  {
+    return !fseeko(file, static_cast<off_t>(unit) * static_cast<off_t>(size),
+                   SEEK_SET) &&
+           std::fread(out, size, 1U, file) == 1U;
+  }
+
+  bool m_Add(const Sample& sample)
+  {
+    if (m_builder.GetEncoding() != Encoding::ePacked ||
+        ++m_untimed < TIMED_SAMPLES)
+      return m_builder.Add(sample);
+    m_untimed = 0U;
+    const auto start = std::chrono::steady_clock::now();
+    const bool added = m_builder.Add(sample);
+    m_packTime += std::chrono::steady_clock::now() - start;
+    ++m_timed;
+    return added;
+  }
+
+  /// Choose the encoding of the next block
+  void m_Choose(std::size_t count, std::size_t size)
+  {
+    if (!m_compression.enabled)
+      return;
+    if (m_builder.GetEncoding() == Encoding::eColumns) {
+      if (!--m_rawBlocks)
+        m_builder.SetEncoding(Encoding::ePacked);
+      return;
+    }
+    const bool larger = size - HEADER_SIZE > 8U * count;
+    const bool slow = m_compression.budget.count() && m_timed &&
+                      m_packTime / m_timed > m_compression.budget;
+    m_timed = 0U;
+    m_packTime = std::chrono::nanoseconds::zero();
+    if (larger || slow) {
+      m_builder.SetEncoding(Encoding::eColumns);
+      m_rawBlocks = RAW_BLOCKS;
+    }
+  }
+
+  /// Hand the block over to the logger, a dropped block keeps its number
+  bool m_Seal()
+  {
+    const auto count = m_builder.GetCount();
+    const auto size = m_builder.GetSize();
+    const auto entry = m_builder.Finish(m_number);
+    m_Choose(count, size);
+    if (!m_log.Append(
+          gsl::span<const std::uint8_t>{m_block.get(), BLOCK_SIZE}))
+      return false;
+    ++m_number;
+    if (m_indexLost)
+      return true;
+    std::array<std::uint8_t, INDEX_ENTRY_SIZE> out{};
+    entry.Store(out.data());
+    // the entries after a dropped one would not match their blocks
+    m_indexLost = !m_index.Append(out);
+    return true;
+  }
+};
+} // namespace samplelog
@@ -0,0 +1,189 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <gsl/span>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <utils/utils.hpp>
+#include <utils/varint.hpp>
+
+/// @brief A compact binary frame for a stream of weight samples
+///
+/// A frame is a fixed header followed by the samples of one channel:
+///
+/// | offset | size | field                                          |
+/// |--------|------|------------------------------------------------|
+/// | 0      | 1    | #MAGIC                                         |
+/// | 1      | 1    | #VERSION                                       |
+/// | 2      | 4    | device                                         |
+/// | 6      | 1    | channel                                        |
+/// | 7      | 8    | base timestamp, ms                             |
+/// | 15     | 4    | scale, IEEE 754 float, the units of one count  |
+/// | 19     | 2    | the number of samples                          |
+///
+/// The multi-byte fields are little-endian. Every sample is a pair of
+/// zigzag varints: the timestamp delta in ms and the value delta in counts,
+/// both from the previous sample (the first one from the base timestamp and
+/// zero). A steady weight stream at a fixed rate takes 2 bytes per sample.
+namespace telemetry {
+constexpr std::uint8_t MAGIC = 0xB7U;
+constexpr std::uint8_t VERSION = 1U;
+constexpr std::size_t HEADER_SIZE = 21U;
+/// @brief The worst case size of an encoded sample
+constexpr std::size_t MAX_SAMPLE_SIZE = 2U * varint::MAX_SIZE;
+constexpr std::size_t MAX_SAMPLES = std::numeric_limits<std::uint16_t>::max();
+
+struct Header {
+  std::uint32_t device;
+  std::uint8_t channel;
+  std::uint64_t baseTimestamp; ///< ms
+  float scale;                 ///< the units of one count, e.g. gramms
+};
+
+struct Sample {
+  std::uint64_t timestamp; ///< ms
+  std::int32_t value;      ///< counts of #Header::scale
+};
+
+/// @brief Get the frame size for the worst case of samples
+[[nodiscard]] constexpr std::size_t MaxFrameSize(std::size_t samples) noexcept
+{
+  return HEADER_SIZE + samples * MAX_SAMPLE_SIZE;
+}
+
+/// @brief Convert a value to counts of the scale, saturating
+[[nodiscard]] inline std::int32_t Quantize(float value, float scale) noexcept
+{
+  const auto counts = std::round(value / scale);
+  if (!(counts > std::numeric_limits<std::int32_t>::min()))
+    return std::numeric_limits<std::int32_t>::min();
+  if (!(counts < std::numeric_limits<std::int32_t>::max()))
+    return std::numeric_limits<std::int32_t>::max();
+  return static_cast<std::int32_t>(counts);
+}
+
+/// @brief Writes a frame into a caller provided buffer
+///
+/// Nothing is allocated, the buffer is the only storage. The sample count is
+/// written by #Finish.
+class Encoder {
+  gsl::span<std::uint8_t> m_buffer;
+  std::size_t m_size{HEADER_SIZE};
+  std::size_t m_count{};
+  std::uint64_t m_lastTimestamp;
+  std::int32_t m_lastValue{};
+
+public:
+  /// @throws std::invalid_argument if the buffer cannot hold the header
+  Encoder(gsl::span<std::uint8_t> buffer, const Header& header)
+    : m_buffer{buffer}, m_lastTimestamp{header.baseTimestamp}
+  {
+    if (buffer.size() < HEADER_SIZE)
+      throw std::invalid_argument{"the buffer is too small for the header"};
+    std::uint32_t scale{};
+    static_assert(sizeof(scale) == sizeof(header.scale));
+    std::memcpy(&scale, &header.scale, sizeof(scale));
+
+    auto* out = m_buffer.data();
+    out[0] = MAGIC;
+    out[1] = VERSION;
+    utils::StoreLittleEndian(out + 2, header.device);
+    out[6] = header.channel;
+    utils::StoreLittleEndian(out + 7, header.baseTimestamp);
+    utils::StoreLittleEndian(out + 15, scale);
+    utils::StoreLittleEndian(out + 19, std::uint16_t{});
+  }
+
+  /// @return false if the sample does not fit, the frame is unchanged then
+  [[nodiscard]] bool Add(const Sample& sample) noexcept
+  {
+    if (m_count == MAX_SAMPLES)
+      return false;
+    const auto rest = m_buffer.subspan(m_size);
+    const auto dt =
+      static_cast<std::int64_t>(sample.timestamp - m_lastTimestamp);
+    const auto dv = std::int64_t{sample.value} - m_lastValue;
+    const auto timeSize = varint::Encode(varint::ZigZag(dt), rest);
+    if (!timeSize)
+      return false;
+    const auto valueSize =
+      varint::Encode(varint::ZigZag(dv), rest.subspan(timeSize));
+    if (!valueSize)
+      return false;
+    m_size += timeSize + valueSize;
+    ++m_count;
+    m_lastTimestamp = sample.timestamp;
+    m_lastValue = sample.value;
+    return true;
+  }
+
+  [[nodiscard]] std::size_t GetCount() const noexcept { return m_count; }
+
+  /// @brief Complete the frame, more samples may be added afterwards
+  ///
+  /// @return The encoded frame, a prefix of the buffer
+  [[nodiscard]] gsl::span<const std::uint8_t> Finish() noexcept
+  {
+    utils::StoreLittleEndian(m_buffer.data() + 19,
+                             static_cast<std::uint16_t>(m_count));
+    return m_buffer.first(m_size);
+  }
+};
+
+/// @brief Reads the samples of a frame in place
+class Decoder {
+  gsl::span<const std::uint8_t> m_frame;
+  Header m_header{};
+  std::size_t m_count{};
+  std::size_t m_offset{HEADER_SIZE};
+  std::size_t m_index{};
+  Sample m_last{};
+
+public:
+  /// @throws std::invalid_argument if the header is malformed
+  explicit Decoder(gsl::span<const std::uint8_t> frame) : m_frame{frame}
+  {
+    if (frame.size() < HEADER_SIZE)
+      throw std::invalid_argument{"the frame is shorter than the header"};
+    const auto* in = frame.data();
+    if (in[0] != MAGIC)
+      throw std::invalid_argument{"not a telemetry frame"};
+    if (in[1] != VERSION)
+      throw std::invalid_argument{"unsupported telemetry frame version"};
+    const auto scale = utils::LoadLittleEndian<std::uint32_t>(in + 15);
+    std::memcpy(&m_header.scale, &scale, sizeof(scale));
+    m_header.device = utils::LoadLittleEndian<std::uint32_t>(in + 2);
+    m_header.channel = in[6];
+    m_header.baseTimestamp = utils::LoadLittleEndian<std::uint64_t>(in + 7);
+    m_count = utils::LoadLittleEndian<std::uint16_t>(in + 19);
+    m_last.timestamp = m_header.baseTimestamp;
+  }
+
+  [[nodiscard]] const Header& GetHeader() const noexcept { return m_header; }
+  [[nodiscard]] std::size_t GetCount() const noexcept { return m_count; }
+
+  /// @return std::nullopt after the last sample
+  /// @throws std::invalid_argument if the frame is truncated
+  [[nodiscard]] std::optional<Sample> Next()
+  {
+    if (m_index == m_count)
+      return std::nullopt;
+    std::uint64_t dt{};
+    std::uint64_t dv{};
+    const auto timeSize = varint::Decode(m_frame.subspan(m_offset), dt);
+    const auto valueSize =
+      timeSize ? varint::Decode(m_frame.subspan(m_offset + timeSize), dv) : 0U;
+    if (!valueSize)
+      throw std::invalid_argument{"the telemetry frame is truncated"};
+    m_offset += timeSize + valueSize;
+    ++m_index;
+    m_last.timestamp += static_cast<std::uint64_t>(varint::UnZigZag(dt));
+    m_last.value = static_cast<std::int32_t>(
+      std::int64_t{m_last.value} + varint::UnZigZag(dv));
+    return m_last;
+  }
+};
+} // namespace telemetry
@@ -0,0 +1,50 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+#include <string_view>
+
+namespace crc {
+namespace detail {
+constexpr std::uint32_t CRC32_POLYNOMIAL = 0xEDB88320U; // reflected 0x04C11DB7
+
+[[nodiscard]] constexpr std::array<std::uint32_t, 256> MakeCrc32Table() noexcept
+{
+  std::array<std::uint32_t, 256> table{};
+  for (std::uint32_t i{}; i < table.size(); ++i) {
+    auto crc = i;
+    for (int bit{}; bit < 8; ++bit)
+      crc = crc & 1U ? (crc >> 1U) ^ CRC32_POLYNOMIAL : crc >> 1U;
+    table[i] = crc;
+  }
+  return table;
+}
+inline constexpr auto CRC32_TABLE = MakeCrc32Table();
+} // namespace detail
+
+/// @brief CRC-32 as in Ethernet, zlib and PNG
+///
+/// @param crc The result for the preceding data to continue a calculation
+[[nodiscard]] constexpr std::uint32_t Crc32(gsl::span<const std::uint8_t> data,
+                                            std::uint32_t crc = 0U) noexcept
+{
+  crc = ~crc;
+  for (const auto byte : data)
+    crc = detail::CRC32_TABLE[(crc ^ byte) & 0xFFU] ^ (crc >> 8U);
+  return ~crc;
+}
+
+[[nodiscard]] constexpr std::uint32_t Crc32(std::string_view data,
+                                            std::uint32_t crc = 0U) noexcept
+{
+  crc = ~crc;
+  for (const auto c : data)
+    crc = detail::CRC32_TABLE[(crc ^ static_cast<std::uint8_t>(c)) & 0xFFU] ^
+          (crc >> 8U);
+  return ~crc;
+}
+static_assert(Crc32(std::string_view{"123456789"}) == 0xCBF43926U);
+static_assert(Crc32(std::string_view{"6789"},
+                    Crc32(std::string_view{"12345"})) == 0xCBF43926U);
+} // namespace crc
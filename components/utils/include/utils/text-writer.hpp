@@ -0,0 +1,201 @@
+#pragma once
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <gsl/span>
+#include <string_view>
+#include <type_traits>
+
+namespace utils {
+/// @brief Formats text into a caller provided buffer without allocating
+///
+/// The output is truncated when the buffer is full and the overflow is
+/// remembered, so a sequence of appends needs one check at the end.
+class TextWriter {
+  gsl::span<char> m_buffer;
+  std::size_t m_size{};
+  bool m_overflow{};
+
+public:
+  explicit TextWriter(gsl::span<char> buffer) noexcept : m_buffer{buffer} {}
+
+  TextWriter& Append(char c) noexcept
+  {
+    if (m_size < m_buffer.size())
+      m_buffer[m_size++] = c;
+    else
+      m_overflow = true;
+    return *this;
+  }
+
+  TextWriter& Append(std::string_view text) noexcept
+  {
+    for (const auto c : text)
+      Append(c);
+    return *this;
+  }
+
+  template<typename Integer,
+           typename = std::enable_if_t<std::is_integral_v<Integer> &&
+                                       !std::is_same_v<Integer, bool> &&
+                                       !std::is_same_v<Integer, char>>>
+  TextWriter& Append(Integer value) noexcept
+  {
+    const auto [end, error] = std::to_chars(
+      m_buffer.data() + m_size, m_buffer.data() + m_buffer.size(), value);
+    if (error == std::errc{})
+      m_size = static_cast<std::size_t>(end - m_buffer.data());
+    else
+      m_overflow = true;
+    return *this;
+  }
+
+  /// @brief Append a number with a fixed number of decimals, like "%.*f"
+  ///
+  /// The value is rounded from its exact binary value like in printf, e.g.
+  /// 0.15 is 0.1499... and becomes "0.1". A non-finite value is written as
+  /// "nan".
+  TextWriter& AppendFixed(double value, unsigned decimals) noexcept
+  {
+    if (!std::isfinite(value))
+      return Append(std::string_view{"nan"});
+    const auto [end, error] =
+      std::to_chars(m_buffer.data() + m_size,
+                    m_buffer.data() + m_buffer.size(), value,
+                    std::chars_format::fixed, static_cast<int>(decimals));
+    if (error == std::errc{})
+      m_size = static_cast<std::size_t>(end - m_buffer.data());
+    else
+      m_overflow = true;
+    return *this;
+  }
+
+  [[nodiscard]] std::string_view View() const noexcept
+  {
+    return {m_buffer.data(), m_size};
+  }
+  [[nodiscard]] std::size_t Size() const noexcept { return m_size; }
+  /// @return true if some output was truncated
+  [[nodiscard]] bool IsOverflow() const noexcept { return m_overflow; }
+
+  void Clear() noexcept
+  {
+    m_size = 0U;
+    m_overflow = false;
+  }
+};
+
+/// @brief Writes JSON into a #TextWriter, inserting the commas itself
+///
+/// The caller keeps the structure balanced, e.g.
+/// `json.BeginObject().Key("t").Value(42).EndObject()`.
+class JsonWriter {
+  TextWriter& m_out;
+  bool m_needComma{};
+
+  void m_Separate() noexcept
+  {
+    if (m_needComma)
+      m_out.Append(',');
+    m_needComma = true;
+  }
+
+  void m_String(std::string_view text) noexcept
+  {
+    constexpr std::string_view HEX{"0123456789abcdef"};
+    m_out.Append('"');
+    for (const auto c : text) {
+      if (c == '"' || c == '\\')
+        m_out.Append('\\').Append(c);
+      else if (static_cast<unsigned char>(c) < 0x20U)
+        m_out.Append(std::string_view{"\\u00"})
+          .Append(HEX[static_cast<unsigned char>(c) >> 4U])
+          .Append(HEX[static_cast<unsigned char>(c) & 0xFU]);
+      else
+        m_out.Append(c);
+    }
+    m_out.Append('"');
+  }
+
+public:
+  explicit JsonWriter(TextWriter& out) noexcept : m_out{out} {}
+
+  JsonWriter& BeginObject() noexcept
+  {
+    m_Separate();
+    m_out.Append('{');
+    m_needComma = false;
+    return *this;
+  }
+  JsonWriter& EndObject() noexcept
+  {
+    m_out.Append('}');
+    m_needComma = true;
+    return *this;
+  }
+  JsonWriter& BeginArray() noexcept
+  {
+    m_Separate();
+    m_out.Append('[');
+    m_needComma = false;
+    return *this;
+  }
+  JsonWriter& EndArray() noexcept
+  {
+    m_out.Append(']');
+    m_needComma = true;
+    return *this;
+  }
+
+  JsonWriter& Key(std::string_view name) noexcept
+  {
+    m_Separate();
+    m_String(name);
+    m_out.Append(':');
+    m_needComma = false;
+    return *this;
+  }
+
+  template<typename Integer,
+           typename = std::enable_if_t<std::is_integral_v<Integer> &&
+                                       !std::is_same_v<Integer, bool> &&
+                                       !std::is_same_v<Integer, char>>>
+  JsonWriter& Value(Integer value) noexcept
+  {
+    m_Separate();
+    m_out.Append(value);
+    return *this;
+  }
+
+  JsonWriter& Value(bool value) noexcept
+  {
+    m_Separate();
+    m_out.Append(value ? std::string_view{"true"} : std::string_view{"false"});
+    return *this;
+  }
+
+  JsonWriter& Value(std::string_view text) noexcept
+  {
+    m_Separate();
+    m_String(text);
+    return *this;
+  }
+
+  // not to convert a string literal to bool
+  JsonWriter& Value(const char* text) noexcept
+  {
+    return Value(std::string_view{text});
+  }
+
+  /// @brief A number with a fixed number of decimals, null if not finite
+  JsonWriter& Fixed(double value, unsigned decimals) noexcept
+  {
+    m_Separate();
+    if (std::isfinite(value))
+      m_out.AppendFixed(value, decimals);
+    else
+      m_out.Append(std::string_view{"null"});
+    return *this;
+  }
+};
+} // namespace utils
@@ -82,6 +82,35 @@ static_assert(GetByteByIndex<5>(0x0123456789ABCDEFU) == 0x45U);
 static_assert(GetByteByIndex<6>(0x0123456789ABCDEFU) == 0x23U);
 static_assert(GetByteByIndex<7>(0x0123456789ABCDEFU) == 0x01U);
 
+namespace detail {
+template<typename Value, std::size_t... INDEX>
+constexpr void StoreLittleEndian(std::uint8_t* out, Value value,
+                                 std::index_sequence<INDEX...>) noexcept
+{
+  ((out[INDEX] = GetByteByIndex<INDEX>(value)), ...);
+}
+} // namespace detail
+
+/// @brief Write an unsigned integer into a byte buffer LSB-first
+template<typename Value>
+constexpr void StoreLittleEndian(std::uint8_t* out, Value value) noexcept
+{
+  detail::StoreLittleEndian(out, value,
+                            std::make_index_sequence<sizeof(Value)>{});
+}
+
+/// @brief Read an unsigned integer from a byte buffer LSB-first
+template<typename Value,
+         typename = std::enable_if_t<std::is_integral_v<Value> &&
+                                     std::is_unsigned_v<Value>>>
+[[nodiscard]] constexpr Value LoadLittleEndian(const std::uint8_t* in) noexcept
+{
+  Value value{};
+  for (std::size_t i = sizeof(Value); i > 0U; --i)
+    value = static_cast<Value>(value << 8U | in[i - 1U]);
+  return value;
+}
+
 template<typename Key, typename Value, std::size_t size>
 struct ConstMap {
   std::array<std::pair<Key, Value>, size> data;
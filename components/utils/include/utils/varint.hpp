@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+#include <type_traits>
+
+namespace varint {
+/// @brief Map a signed integer to an unsigned one so that the small
+/// magnitudes of both signs get small codes: 0, -1, 1, -2... -> 0, 1, 2, 3...
+template<typename Signed, typename = std::enable_if_t<std::is_signed_v<Signed>>>
+[[nodiscard]] constexpr auto ZigZag(Signed value) noexcept
+{
+  using Unsigned = std::make_unsigned_t<Signed>;
+  return static_cast<Unsigned>((static_cast<Unsigned>(value) << 1U) ^
+                               static_cast<Unsigned>(value < 0 ? -1 : 0));
+}
+
+template<typename Unsigned,
+         typename = std::enable_if_t<std::is_unsigned_v<Unsigned>>>
+[[nodiscard]] constexpr auto UnZigZag(Unsigned value) noexcept
+{
+  using Signed = std::make_signed_t<Unsigned>;
+  return static_cast<Signed>((value >> 1U) ^ (~(value & 1U) + 1U));
+}
+static_assert(ZigZag(std::int32_t{0}) == 0U);
+static_assert(ZigZag(std::int32_t{-1}) == 1U);
+static_assert(ZigZag(std::int32_t{1}) == 2U);
+static_assert(ZigZag(std::int32_t{-2}) == 3U);
+static_assert(UnZigZag(ZigZag(std::int32_t{-123456})) == -123456);
+static_assert(UnZigZag(ZigZag(std::int64_t{INT64_MIN})) == INT64_MIN);
+
+/// @brief The maximum encoded size of a 64-bit value
+constexpr std::size_t MAX_SIZE = 10U;
+
+/// @brief Write an unsigned LEB128 value, 7 bits per byte LSB-first
+///
+/// @return The number of written bytes, 0 if the output is too small
+[[nodiscard]] inline std::size_t Encode(std::uint64_t value,
+                                        gsl::span<std::uint8_t> out) noexcept
+{
+  std::size_t size{};
+  do {
+    if (size == out.size())
+      return 0U;
+    auto byte = static_cast<std::uint8_t>(value & 0x7FU);
+    value >>= 7U;
+    if (value)
+      byte |= 0x80U;
+    out[size++] = byte;
+  } while (value);
+  return size;
+}
+
+/// @brief Read an unsigned LEB128 value
+///
+/// @return The number of consumed bytes, 0 if the input is truncated or the
+/// value does not fit 64 bits
+[[nodiscard]] inline std::size_t Decode(gsl::span<const std::uint8_t> in,
+                                        std::uint64_t& value) noexcept
+{
+  value = 0U;
+  for (std::size_t i{}; i < in.size() && i < MAX_SIZE; ++i) {
+    // the last byte holds the 64th bit only
+    if (i + 1U == MAX_SIZE && in[i] > 0x01U)
+      return 0U;
+    value |= static_cast<std::uint64_t>(in[i] & 0x7FU) << (7U * i);
+    if (!(in[i] & 0x80U))
+      return i + 1U;
+  }
+  return 0U;
+}
+} // namespace varint
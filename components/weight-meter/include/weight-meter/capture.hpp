@@ -0,0 +1,68 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+#include <logger/logger.hpp>
+
+/// @brief A timestamped raw conversion as it is stored in a capture file
+struct RawSample {
+  /// since the start of the capture, up to #Capture::MAX_DURATION
+  std::uint32_t timestampUs;
+  std::uint32_t raw;         ///< the ADC code
+};
+static_assert(sizeof(RawSample) == 8U);
+
+/// @brief Streams raw samples into a file without stalling the acquisition
+///
+/// The samples go through a #Logger: they are collected into cluster sized
+/// blocks while its background thread writes the full ones, so the producer
+/// only copies a sample under a short lock. If the writer falls behind by
+/// all the blocks, the new samples are dropped and counted. The file is a
+/// plain array of #RawSample in the native (little-endian) byte order.
+class Capture {
+public:
+  static constexpr std::size_t BLOCK_SAMPLES =
+      Logger::CLUSTER_SIZE / sizeof(RawSample);
+  /// the longest capture #RawSample::timestampUs can represent
+  static constexpr std::chrono::seconds MAX_DURATION{UINT32_MAX / 1000000U};
+
+  struct Stats {
+    std::uint32_t samples; ///< the number of written samples
+    std::uint32_t drops;   ///< the number of dropped samples
+    /// the maximum number of samples waiting for the file in full blocks
+    std::uint32_t maxFill;
+    bool failed; ///< the capture could not be started
+  };
+
+  /// @throws std::runtime_error if the file can not be opened
+  explicit Capture(const char *path) : m_logger{path, CONFIG} {}
+
+  Capture(const Capture &) = delete;
+  Capture &operator=(const Capture &) = delete;
+  Capture(Capture &&) = delete;
+  Capture &operator=(Capture &&) = delete;
+  ~Capture() = default;
+
+  /// @brief Add a sample, never blocks on the file
+  void Push(RawSample sample) noexcept {
+    static_cast<void>(m_logger.Append(gsl::span<const std::uint8_t>{
+        reinterpret_cast<const std::uint8_t *>(&sample), sizeof(sample)}));
+  }
+
+  /// @brief Write the buffered samples and close the file
+  Stats Stop() {
+    const auto stats = m_logger.Stop();
+    return Stats{
+        static_cast<std::uint32_t>(stats.bytes / sizeof(RawSample)),
+        stats.drops,
+        static_cast<std::uint32_t>(stats.maxQueued * BLOCK_SAMPLES), false};
+  }
+
+private:
+  static constexpr Logger::Config CONFIG{
+      Logger::CLUSTER_SIZE, 2U, Logger::DEFAULT_CONFIG.syncInterval,
+      Logger::DEFAULT_CONFIG.writerPriority, true, false};
+
+  Logger m_logger;
+};
@@ -0,0 +1,130 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/// @brief Estimates the weight of items moving over the scale
+///
+/// An item is detected when the signal rises above the empty level by
+/// #Config::entryThreshold and it is over when the signal falls back below
+/// #Config::exitThreshold. The loaded samples are collected (decimated by 2
+/// every time the buffer fills up, so an item of any length fits), then the
+/// entry and exit transients are trimmed and the weight is the median of the
+/// remaining plateau. The median does not care about the vibration spikes,
+/// and its spread gives the confidence of the estimate. The work per sample
+/// is bounded by #MAX_SAMPLES regardless of the item length.
+class Checkweigher {
+public:
+  static constexpr std::size_t MAX_SAMPLES = 256U;
+
+  struct Config {
+    float entryThreshold; ///< gramms above the empty level, an item arrived
+    float exitThreshold;  ///< gramms above the empty level, the item left
+    float edgeFraction;   ///< the share of the samples trimmed at each end
+    std::size_t minSamples; ///< shorter plateaus are rejected
+    float tolerance;        ///< gramms, the standard error of 0.5 confidence
+  };
+
+  struct Item {
+    float grams;
+    float confidence;      ///< 0..1
+    std::uint32_t samples; ///< the number of the loaded samples
+  };
+
+  explicit Checkweigher(const Config &config) noexcept : m_config{config} {}
+
+  /// @brief Feed a sample
+  ///
+  /// @return The estimate of an item once it has left the scale
+  [[nodiscard]] std::optional<Item> Process(float grams) noexcept {
+    const auto load = grams - m_zero;
+
+    if (!m_loaded) {
+      if (load < m_config.entryThreshold) {
+        m_zero += (grams - m_zero) * ZERO_TRACKING;
+        return std::nullopt;
+      }
+      m_loaded = true;
+      m_size = 0U;
+      m_stride = 1U;
+      m_skipped = 0U;
+      m_total = 0U;
+    }
+
+    if (load >= m_config.exitThreshold) {
+      m_Append(load);
+      return std::nullopt;
+    }
+
+    m_loaded = false;
+    return m_Estimate();
+  }
+
+  /// @brief Set the empty level, e.g. after a tare
+  void SetZero(float grams) noexcept { m_zero = grams; }
+
+private:
+  static constexpr float ZERO_TRACKING = 0.01f;
+  // converts MAD to the standard deviation of a normal distribution
+  static constexpr float MAD_TO_SIGMA = 1.4826f;
+  // the standard error of the median relative to the one of the mean
+  static constexpr float MEDIAN_EFFICIENCY = 1.2533f;
+
+  const Config m_config;
+  float m_zero{};
+  bool m_loaded{};
+  std::array<float, MAX_SAMPLES> m_samples{};
+  std::array<float, MAX_SAMPLES> m_scratch{};
+  std::size_t m_size{};
+  std::size_t m_stride{1U};
+  std::size_t m_skipped{};
+  std::uint32_t m_total{};
+
+  void m_Append(float load) noexcept {
+    ++m_total;
+    if (++m_skipped < m_stride)
+      return;
+    m_skipped = 0U;
+    if (m_size == MAX_SAMPLES) {
+      for (std::size_t i{}; i < MAX_SAMPLES / 2U; ++i)
+        m_samples[i] = m_samples[2U * i];
+      m_size = MAX_SAMPLES / 2U;
+      m_stride *= 2U;
+    }
+    m_samples[m_size++] = load;
+  }
+
+  /// Median of [first, last) in the scratch buffer, reorders it
+  [[nodiscard]] static float m_Median(float *first, float *last) noexcept {
+    auto *middle = first + (last - first) / 2;
+    std::nth_element(first, middle, last);
+    return *middle;
+  }
+
+  [[nodiscard]] std::optional<Item> m_Estimate() noexcept {
+    const auto edge = static_cast<std::size_t>(
+        static_cast<float>(m_size) * m_config.edgeFraction);
+    if (m_size < 2U * edge + std::max<std::size_t>(m_config.minSamples, 1U))
+      return std::nullopt;
+
+    const auto n = m_size - 2U * edge;
+    auto *first = m_scratch.data();
+    auto *last = first + n;
+    std::copy_n(m_samples.cbegin() + edge, n, first);
+    const auto median = m_Median(first, last);
+
+    std::transform(first, last, first,
+                   [median](float v) { return std::abs(v - median); });
+    const auto mad = m_Median(first, last);
+
+    const auto stdErr = MEDIAN_EFFICIENCY * MAD_TO_SIGMA * mad /
+                        std::sqrt(static_cast<float>(n));
+    // a flat plateau is exact even with no tolerance
+    const auto spread = m_config.tolerance + stdErr;
+    return Item{median, spread > 0.f ? m_config.tolerance / spread : 1.f,
+                m_total};
+  }
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <hx711/hx711.hpp>
+#include <memory>
+#include <optional>
+#include <utility>
+
+/// @brief A single conversion of a load cell
+struct Sample {
+  std::uint32_t raw; ///< the ADC code
+  float grams;       ///< the calibrated weight
+};
+
+/// @brief A continuous stream of load cell conversions
+class ISampleSource {
+public:
+  virtual ~ISampleSource() = default;
+  /// @brief Block until the next conversion is ready, at most the timeout
+  ///
+  /// @return std::nullopt on the timeout, e.g. of a disconnected sensor
+  [[nodiscard]] virtual std::optional<Sample>
+  Read(std::chrono::milliseconds timeout) = 0;
+};
+
+class Hx711Source final : public ISampleSource {
+  std::unique_ptr<Hx711> m_hx711;
+
+public:
+  explicit Hx711Source(std::unique_ptr<Hx711> hx711)
+      : m_hx711{std::move(hx711)} {}
+
+  [[nodiscard]] std::optional<Sample>
+  Read(std::chrono::milliseconds timeout) override {
+    const auto raw = m_hx711->Read(timeout);
+    if (!raw)
+      return std::nullopt;
+    return Sample{*raw, m_hx711->ToUnits(*raw)};
+  }
+};
@@ -1,43 +1,422 @@
 #pragma once
 #include "esp_log.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <cstdint>
-#include <hx711/hx711.hpp>
+#include <exception>
 #include <memory>
 #include <message-queue/interfaces.hpp>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <thread>
 #include <utils/utils.hpp>
+#include <vector>
+#include <weight-meter/capture.hpp>
+#include <weight-meter/checkweigher.hpp>
+#include <weight-meter/sample-source.hpp>
 
+/// @brief Answers weight requests from a continuously acquired sample stream
+///
+/// A background thread reads every conversion of the sample source and keeps
+/// a moving average of the last #AVG_SAMPLES of them, so a read command is
+/// answered immediately instead of blocking the message loop for the
+/// conversions. Subscribers get the weight pushed to them instead: only when
+/// it moves past their deadband or a heartbeat is due, so an idle scale
+/// generates no traffic beyond the heartbeats. The heartbeats are driven by
+/// the scheduler, so they go on and report the stale weight when the source
+/// stops converting.
+///
+/// The weight of the source is corrected by a #Calibration, set by the tare
+/// and the calibration commands. The replies to the read, tare and
+/// calibration commands go out at the priority 0, so a remote command is not
+/// delayed by the telemetry traffic.
 class WeightMeter final : public mq::ISystem {
   static constexpr const char *TAG = "WEIGHT-METER";
   static constexpr const int AVG_SAMPLES = 10;
-
-  mq::IContext &m_ctx;
-  mq::IScheduler &m_scheduler;
-  std::unique_ptr<Hx711> m_hx711;
+  static constexpr float STABLE_SPREAD = 2.f; // gramms
+  static constexpr auto STALE_AFTER{std::chrono::seconds{1}};
+  /// the longest wait for a conversion, so a disconnected sensor does not
+  /// hold up the destructor
+  static constexpr auto READ_TIMEOUT{std::chrono::milliseconds{100}};
 
 public:
   enum class Event : decltype(mq::Addr::ev) {
     eReadCmd,
+    eSubscribe,   ///< #Subscription, updates go to the sender address
+    eUnsubscribe, ///< stops the updates to the sender address
+    /// #CaptureRequest, the sender gets #Capture::Stats when the capture
+    /// ends or fails to start. A started capture replaces the running one,
+    /// a failed one leaves it running.
+    eStartCapture,
+    eStopCapture,
+    /// #Checkweigher::Config, the sender gets a #Checkweigher::Item per item
+    eStartDynamic,
+    eStopDynamic,
+    eTare,      ///< the sender gets a #CalibrationResult
+    eCalibrate, ///< a `float` load in gramms, the sender gets a
+                ///< #CalibrationResult
+    eHeartbeat, ///< internal, sends the heartbeats that are due
+  };
+
+  enum class Quality : std::uint8_t {
+    eNoData,   ///< no conversion has been done yet
+    eUnstable, ///< the load is changing or the average is not settled
+    eStable,   ///< the samples of the average are within #STABLE_SPREAD
+    eStale,    ///< the last conversion is older than #STALE_AFTER
+  };
+
+  /// @brief The reply to #Event::eReadCmd
+  struct Reading {
+    float grams;
+    std::chrono::milliseconds age; ///< since the last conversion
+    Quality quality;
+  };
+
+  /// @brief The correction of the source weight: `(w - zero) * gain`
+  struct Calibration {
+    float zero; ///< the source weight of the empty scale
+    float gain;
+  };
+
+  /// @brief The reply to #Event::eTare and #Event::eCalibrate
+  struct CalibrationResult {
+    bool done; ///< false if the weight is not stable or the load is invalid
+    Calibration calibration; ///< the one in use
+  };
+
+  /// @brief The payload of #Event::eSubscribe
+  struct Subscription {
+    /// the minimum time between updates, i.e. the maximum update rate
+    std::chrono::milliseconds minInterval;
+    /// the maximum time between updates
+    std::chrono::milliseconds heartbeat;
+    /// the minimum weight change to send an update before the heartbeat
+    float deadband; // gramms
+  };
+
+  /// @brief The payload of #Event::eStartCapture
+  struct CaptureRequest {
+    std::string path; ///< the file to stream the raw samples to
+    /// stop automatically after this time, #Capture::MAX_DURATION if zero,
+    /// a longer one fails
+    std::chrono::seconds duration;
   };
 
+  /// @param instance The index of the meter if several scales are attached
   WeightMeter(mq::IContext &ctx, mq::IScheduler &scheduler,
-              std::unique_ptr<Hx711> hx711)
-      : m_ctx{ctx}, m_scheduler{scheduler}, m_hx711{std::move(hx711)} {}
+              std::unique_ptr<ISampleSource> source,
+              std::uint8_t instance = 0)
+      : m_ctx{ctx}, m_scheduler{scheduler}, m_source{std::move(source)},
+        m_id{mq::MakeId(mq::Id::eWeightMeter, instance)},
+        m_acquisition{[this] { m_Acquire(); }} {}
 
-  void Process(const mq::Message &msg) {
+  ~WeightMeter() override {
+    m_running.store(false, std::memory_order_relaxed);
+    m_acquisition.join();
+  }
+
+  void Process(const mq::Message &msg) override {
     if (msg.to.sys != GetId())
       return;
 
     switch (msg.to.ev) {
     case utils::EnumValue(Event::eReadCmd): {
-      float weight = m_hx711->GetUnits(AVG_SAMPLES);
-      ESP_LOGI(TAG, "%u", (unsigned)weight);
-      m_ctx.Push(mq::Message{ msg.to, msg.from, weight});
+      const auto reading = GetReading();
+      ESP_LOGI(TAG, "%u", (unsigned)reading.grams);
+      m_ctx.Push(mq::Message{msg.to, msg.from, reading}, 0);
+    } break;
+    case utils::EnumValue(Event::eSubscribe): {
+      const auto *subscription = std::any_cast<Subscription>(&msg.data);
+      if (!subscription)
+        break;
+      std::scoped_lock lock{m_mutex};
+      if (auto it = m_FindSubscriber(msg.from); it != m_subscribers.end())
+        it->subscription = *subscription;
+      else
+        m_subscribers.push_back(Subscriber{msg.from, *subscription});
+      // replace the scheduled heartbeat, the new one may be due earlier
+      ++m_heartbeatId;
+      m_ScheduleHeartbeat(m_scheduler.GetClock().Now());
+    } break;
+    case utils::EnumValue(Event::eUnsubscribe): {
+      std::scoped_lock lock{m_mutex};
+      if (auto it = m_FindSubscriber(msg.from); it != m_subscribers.end())
+        m_subscribers.erase(it);
+    } break;
+    case utils::EnumValue(Event::eStartCapture): {
+      const auto *request = std::any_cast<CaptureRequest>(&msg.data);
+      if (!request)
+        break;
+      // a rejected request leaves the running capture alone
+      if (request->duration > Capture::MAX_DURATION) {
+        ESP_LOGE(TAG, "Invalid capture duration %lld s",
+                 static_cast<long long>(request->duration.count()));
+        m_FailCapture(msg.from);
+        break;
+      }
+      // the same file is started over, it can not be open twice
+      if (request->path == m_capturePath)
+        m_StopCapture();
+      std::unique_ptr<Capture> capture;
+      try {
+        capture = std::make_unique<Capture>(request->path.c_str());
+      } catch (const std::exception &e) {
+        ESP_LOGE(TAG, "Failed to capture to %s: %s", request->path.c_str(),
+                 e.what());
+        m_FailCapture(msg.from);
+        break;
+      }
+      m_StopCapture();
+      ESP_LOGI(TAG, "Capturing to %s", request->path.c_str());
+      {
+        std::scoped_lock lock{m_mutex};
+        m_capture = std::move(capture);
+        m_captureStart = m_scheduler.GetClock().Now();
+      }
+      m_capturePath = request->path;
+      m_captureRequester = msg.from;
+      ++m_captureId;
+      m_scheduler.ScheduleAfter(
+          mq::Message{
+              mq::NONE,
+              mq::Addr{GetId(), utils::EnumValue(Event::eStopCapture)},
+              m_captureId},
+          m_ctx.GetNumPriorities() - 1,
+          request->duration.count() ? request->duration
+                                    : Capture::MAX_DURATION);
+    } break;
+    case utils::EnumValue(Event::eStartDynamic): {
+      const auto *config = std::any_cast<Checkweigher::Config>(&msg.data);
+      if (!config)
+        break;
+      std::scoped_lock lock{m_mutex};
+      m_checkweigher.emplace(*config);
+      if (m_count)
+        m_checkweigher->SetZero(
+          m_Calibrated(m_sum / static_cast<float>(m_count)));
+      m_dynamicRequester = msg.from;
+    } break;
+    case utils::EnumValue(Event::eStopDynamic): {
+      std::scoped_lock lock{m_mutex};
+      m_checkweigher.reset();
     } break;
+    case utils::EnumValue(Event::eTare): {
+      CalibrationResult result{};
+      {
+        std::scoped_lock lock{m_mutex};
+        result.done = m_GetReading().quality == Quality::eStable;
+        if (result.done) {
+          m_calibration.zero = m_sum / static_cast<float>(m_count);
+          if (m_checkweigher)
+            m_checkweigher->SetZero(0.f);
+        }
+        result.calibration = m_calibration;
+      }
+      m_ctx.Push(mq::Message{msg.to, msg.from, result}, 0);
+    } break;
+    case utils::EnumValue(Event::eCalibrate): {
+      const auto *load = std::any_cast<float>(&msg.data);
+      CalibrationResult result{};
+      {
+        std::scoped_lock lock{m_mutex};
+        const auto net =
+            m_count ? m_sum / static_cast<float>(m_count) - m_calibration.zero
+                    : 0.f;
+        // the known load must stand out of the noise
+        result.done = load && *load > 0.f && std::abs(net) > STABLE_SPREAD &&
+                      m_GetReading().quality == Quality::eStable;
+        if (result.done)
+          m_calibration.gain = *load / net;
+        result.calibration = m_calibration;
+      }
+      m_ctx.Push(mq::Message{msg.to, msg.from, result}, 0);
+    } break;
+    case utils::EnumValue(Event::eStopCapture): {
+      // ignore a scheduled stop of a previous capture
+      if (const auto *id = std::any_cast<std::uint32_t>(&msg.data);
+          !id || *id == m_captureId)
+        m_StopCapture();
+    } break;
+    case utils::EnumValue(Event::eHeartbeat): {
+      const auto *id = std::any_cast<std::uint32_t>(&msg.data);
+      std::scoped_lock lock{m_mutex};
+      if (!id || *id != m_heartbeatId)
+        break;
+      const auto now = m_scheduler.GetClock().Now();
+      m_Notify(now);
+      m_ScheduleHeartbeat(now);
+    } break;
+    }
+  }
+
+  /// @brief Get the current filtered weight
+  [[nodiscard]] Reading GetReading() {
+    std::scoped_lock lock{m_mutex};
+    return m_GetReading();
+  }
+
+  [[nodiscard]] mq::Id GetId() const noexcept final { return m_id; }
+
+private:
+  struct Subscriber {
+    mq::Addr to;
+    Subscription subscription;
+    Reading last{};
+    mq::IClock::time_point lastTime{};
+    bool notified{};
+  };
+
+  mq::IContext &m_ctx;
+  mq::IScheduler &m_scheduler;
+  std::unique_ptr<ISampleSource> m_source;
+  const mq::Id m_id;
+
+  std::mutex m_mutex;
+  std::array<float, AVG_SAMPLES> m_window{};
+  int m_count{};
+  int m_next{};
+  float m_sum{};
+  mq::IClock::time_point m_lastSampleTime{};
+  std::vector<Subscriber> m_subscribers;
+  std::uint32_t m_heartbeatId{}; // invalidates the scheduled heartbeats
+  std::unique_ptr<Capture> m_capture;
+  std::string m_capturePath; // of the running capture
+  mq::IClock::time_point m_captureStart{};
+  mq::Addr m_captureRequester{mq::NONE};
+  std::uint32_t m_captureId{};
+  std::optional<Checkweigher> m_checkweigher;
+  mq::Addr m_dynamicRequester{mq::NONE};
+  Calibration m_calibration{0.f, 1.f};
+
+  std::atomic_bool m_running{true};
+  std::thread m_acquisition; // the last member: it uses all the others
+
+  [[nodiscard]] std::vector<Subscriber>::iterator
+  m_FindSubscriber(const mq::Addr &to) {
+    return std::find_if(m_subscribers.begin(), m_subscribers.end(),
+                        [&to](const auto &s) { return s.to == to; });
+  }
+
+  [[nodiscard]] float m_Calibrated(float grams) const noexcept {
+    return (grams - m_calibration.zero) * m_calibration.gain;
+  }
+
+  [[nodiscard]] Reading m_GetReading() const {
+    if (!m_count)
+      return Reading{0.f, {}, Quality::eNoData};
+
+    const auto age = std::chrono::duration_cast<std::chrono::milliseconds>(
+        m_scheduler.GetClock().Now() - m_lastSampleTime);
+    auto quality = Quality::eStable;
+    if (age > STALE_AFTER)
+      quality = Quality::eStale;
+    else if (m_count < AVG_SAMPLES)
+      quality = Quality::eUnstable;
+    else if (const auto [min, max] =
+                 std::minmax_element(m_window.cbegin(), m_window.cend());
+             (*max - *min) * std::abs(m_calibration.gain) > STABLE_SPREAD)
+      quality = Quality::eUnstable;
+
+    return Reading{m_Calibrated(m_sum / static_cast<float>(m_count)), age,
+                   quality};
+  }
+
+  void m_Acquire() {
+    while (m_running.load(std::memory_order_relaxed)) {
+      const auto sample = m_source->Read(READ_TIMEOUT);
+      if (!sample)
+        continue;
+      std::scoped_lock lock{m_mutex};
+      m_sum += sample->grams - m_window[m_next];
+      m_window[m_next] = sample->grams;
+      m_next = (m_next + 1) % AVG_SAMPLES;
+      if (!m_next) // drop the accumulated rounding error
+        m_sum = std::accumulate(m_window.cbegin(), m_window.cend(), 0.f);
+      m_count = std::min(m_count + 1, AVG_SAMPLES);
+      m_lastSampleTime = m_scheduler.GetClock().Now();
+      // the samples after a late scheduled stop can not be represented
+      if (const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+              m_lastSampleTime - m_captureStart);
+          m_capture && us.count() <= UINT32_MAX)
+        m_capture->Push(
+            RawSample{static_cast<std::uint32_t>(us.count()), sample->raw});
+      if (m_checkweigher)
+        if (const auto item =
+                m_checkweigher->Process(m_Calibrated(sample->grams)))
+          m_ctx.Push(mq::Message{
+              mq::Addr{GetId(), utils::EnumValue(Event::eStartDynamic)},
+              m_dynamicRequester, *item});
+      m_Notify(m_lastSampleTime);
     }
   }
 
-  [[nodiscard]] mq::Id GetId() const noexcept final {
-    return mq::Id::eWeightMeter;
+  void m_StopCapture() {
+    std::unique_ptr<Capture> capture;
+    {
+      std::scoped_lock lock{m_mutex};
+      capture = std::move(m_capture);
+    }
+    if (!capture)
+      return;
+    m_capturePath.clear();
+    const auto stats = capture->Stop();
+    ESP_LOGI(TAG, "Capture stopped: %u samples, %u drops, max fill %u",
+             static_cast<unsigned>(stats.samples),
+             static_cast<unsigned>(stats.drops),
+             static_cast<unsigned>(stats.maxFill));
+    m_ctx.Push(mq::Message{
+        mq::Addr{GetId(), utils::EnumValue(Event::eStopCapture)},
+        m_captureRequester, stats});
+  }
+
+  void m_FailCapture(const mq::Addr &requester) {
+    m_ctx.Push(mq::Message{
+        mq::Addr{GetId(), utils::EnumValue(Event::eStopCapture)}, requester,
+        Capture::Stats{0U, 0U, 0U, true}});
+  }
+
+  /// Schedule the next heartbeat when the first one is due, the mutex is
+  /// held. A heartbeat is checked at least every #STALE_AFTER, so a stale
+  /// weight is reported within twice that time.
+  void m_ScheduleHeartbeat(mq::IClock::time_point now) {
+    if (m_subscribers.empty())
+      return;
+    auto when = now + STALE_AFTER;
+    for (const auto &s : m_subscribers)
+      when = std::min(when, s.notified ? s.lastTime + s.subscription.heartbeat
+                                       : now);
+    m_scheduler.Schedule(
+        mq::Message{mq::NONE,
+                    mq::Addr{GetId(), utils::EnumValue(Event::eHeartbeat)},
+                    m_heartbeatId},
+        m_ctx.GetNumPriorities() - 1, std::max(when, now));
+  }
+
+  /// Push the reading to the subscribers whose deadband or heartbeat is hit,
+  /// the mutex is held
+  void m_Notify(mq::IClock::time_point now) {
+    if (m_subscribers.empty())
+      return;
+    const auto reading = m_GetReading();
+    for (auto &s : m_subscribers) {
+      const auto elapsed = now - s.lastTime;
+      const bool changed =
+          std::abs(reading.grams - s.last.grams) >= s.subscription.deadband ||
+          reading.quality != s.last.quality;
+      if (s.notified && elapsed < s.subscription.heartbeat &&
+          (!changed || elapsed < s.subscription.minInterval))
+        continue;
+      s.last = reading;
+      s.lastTime = now;
+      s.notified = true;
+      m_ctx.Push(mq::Message{
+          mq::Addr{GetId(), utils::EnumValue(Event::eSubscribe)}, s.to,
+          reading});
+    }
   }
 };
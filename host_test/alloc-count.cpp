@@ -0,0 +1,21 @@
+#include "alloc-count.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace alloc_count {
+std::atomic<bool> g_counting{};
+std::atomic<std::size_t> g_allocations{};
+} // namespace alloc_count
+
+void* operator new(std::size_t size)
+{
+  if (alloc_count::g_counting.load(std::memory_order_relaxed))
+    alloc_count::g_allocations.fetch_add(1U, std::memory_order_relaxed);
+  if (auto* memory = std::malloc(size ? size : 1U))
+    return memory;
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
@@ -0,0 +1,22 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// The global operator new of a test linked with alloc-count.cpp counts the
+// allocations while a function runs
+namespace alloc_count {
+extern std::atomic<bool> g_counting;
+extern std::atomic<std::size_t> g_allocations;
+
+/// @brief Get the number of the allocations while the function runs, on any
+/// thread
+template<typename Function>
+std::size_t Count(Function&& function)
+{
+  g_allocations = 0U;
+  g_counting = true;
+  function();
+  g_counting = false;
+  return g_allocations;
+}
+} // namespace alloc_count
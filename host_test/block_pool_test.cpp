@@ -0,0 +1,132 @@
+#include "check.hpp"
+
+#include <any>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <message-queue/block-pool.hpp>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr std::size_t CAPACITY = 64U;
+using Pool = mq::BlockPool<std::uint32_t, CAPACITY>;
+
+/// The handles travel in `std::any` as in an #mq::Message
+class Queue {
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::deque<std::any> m_items;
+
+public:
+  void Push(std::any item)
+  {
+    {
+      std::scoped_lock lock{m_mutex};
+      m_items.push_back(std::move(item));
+    }
+    m_cv.notify_one();
+  }
+
+  std::any Pop()
+  {
+    std::unique_lock lock{m_mutex};
+    m_cv.wait(lock, [this] { return !m_items.empty(); });
+    auto item = std::move(m_items.front());
+    m_items.pop_front();
+    return item;
+  }
+};
+
+void TestSingleThread()
+{
+  static_assert(sizeof(Pool::Ref) == sizeof(void*));
+  Pool pool{2U};
+  auto writer = pool.TryAcquire();
+  CHECK(writer);
+  for (std::uint32_t i{}; i < CAPACITY; ++i)
+    CHECK(writer->Push(i));
+  CHECK(writer->IsFull() && !writer->Push(0U));
+
+  const auto ref = std::move(*writer).Seal();
+  auto copy = ref;
+  CHECK(copy.size() == CAPACITY && copy[10] == 10U);
+  CHECK(pool.GetNumFree() == 1U);
+  copy.Reset();
+  CHECK(pool.GetNumFree() == 1U);
+
+  // an unsealed block goes back on its own
+  {
+    auto other = pool.TryAcquire();
+    CHECK(other && pool.GetNumFree() == 0U);
+    CHECK(!pool.TryAcquire() && pool.GetExhaustedCount() == 1U);
+  }
+  CHECK(pool.GetNumFree() == 1U);
+}
+
+/// Producers share every block with all the consumers while the pool is
+/// kept short, so the reference counts and the free list are raced
+void TestShared()
+{
+  constexpr int PRODUCERS = 2;
+  constexpr int CONSUMERS = 3;
+  constexpr int BLOCKS = 2000; // per producer
+  Pool pool{4U};
+  std::vector<Queue> queues(CONSUMERS);
+  std::atomic<std::uint64_t> checked{};
+
+  std::vector<std::thread> consumers;
+  for (auto& queue : queues)
+    consumers.emplace_back([&queue, &checked] {
+      for (;;) {
+        const auto item = queue.Pop();
+        const auto* ref = std::any_cast<Pool::Ref>(&item);
+        if (!ref || !*ref)
+          return;
+        std::uint64_t sum{};
+        for (const auto value : *ref)
+          sum += value - (*ref)[0];
+        CHECK(ref->size() == CAPACITY);
+        CHECK(sum == CAPACITY * (CAPACITY - 1U) / 2U);
+        checked.fetch_add(1U, std::memory_order_relaxed);
+      }
+    });
+
+  std::vector<std::thread> producers;
+  for (int p{}; p < PRODUCERS; ++p)
+    producers.emplace_back([&pool, &queues, p] {
+      for (int i{}; i < BLOCKS; ++i) {
+        auto writer = pool.TryAcquire();
+        // the backpressure: wait for the consumers
+        while (!writer) {
+          std::this_thread::yield();
+          writer = pool.TryAcquire();
+        }
+        const auto first = static_cast<std::uint32_t>(p * BLOCKS + i);
+        for (std::uint32_t j{}; j < CAPACITY; ++j)
+          CHECK(writer->Push(first + j));
+        const std::any message{std::move(*writer).Seal()};
+        for (auto& queue : queues)
+          queue.Push(message);
+      }
+    });
+  for (auto& producer : producers)
+    producer.join();
+  for (auto& queue : queues)
+    queue.Push(Pool::Ref{});
+  for (auto& consumer : consumers)
+    consumer.join();
+
+  CHECK(checked == std::uint64_t{PRODUCERS} * BLOCKS * CONSUMERS);
+  CHECK(pool.GetNumFree() == 4U);
+}
+} // namespace
+
+int main()
+{
+  TestSingleThread();
+  TestShared();
+  std::puts("block_pool_test passed");
+}
@@ -0,0 +1,119 @@
+#include "check.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <weight-meter/checkweigher.hpp>
+
+// The accuracy and the confidence of the checkweigher against the belt
+// speed on a synthetic 80 SPS trace: 100-1000 g items loaded half of their
+// period, each entering with a 25 ms ramp and a damped 6 Hz ringing of the
+// platform, with 1 g of noise and 2 g of a 13 Hz motor vibration. The
+// error floors are loose.
+namespace {
+constexpr double SPS = 80.;
+constexpr int ITEMS = 400;
+constexpr double RAMP_S = 0.025;
+constexpr double RING_HZ = 6.;
+constexpr double RING_DECAY_S = 0.05;
+constexpr double PI = 3.14159265358979323846;
+using Clock = std::chrono::steady_clock;
+
+constexpr Checkweigher::Config CONFIG{20.f, 10.f, 0.2f, 5U, 1.f};
+
+struct Result {
+  int detected{};
+  double meanError{};
+  double maxError{};
+  double meanConfidence{};
+  double nsPerSample{};
+  double worstNs{}; ///< the sample which completes an estimate
+};
+
+Result Run(double itemsPerMin)
+{
+  std::mt19937 rng{7U};
+  std::normal_distribution<double> noise{0., 1.};
+  std::uniform_real_distribution<double> weights{100., 1000.};
+  const auto period = 60. / itemsPerMin;
+  const auto dwell = period / 2.;
+
+  Checkweigher checkweigher{CONFIG};
+  std::vector<double> expected;
+  Result result;
+  double confidence{};
+  long samples{};
+  Clock::duration busy{};
+  double t{};
+  for (int item{}; item < ITEMS; ++item) {
+    const auto grams = weights(rng);
+    expected.push_back(grams);
+    for (double s{}; s < period; s += 1. / SPS, t += 1. / SPS) {
+      double load{};
+      if (s < RAMP_S)
+        load = grams * s / RAMP_S;
+      else if (s < dwell)
+        load = grams * (1. - std::exp(-(s - RAMP_S) / RING_DECAY_S) *
+                               std::cos(2. * PI * RING_HZ * (s - RAMP_S)));
+      else if (s < dwell + RAMP_S)
+        load = grams * (1. - (s - dwell) / RAMP_S);
+      const auto sample = static_cast<float>(
+        load + noise(rng) + 2. * std::sin(2. * PI * 13. * t));
+
+      const auto start = Clock::now();
+      const auto estimate = checkweigher.Process(sample);
+      const auto took = Clock::now() - start;
+      busy += took;
+      result.worstNs = std::max(
+        result.worstNs, std::chrono::duration<double, std::nano>(took).count());
+      ++samples;
+      if (!estimate)
+        continue;
+      // the item which just left
+      const auto error = std::abs(estimate->grams - expected.back());
+      CHECK(!std::isnan(estimate->confidence));
+      ++result.detected;
+      result.meanError += error;
+      result.maxError = std::max(result.maxError, error);
+      confidence += estimate->confidence;
+    }
+  }
+  if (result.detected) {
+    result.meanError /= result.detected;
+    result.meanConfidence = confidence / result.detected;
+  }
+  result.nsPerSample =
+    std::chrono::duration<double, std::nano>(busy).count() /
+    static_cast<double>(samples);
+  return result;
+}
+} // namespace
+
+int main()
+{
+  std::printf("items/min  detected  mean err [g]  max err [g]  confidence  "
+              "ns/sample  worst ns\n");
+  Result slowest{};
+  Result fastest{};
+  for (const auto itemsPerMin : {15., 30., 60., 90., 120., 180.}) {
+    const auto r = Run(itemsPerMin);
+    std::printf("%9.0f  %4d/%-4d %12.2f %12.2f %11.2f %10.0f %9.0f\n",
+                itemsPerMin, r.detected, ITEMS, r.meanError, r.maxError,
+                r.meanConfidence, r.nsPerSample, r.worstNs);
+    if (itemsPerMin == 15.)
+      slowest = r;
+    fastest = r;
+  }
+  CHECK(slowest.detected == ITEMS && slowest.meanError < 1.);
+  CHECK(slowest.meanConfidence > fastest.meanConfidence);
+
+  // a noise free plateau with no tolerance is exact, not NaN
+  Checkweigher exact{Checkweigher::Config{20.f, 10.f, 0.2f, 5U, 0.f}};
+  for (int i{}; i < 20; ++i)
+    CHECK(!exact.Process(500.f));
+  const auto item = exact.Process(0.f);
+  CHECK(item && item->grams == 500.f && item->confidence == 1.f);
+}
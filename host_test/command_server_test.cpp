@@ -0,0 +1,255 @@
+#include "check.hpp"
+
+#include <array>
+#include <command-server/command-server.hpp>
+#include <cstdio>
+#include <memory>
+#include <message-queue/context.hpp>
+#include <message-queue/scheduler.hpp>
+#include <message-queue/virtual-clock.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The requests are parsed from the topic and the payload, the replies of the
+// meters find their request by the token, and a silent meter times out
+namespace {
+using namespace std::chrono_literals;
+
+constexpr std::chrono::milliseconds TIMEOUT{500};
+
+/// Takes the requests in place of the broker and keeps the replies
+class FakeTransport final : public mqtt::ITransport {
+public:
+  std::vector<std::pair<std::string, std::string>> replies;
+
+  void Request(const std::string& topic, std::string_view payload)
+  {
+    m_handler->OnData(mqtt::DataChunk{topic, 0U, payload, payload.size()});
+  }
+
+  void Start(mqtt::ITransportHandler& handler) override
+  {
+    m_handler = &handler;
+    handler.OnConnected(false);
+  }
+  int Subscribe(const char*, mqtt::QoS) override { return 1; }
+  int Unsubscribe(const char*) override { return 1; }
+  int Publish(const char* topic, std::string_view data, mqtt::QoS,
+              bool) override
+  {
+    replies.emplace_back(topic, data);
+    return 1;
+  }
+  int Enqueue(const char* topic, std::string_view data, mqtt::QoS qos,
+              bool retain, bool) override
+  {
+    return Publish(topic, data, qos, retain);
+  }
+
+private:
+  mqtt::ITransportHandler* m_handler{};
+};
+
+/// Holds the reads until told to answer them
+class FakeMeter final : public mq::ISystem {
+public:
+  struct Read {
+    mq::Addr from;
+    mq::Addr to;
+  };
+  std::vector<Read> reads;
+
+  explicit FakeMeter(mq::IContext& ctx) : m_ctx{ctx} {}
+
+  void Answer(std::size_t read, float grams)
+  {
+    m_ctx.Push(mq::Message{reads.at(read).to, reads.at(read).from,
+                           WeightMeter::Reading{grams,
+                                                {},
+                                                WeightMeter::Quality::eStable}},
+               0);
+  }
+
+  void Process(const mq::Message& msg) override
+  {
+    if (msg.to.sys == GetId() &&
+        msg.to.ev == utils::EnumValue(WeightMeter::Event::eReadCmd))
+      reads.push_back(Read{msg.from, msg.to});
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eWeightMeter;
+  }
+
+private:
+  mq::IContext& m_ctx;
+};
+
+/// Counts the telemetry flushes
+class FakeLogic final : public mq::ISystem {
+public:
+  int flushes{};
+
+  void Process(const mq::Message& msg) override
+  {
+    if (msg.to.sys == GetId() &&
+        msg.to.ev == utils::EnumValue(Logic::Event::eFlushTelemetry))
+      ++flushes;
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eLogic;
+  }
+};
+
+struct Setup {
+  mq::VirtualClock clock;
+  mq::Context ctx;
+  mq::Scheduler scheduler{clock};
+  FakeTransport* transport = new FakeTransport;
+  std::shared_ptr<mqtt::Client> client = std::make_shared<mqtt::Client>(
+    std::unique_ptr<mqtt::ITransport>{transport});
+  std::shared_ptr<FakeMeter> meter = std::make_shared<FakeMeter>(ctx);
+  std::shared_ptr<FakeLogic> logic = std::make_shared<FakeLogic>();
+
+  Setup()
+  {
+    ctx.AddSystem(meter);
+    ctx.AddSystem(logic);
+    ctx.AddSystem(std::make_shared<CommandServer>(
+      ctx, scheduler, client,
+      CommandServer::Config{"dev", "capture.bin", TIMEOUT}));
+  }
+
+  /// Send a request and run for a while
+  void Request(const std::string& topic, std::string_view payload = {},
+               std::chrono::milliseconds run = 1ms)
+  {
+    transport->Request(topic, payload);
+    mq::Simulate(ctx, scheduler, clock, run);
+  }
+
+  /// The status of the reply to the ID, empty if there is none
+  [[nodiscard]] std::string Status(const std::string& id) const
+  {
+    std::string status;
+    for (const auto& [topic, payload] : transport->replies)
+      if (topic == "dev/rsp/" + id) {
+        CHECK(status.empty());
+        const auto begin = payload.find("\"status\":\"");
+        CHECK(begin != std::string::npos);
+        status = payload.substr(begin + 10U,
+                                payload.find('"', begin + 10U) - begin - 10U);
+      }
+    return status;
+  }
+
+  [[nodiscard]] std::string Reply(const std::string& id) const
+  {
+    for (const auto& [topic, payload] : transport->replies)
+      if (topic == "dev/rsp/" + id)
+        return payload;
+    return {};
+  }
+};
+
+void TestParse()
+{
+  Setup setup;
+  setup.Request("dev/req/nope/1");
+  CHECK(setup.Status("1") == "unknown");
+  // no ID to reply to
+  setup.Request("dev/req/read/");
+  setup.Request("dev/req/read/" + std::string(65U, 'x'));
+  CHECK(setup.transport->replies.size() == 1U);
+  CHECK(setup.meter->reads.empty());
+
+  for (const auto& [id, command, args] :
+       std::vector<std::array<std::string, 3>>{
+         {"2", "calibrate", "abc"},
+         {"3", "calibrate", "-1"},
+         {"4", "calibrate", ""},
+         {"5", "read", "x"},
+         {"6", "read", "0 1"},
+         {"7", "tare", "256"},
+         {"8", "capture", "4295"},
+         {"9", "capture", "0"},
+       }) {
+    setup.Request("dev/req/" + command + "/" + id, args);
+    CHECK(setup.Status(id) == "invalid");
+  }
+  CHECK(setup.meter->reads.empty());
+
+  setup.Request("dev/req/flush/10");
+  CHECK(setup.Status("10") == "ok" && setup.logic->flushes == 1);
+  // the spaces around the arguments don't matter
+  setup.Request("dev/req/read/11", " 0 ");
+  CHECK(setup.meter->reads.size() == 1U && setup.Status("11").empty());
+}
+
+void TestToken()
+{
+  Setup setup;
+  setup.Request("dev/req/read/a");
+  setup.Request("dev/req/read/b");
+  CHECK(setup.meter->reads.size() == 2U);
+  CHECK(setup.meter->reads[0].from.ev != setup.meter->reads[1].from.ev);
+  // the answers come in the reverse order
+  setup.meter->Answer(1U, 2.f);
+  mq::Simulate(setup.ctx, setup.scheduler, setup.clock, 3ms);
+  setup.meter->Answer(0U, 1.f);
+  mq::Simulate(setup.ctx, setup.scheduler, setup.clock, 1ms);
+  CHECK(setup.Reply("a") ==
+        R"({"id":"a","cmd":"read","status":"ok","us":5000,"g":1.0,"q":2,)"
+        R"("age":0})");
+  CHECK(setup.Reply("b") ==
+        R"({"id":"b","cmd":"read","status":"ok","us":1000,"g":2.0,"q":2,)"
+        R"("age":0})");
+  // an answer without a pending request is ignored
+  setup.meter->Answer(0U, 1.f);
+  mq::Simulate(setup.ctx, setup.scheduler, setup.clock, 1s);
+  CHECK(setup.transport->replies.size() == 2U);
+
+  // no more than 8 pending commands
+  for (int i{}; i < 9; ++i)
+    setup.Request("dev/req/read/c" + std::to_string(i));
+  CHECK(setup.meter->reads.size() == 10U);
+  CHECK(setup.Status("c7").empty() && setup.Status("c8") == "busy");
+}
+
+void TestTimeout()
+{
+  Setup setup;
+  setup.Request("dev/req/read/1");
+  // the instance 1 doesn't exist
+  setup.Request("dev/req/tare/2", "1");
+  mq::Simulate(setup.ctx, setup.scheduler, setup.clock, TIMEOUT - 3ms);
+  CHECK(setup.transport->replies.empty());
+  mq::Simulate(setup.ctx, setup.scheduler, setup.clock, 1ms);
+  CHECK(setup.Reply("1") ==
+        R"({"id":"1","cmd":"read","status":"timeout","us":500000})");
+  CHECK(setup.Status("2").empty());
+  mq::Simulate(setup.ctx, setup.scheduler, setup.clock, 1ms);
+  CHECK(setup.Status("2") == "timeout");
+  // a late answer is ignored
+  setup.meter->Answer(0U, 1.f);
+  mq::Simulate(setup.ctx, setup.scheduler, setup.clock, 1s);
+  CHECK(setup.transport->replies.size() == 2U);
+
+  // the time of a capture adds to the timeout
+  setup.Request("dev/req/capture/3", "1.5");
+  mq::Simulate(setup.ctx, setup.scheduler, setup.clock, 2s + TIMEOUT - 2ms);
+  CHECK(setup.Status("3").empty());
+  mq::Simulate(setup.ctx, setup.scheduler, setup.clock, 1ms);
+  CHECK(setup.Status("3") == "timeout");
+}
+} // namespace
+
+int main()
+{
+  TestParse();
+  TestToken();
+  TestTimeout();
+  std::puts("command_server_test passed");
+}
@@ -0,0 +1,120 @@
+#include "check.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <sample-log/format.hpp>
+#include <vector>
+
+// The size and the speed of the packed blocks against the raw columns on a
+// synthetic load cell trace, in memory: 6 h at 80 SPS of a 24-bit ADC with
+// a tare offset, loads put on and taken off with a settling, drift, noise
+// and the jitter of the DRDY interrupt. The speeds are in MB/s of 8-byte
+// samples. The floors are loose.
+namespace {
+constexpr std::size_t SAMPLES = 80U * 3600U * 6U;
+constexpr double MIN_RATIO = 2.;
+constexpr double MIN_MB_PER_S = 20.;
+using Clock = std::chrono::steady_clock;
+using samplelog::Sample;
+
+std::vector<Sample> LoadCell()
+{
+  std::mt19937 rng{1U};
+  std::normal_distribution<double> noise{0., 35.};
+  std::uniform_int_distribution<int> jitter{-40, 40};
+  std::vector<Sample> trace;
+  trace.reserve(SAMPLES);
+  double target{};
+  double level{};
+  double drift{};
+  std::uint64_t timeUs = 5000000U;
+  for (std::size_t i{}; i < SAMPLES; ++i) {
+    if (!(rng() % 2000U))
+      target = rng() % 3U ? static_cast<double>(rng() % 400000U) : 0.;
+    level += (target - level) * 0.08;
+    drift += 0.01;
+    timeUs += 12500U;
+    trace.push_back(Sample{
+      static_cast<std::uint64_t>(static_cast<std::int64_t>(timeUs) +
+                                 jitter(rng)),
+      static_cast<std::int32_t>(1250000. + level + drift + noise(rng))});
+  }
+  return trace;
+}
+
+struct Blocks {
+  std::vector<std::vector<std::uint8_t>> data;
+  std::vector<samplelog::IndexEntry> entries;
+};
+
+Blocks Encode(const std::vector<Sample>& trace, samplelog::Encoding encoding)
+{
+  Blocks blocks;
+  std::vector<std::uint8_t> block(samplelog::BLOCK_SIZE);
+  samplelog::BlockBuilder builder{block, 0U, encoding};
+  const auto seal = [&] {
+    blocks.entries.push_back(
+      builder.Finish(static_cast<std::uint32_t>(blocks.data.size())));
+    blocks.data.push_back(block);
+  };
+  for (const auto& sample : trace)
+    if (!builder.Add(sample)) {
+      seal();
+      CHECK(builder.Add(sample));
+    }
+  seal();
+  return blocks;
+}
+
+double MbPerS(Clock::time_point start)
+{
+  const auto seconds =
+    std::chrono::duration<double>(Clock::now() - start).count();
+  return 8. * SAMPLES / seconds / 1e6;
+}
+
+void Measure(const std::vector<Sample>& trace, samplelog::Encoding encoding,
+             const char* name, std::size_t& blockCount)
+{
+  auto start = Clock::now();
+  const auto blocks = Encode(trace, encoding);
+  const auto encodeRate = MbPerS(start);
+
+  start = Clock::now();
+  std::size_t i{};
+  bool same = true;
+  for (std::size_t b{}; b < blocks.data.size(); ++b) {
+    samplelog::BlockDecoder decoder{blocks.data[b], blocks.entries[b]};
+    for (Sample sample{}; decoder.Next(sample); ++i)
+      same = same && i < trace.size() &&
+             sample.timestampUs == trace[i].timestampUs &&
+             sample.value == trace[i].value;
+  }
+  const auto decodeRate = MbPerS(start);
+
+  blockCount = blocks.data.size();
+  std::printf("%s: %zu blocks, %.2f B/sample, encode %.0f MB/s, "
+              "decode %.0f MB/s\n",
+              name, blockCount,
+              static_cast<double>(blockCount * samplelog::BLOCK_SIZE) /
+                SAMPLES,
+              encodeRate, decodeRate);
+  CHECK(same && i == trace.size());
+  CHECK(encodeRate >= MIN_MB_PER_S && decodeRate >= MIN_MB_PER_S);
+}
+} // namespace
+
+int main()
+{
+  const auto trace = LoadCell();
+  std::size_t raw{};
+  std::size_t packed{};
+  Measure(trace, samplelog::Encoding::eColumns, "columns", raw);
+  Measure(trace, samplelog::Encoding::ePacked, "packed", packed);
+  const auto ratio = static_cast<double>(raw) / static_cast<double>(packed);
+  std::printf("ratio: %.2f\n", ratio);
+  CHECK(ratio >= MIN_RATIO);
+  return 0;
+}
@@ -0,0 +1,151 @@
+#include "check.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <message-queue/context.hpp>
+#include <message-queue/virtual-clock.hpp>
+#include <optional>
+#include <vector>
+
+// The cost of a push and a pick with 1 to 32 occupied levels, without and
+// with the aging, then the longest wait of the low priority messages under a
+// saturating high priority stream
+namespace {
+using namespace std::chrono_literals;
+constexpr int ROUNDS = 1000000;
+constexpr auto BOUND = 50ms;
+using Clock = std::chrono::steady_clock;
+
+/// Pushes every message to the next lower level, the lowest one to the top
+class Echo final : public mq::ISystem {
+public:
+  Echo(mq::IContext& ctx, unsigned levels) : m_ctx{ctx}, m_levels{levels} {}
+
+  void Process(const mq::Message& msg) override
+  {
+    const auto level = static_cast<std::uint16_t>((msg.to.ev + 1U) % m_levels);
+    m_ctx.Push(mq::Message{msg.from, mq::Addr{msg.to.sys, level}, {}}, level);
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eLogic;
+  }
+
+private:
+  mq::IContext& m_ctx;
+  const unsigned m_levels;
+};
+
+/// Every level holds a message and is picked in turn, the virtual time stands
+/// still so nothing ages
+double PickCost(unsigned levels, std::optional<mq::IClock::duration> bound)
+{
+  mq::VirtualClock clock;
+  mq::Context ctx{mq::Context::MAX_PRIORITIES, bound, clock};
+  ctx.AddSystem(std::make_shared<Echo>(ctx, levels));
+  for (unsigned level{}; level < levels; ++level)
+    ctx.Push(mq::Message{mq::NONE,
+                         mq::Addr{mq::Id::eLogic,
+                                  static_cast<std::uint16_t>(level)},
+                         {}},
+             level);
+
+  const auto start = Clock::now();
+  for (int i{}; i < ROUNDS; ++i)
+    CHECK(ctx.ProcessOneMessage());
+  const std::chrono::duration<double, std::nano> time = Clock::now() - start;
+  return time.count() / ROUNDS;
+}
+
+/// Notes the longest wait of the messages to it, the payload is the time
+/// they were pushed
+class Sink final : public mq::ISystem {
+public:
+  explicit Sink(const mq::IClock& clock) : m_clock{clock} {}
+
+  std::size_t served{};
+  mq::IClock::duration longest{};
+
+  void Process(const mq::Message& msg) override
+  {
+    ++served;
+    longest = std::max(longest, m_clock.Now() -
+                                  *std::any_cast<mq::IClock::time_point>(
+                                    &msg.data));
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eWeightMeter;
+  }
+
+private:
+  const mq::IClock& m_clock;
+};
+
+/// A backlog of the high priority messages which never drains, 3 of them per
+/// 1 ms served at the same rate, and one of the lowest of 8 levels per 10 ms
+/// on top for 1 s. The aging serves the low ones at the expense of a growing
+/// high priority backlog.
+mq::IClock::duration LongestWait(std::optional<mq::IClock::duration> bound)
+{
+  mq::VirtualClock clock;
+  mq::Context ctx{8U, bound, clock};
+  auto sink = std::make_shared<Sink>(clock);
+  ctx.AddSystem(sink);
+
+  for (int i{}; i < 10; ++i)
+    ctx.Push(mq::Message{mq::NONE, mq::Addr{mq::Id::eLogic, 0}, {}}, 0U);
+  std::vector<mq::IClock::time_point> pushed;
+  for (int ms{}; ms < 1000; ++ms) {
+    if (ms % 10 == 0) {
+      pushed.push_back(clock.Now());
+      ctx.Push(mq::Message{mq::NONE, mq::Addr{mq::Id::eWeightMeter, 0},
+                           clock.Now()},
+               7U);
+    }
+    for (int i{}; i < 3; ++i)
+      ctx.Push(mq::Message{mq::NONE, mq::Addr{mq::Id::eLogic, 0}, {}}, 0U);
+    for (int i{}; i < 3; ++i)
+      CHECK(ctx.ProcessOneMessage());
+    clock.Advance(1ms);
+  }
+  // the ones never served waited till the end at least
+  if (sink->served < pushed.size())
+    return std::max(sink->longest, clock.Now() - pushed[sink->served]);
+  return sink->longest;
+}
+} // namespace
+
+int main()
+{
+  std::printf("levels  push+pick [ns]  aged [ns]\n");
+  double aged1{};
+  double aged32{};
+  for (const auto levels : {1U, 8U, 32U}) {
+    const auto plain = PickCost(levels, std::nullopt);
+    const auto aged = PickCost(levels, BOUND);
+    std::printf("%6u  %14.0f  %9.0f\n", levels, plain, aged);
+    if (levels == 1U)
+      aged1 = aged;
+    if (levels == 32U)
+      aged32 = aged;
+  }
+
+  const auto starved = LongestWait(std::nullopt);
+  const auto aged = LongestWait(BOUND);
+  std::printf(
+    "longest low priority wait: %lld ms without aging, %lld ms with a "
+    "%lld ms bound\n",
+    static_cast<long long>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(starved).count()),
+    static_cast<long long>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(aged).count()),
+    static_cast<long long>(BOUND.count()));
+  CHECK(aged <= BOUND + 1ms);
+  CHECK(starved >= 1s);
+  // the aged pick does not walk the levels
+  CHECK(aged32 < aged1 * 2.);
+}
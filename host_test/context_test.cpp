@@ -0,0 +1,124 @@
+#include "check.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <message-queue/context.hpp>
+#include <message-queue/virtual-clock.hpp>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+using namespace std::chrono_literals;
+
+/// Notes the value of every message to it
+class Sink final : public mq::ISystem {
+public:
+  std::vector<int> values;
+
+  void Process(const mq::Message& msg) override
+  {
+    values.push_back(*std::any_cast<int>(&msg.data));
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eLogic;
+  }
+};
+
+void Push(mq::IContext& ctx, int value, unsigned priority)
+{
+  ctx.Push(mq::Message{mq::NONE, mq::Addr{mq::Id::eLogic, 0}, value},
+           priority);
+}
+
+/// The priority first, the arrival within a level
+void TestPriorities()
+{
+  CHECK([] {
+    try {
+      mq::Context{mq::Context::MAX_PRIORITIES + 1U};
+    }
+    catch (const std::invalid_argument&) {
+      return true;
+    }
+    return false;
+  }());
+
+  mq::Context ctx{mq::Context::MAX_PRIORITIES};
+  auto sink = std::make_shared<Sink>();
+  ctx.AddSystem(sink);
+  for (unsigned priority = mq::Context::MAX_PRIORITIES; priority-- > 0U;) {
+    Push(ctx, static_cast<int>(priority * 2U), priority);
+    Push(ctx, static_cast<int>(priority * 2U + 1U), priority);
+  }
+  while (ctx.ProcessOneMessage()) {}
+  CHECK(sink->values.size() == mq::Context::MAX_PRIORITIES * 2U);
+  for (std::size_t i{}; i < sink->values.size(); ++i)
+    CHECK(sink->values[i] == static_cast<int>(i));
+}
+
+/// The messages over the bound are served first, the oldest one first
+void TestAging()
+{
+  mq::VirtualClock clock;
+  mq::Context ctx{3U, 10ms, clock};
+  auto sink = std::make_shared<Sink>();
+  ctx.AddSystem(sink);
+
+  Push(ctx, 2, 2U);
+  clock.Advance(5ms);
+  Push(ctx, 1, 1U);
+  clock.Advance(5ms);
+  // exactly on the bound is not aged yet
+  Push(ctx, 0, 0U);
+  CHECK(ctx.ProcessOneMessage() && sink->values.back() == 0);
+
+  Push(ctx, 0, 0U);
+  clock.Advance(10ms);
+  Push(ctx, 0, 0U);
+  // 2 waited 20 ms, 1 waited 15 ms, the first 0 waited 10 ms
+  while (ctx.ProcessOneMessage()) {}
+  CHECK((sink->values == std::vector<int>{0, 2, 1, 0, 0}));
+}
+
+/// A saturating high priority stream does not starve a low priority message
+/// longer than the bound
+void TestStarvation()
+{
+  constexpr auto BOUND = 50ms;
+  mq::VirtualClock clock;
+  mq::Context ctx{4U, BOUND, clock};
+  auto sink = std::make_shared<Sink>();
+  ctx.AddSystem(sink);
+
+  // a backlog of the high priority messages which never drains
+  for (int i{}; i < 10; ++i)
+    Push(ctx, 0, 0U);
+  std::vector<mq::IClock::time_point> pushed;
+  for (int step{}; step < 1000; ++step) {
+    if (step % 100 == 0) {
+      Push(ctx, 1 + static_cast<int>(pushed.size()), 3U);
+      pushed.push_back(clock.Now());
+    }
+    Push(ctx, 0, 0U);
+    CHECK(ctx.ProcessOneMessage());
+    if (const auto value = sink->values.back(); value > 0)
+      CHECK(clock.Now() - pushed.at(static_cast<std::size_t>(value - 1)) <=
+            BOUND + 1ms);
+    clock.Advance(1ms);
+  }
+  int served{};
+  for (const auto value : sink->values)
+    served += value > 0;
+  CHECK(served == static_cast<int>(pushed.size()));
+}
+} // namespace
+
+int main()
+{
+  TestPriorities();
+  TestAging();
+  TestStarvation();
+  std::puts("context_test passed");
+}
@@ -0,0 +1,101 @@
+#include "check.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <mqtt-helper/loopback.hpp>
+#include <string>
+#include <vector>
+
+// A payload bigger than the buffer of the transport is assembled in a pooled
+// block shared by the handlers, the chunk handlers get the chunks in place
+namespace {
+using mqtt::InboundMessage;
+
+std::string MakePayload(std::size_t size)
+{
+  std::string payload(size, '\0');
+  for (std::size_t i{}; i < size; ++i)
+    payload[i] = static_cast<char>('a' + i % 26U);
+  return payload;
+}
+} // namespace
+
+int main()
+{
+  constexpr std::size_t BUFFER_SIZE = 256U;
+  constexpr std::size_t BLOCKS = 2U;
+  mqtt::LoopbackBroker broker;
+  auto client = std::make_shared<mqtt::Client>(
+    std::make_unique<mqtt::LoopbackTransport>(broker, BUFFER_SIZE), nullptr,
+    nullptr, BLOCKS);
+
+  std::vector<InboundMessage> first;
+  std::vector<InboundMessage> second;
+  std::size_t chunks{};
+  std::size_t chunked{};
+  CHECK(client->AddFilterHandler(
+    "big/#", [&first](const InboundMessage& m) { first.push_back(m); }));
+  CHECK(client->AddFilterHandler(
+    "big/+", [&second](const InboundMessage& m) { second.push_back(m); }));
+  CHECK(client->AddChunkHandler(
+    "big/#", [&chunks, &chunked](std::string_view, std::size_t offset,
+                                 std::string_view chunk, std::size_t total) {
+      ++chunks;
+      if (offset + chunk.size() == total)
+        chunked += total;
+    }));
+  client->Subscribe("big/#", mqtt::QoS::e1);
+  broker.WaitIdle();
+
+  const auto payload = MakePayload(3000U);
+  client->Publish("big/a", payload, mqtt::QoS::e1);
+  broker.WaitIdle();
+  CHECK(first.size() == 1U && second.size() == 1U);
+  CHECK(first[0].GetTopic() == "big/a" && first[0].GetPayload() == payload);
+  // one block for both handlers
+  CHECK(first[0].GetPayload().data() == second[0].GetPayload().data());
+  CHECK(chunks == (payload.size() + BUFFER_SIZE - 1U) / BUFFER_SIZE);
+  CHECK(chunked == payload.size());
+
+  // the held messages exhaust the pool
+  client->Publish("big/b", "b", mqtt::QoS::e1);
+  client->Publish("big/c", "c", mqtt::QoS::e1);
+  broker.WaitIdle();
+  CHECK(first.size() == 2U && first[1].GetPayload() == "b");
+  CHECK(client->GetInboundDrops() == 1U);
+  first.clear();
+  second.clear();
+  client->Publish("big/d", "", mqtt::QoS::e1);
+  broker.WaitIdle();
+  CHECK(first.size() == 1U && first[0].GetTopic() == "big/d" &&
+        first[0].GetPayload().empty());
+
+  // the handlers get the messages up to a full buffer of the esp-mqtt client
+  first.clear();
+  second.clear();
+  const auto large = MakePayload(6000U);
+  const auto full = MakePayload(InboundMessage::MAX_MESSAGE_SIZE - 5U);
+  client->Publish("big/f", large, mqtt::QoS::e1);
+  client->Publish("big/g", full, mqtt::QoS::e1);
+  broker.WaitIdle();
+  CHECK(first.size() == 2U && second.size() == 2U);
+  CHECK(first[0].GetTopic() == "big/f" && first[0].GetPayload() == large);
+  CHECK(second[1].GetTopic() == "big/g" && second[1].GetPayload() == full);
+  CHECK(client->GetInboundDrops() == 1U);
+
+  // a bigger message only goes to the chunk handlers
+  first.clear();
+  second.clear();
+  const auto huge = MakePayload(InboundMessage::MAX_MESSAGE_SIZE - 4U);
+  chunked = 0U;
+  client->Publish("big/e", huge, mqtt::QoS::e1);
+  broker.WaitIdle();
+  CHECK(first.empty() && client->GetInboundDrops() == 2U);
+  CHECK(chunked == huge.size());
+
+  // the client outlives the messages
+  first.clear();
+  second.clear();
+  client.reset();
+  std::puts("inbound_test passed");
+}
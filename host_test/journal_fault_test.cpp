@@ -0,0 +1,225 @@
+#include "check.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <gsl/span>
+#include <logger/journal.hpp>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <utils/crc.hpp>
+#include <utils/utils.hpp>
+#include <vector>
+
+// Power losses injected into a journal: the file cut at every byte and
+// followed by nothing, zeros, random bytes or the records of another file,
+// and the writes of the logger failing from every one on, the first failing
+// one torn. Linked with -Wl,--wrap=fwrite.
+namespace {
+constexpr const char* PATH = "journal_fault_test.jl";
+constexpr const char* STALE_PATH = "journal_fault_test.old";
+constexpr std::size_t TAIL_SIZE = 3000U;
+
+// the writes from the limit on fail, the one at it is torn
+long g_writes{};
+long g_limit = -1;
+} // namespace
+
+extern "C" std::size_t __real_fwrite(const void* data, std::size_t size,
+                                     std::size_t count, std::FILE* file);
+
+extern "C" std::size_t __wrap_fwrite(const void* data, std::size_t size,
+                                     std::size_t count, std::FILE* file)
+{
+  if (g_limit < 0)
+    return __real_fwrite(data, size, count, file);
+  const auto write = g_writes++;
+  if (write < g_limit)
+    return __real_fwrite(data, size, count, file);
+  if (write == g_limit && size * count > 1U)
+    return __real_fwrite(data, 1U, size * count / 2U, file) / size;
+  return 0U;
+}
+
+namespace {
+std::vector<std::uint8_t> ReadAll(const char* path)
+{
+  struct stat info {};
+  if (stat(path, &info))
+    return {};
+  std::vector<std::uint8_t> data(static_cast<std::size_t>(info.st_size));
+  auto* file = std::fopen(path, "rb");
+  CHECK(file);
+  CHECK(std::fread(data.data(), 1U, data.size(), file) == data.size());
+  std::fclose(file);
+  return data;
+}
+
+void WriteAll(const char* path, const std::vector<std::uint8_t>& data)
+{
+  auto* file = std::fopen(path, "wb");
+  CHECK(file);
+  CHECK(std::fwrite(data.data(), 1U, data.size(), file) == data.size());
+  std::fclose(file);
+}
+
+Journal::Config SmallConfig()
+{
+  auto config = Journal::DEFAULT_CONFIG;
+  config.logger.blockSize = 512U;
+  config.logger.blocks = 64U;
+  config.logger.syncInterval = std::chrono::milliseconds{0};
+  config.checkpointInterval = 2048U;
+  return config;
+}
+
+std::vector<std::uint8_t> Payload(std::mt19937& rng, std::uint32_t i)
+{
+  std::vector<std::uint8_t> payload(1U + rng() % 60U);
+  for (auto& byte : payload)
+    byte = static_cast<std::uint8_t>(i * 31U + rng());
+  return payload;
+}
+
+void Write(const char* path, std::uint32_t records, std::mt19937& rng)
+{
+  Journal journal{path, SmallConfig()};
+  for (std::uint32_t i{}; i < records; ++i) {
+    const auto payload = Payload(rng, i);
+    while (!journal.Append(payload))
+      std::this_thread::yield();
+  }
+}
+
+/// The offset after the valid records from the offset on, the CRC and the
+/// sequence numbers checked without the journal
+std::size_t Walk(const std::vector<std::uint8_t>& data, std::size_t offset)
+{
+  std::uint32_t run{};
+  std::uint32_t sequence{};
+  for (bool first = true; offset + Journal::HEADER_SIZE <= data.size();
+       first = false) {
+    const auto* header = data.data() + offset;
+    const auto length = utils::LoadLittleEndian<std::uint16_t>(header + 4);
+    const auto number = utils::LoadLittleEndian<std::uint32_t>(header + 8);
+    if (offset + Journal::HEADER_SIZE + length > data.size() ||
+        (!first && number != sequence))
+      break;
+    const bool checkpoint =
+      header[2] == utils::EnumValue(Journal::Type::eCheckpoint);
+    if (checkpoint)
+      run = utils::LoadLittleEndian<std::uint32_t>(header + 24);
+    const auto crc = crc::Crc32(
+      gsl::span{header + Journal::HEADER_SIZE, length},
+      crc::Crc32(gsl::span{header, 12U}, checkpoint ? 0U : run));
+    if (crc != utils::LoadLittleEndian<std::uint32_t>(header + 12))
+      break;
+    sequence = number + 1U;
+    offset += Journal::HEADER_SIZE + length;
+  }
+  return offset;
+}
+
+void TestCuts()
+{
+  std::mt19937 rng{1U};
+  std::remove(PATH);
+  // two runs
+  Write(PATH, 150U, rng);
+  Write(PATH, 150U, rng);
+  const auto reference = ReadAll(PATH);
+  CHECK(Walk(reference, 0U) == reference.size());
+  std::vector<std::size_t> bounds{0U};
+  for (std::size_t offset{};
+       offset + Journal::HEADER_SIZE <= reference.size();) {
+    offset += Journal::HEADER_SIZE +
+              utils::LoadLittleEndian<std::uint16_t>(&reference[offset + 4]);
+    bounds.push_back(offset);
+  }
+  CHECK(bounds.back() == reference.size());
+  std::remove(STALE_PATH);
+  Write(STALE_PATH, 400U, rng);
+  const auto stale = ReadAll(STALE_PATH);
+
+  std::uint64_t maxScanned{};
+  for (std::size_t cut{}; cut <= reference.size(); ++cut)
+    for (int tail{}; tail < 4; ++tail) {
+      std::vector<std::uint8_t> data(reference.cbegin(),
+                                     reference.cbegin() + cut);
+      for (std::size_t i{}; tail && i < TAIL_SIZE; ++i)
+        data.push_back(tail == 1   ? 0U
+                       : tail == 2 ? static_cast<std::uint8_t>(rng())
+                                   : stale[std::min(stale.size() - 1U,
+                                                    cut + i + 1000U)]);
+      WriteAll(PATH, data);
+      const auto recovery = Journal::Recover(PATH);
+      CHECK(ReadAll(PATH).size() == recovery.size);
+      maxScanned = std::max(maxScanned, recovery.scanned);
+      // the last whole record before the cut, a cut inside the first
+      // checkpoint leaves no journal and the file is kept
+      const auto last = *(std::upper_bound(bounds.cbegin(), bounds.cend(),
+                                           cut) - 1);
+      if (!last) {
+        CHECK(recovery.size == data.size());
+        continue;
+      }
+      // a torn record completed by the same bytes is a whole record
+      CHECK(recovery.size >= last && recovery.size <= reference.size() &&
+            std::binary_search(bounds.cbegin(), bounds.cend(),
+                               recovery.size) &&
+            std::equal(data.cbegin(), data.cbegin() + recovery.size,
+                       reference.cbegin()));
+    }
+  std::printf("cuts: %zu bytes, at most %llu scanned\n", reference.size(),
+              static_cast<unsigned long long>(maxScanned));
+  std::remove(STALE_PATH);
+}
+
+void TestWriteFaults()
+{
+  std::mt19937 rng{2U};
+  long limit{};
+  for (;; ++limit) {
+    std::remove(PATH);
+    g_writes = 0;
+    g_limit = limit;
+    {
+      Journal journal{PATH, SmallConfig()};
+      for (std::uint32_t i{}; i < 200U; ++i) {
+        static_cast<void>(journal.Append(Payload(rng, i)));
+        std::this_thread::sleep_for(std::chrono::microseconds{20});
+      }
+      journal.Stop();
+    }
+    const auto writes = g_writes;
+    g_limit = -1;
+    const auto before = ReadAll(PATH).size();
+    const auto recovery = Journal::Recover(PATH);
+    CHECK(recovery.size <= before);
+    // the next run appends to the recovered journal
+    Write(PATH, 50U, rng);
+    const auto data = ReadAll(PATH);
+    auto end = Walk(data, 0U);
+    // a torn first checkpoint is not a journal, the next run follows it
+    if (!end)
+      end = Walk(data, recovery.size);
+    CHECK(end == data.size());
+    CHECK(!Journal::Recover(PATH).dropped);
+    if (limit >= writes)
+      break;
+  }
+  std::printf("write faults: %ld writes\n", limit);
+}
+} // namespace
+
+int main()
+{
+  TestCuts();
+  TestWriteFaults();
+  std::remove(PATH);
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include "check.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <gsl/span>
+#include <logger/journal.hpp>
+#include <memory>
+#include <sample-log/reader.hpp>
+#include <string>
+#include <unistd.h>
+
+// A sample log and a journal past 2 GiB, the offsets beyond a 32-bit long.
+// The files are sparse: the first 2 GiB are a hole, the records at the end
+// are real.
+namespace {
+constexpr std::uint64_t TWO_GIB = std::uint64_t{1} << 31U;
+
+void Extend(const std::string& path, std::uint64_t size)
+{
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> file{
+    std::fopen(path.c_str(), "wb"), &std::fclose};
+  CHECK(file);
+  file.reset();
+  CHECK(!truncate(path.c_str(), static_cast<off_t>(size)));
+}
+
+void Append(const std::string& path, gsl::span<const std::uint8_t> data)
+{
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> file{
+    std::fopen(path.c_str(), "ab"), &std::fclose};
+  CHECK(file);
+  CHECK(std::fwrite(data.data(), 1U, data.size(), file.get()) ==
+        data.size());
+}
+
+void TestSampleLog()
+{
+  constexpr std::uint32_t HOLE = TWO_GIB / samplelog::BLOCK_SIZE + 1U;
+  constexpr std::uint32_t BLOCKS = 3U;
+  constexpr std::uint64_t START_US = 1000000U;
+  const std::string path = "large_file_test.slb";
+  const auto index = path + samplelog::INDEX_SUFFIX;
+  // the zero entries of the hole end before every sample
+  Extend(path, std::uint64_t{HOLE} * samplelog::BLOCK_SIZE);
+  Extend(index, std::uint64_t{HOLE} * samplelog::INDEX_ENTRY_SIZE);
+
+  std::uint64_t timeUs = START_US;
+  std::uint64_t samples{};
+  std::array<std::uint8_t, samplelog::BLOCK_SIZE> block{};
+  for (std::uint32_t i{}; i < BLOCKS; ++i) {
+    samplelog::BlockBuilder builder{block, 1U};
+    while (builder.Add(samplelog::Sample{
+      timeUs, static_cast<std::int32_t>(timeUs % 1000U)})) {
+      timeUs += 1000U;
+      ++samples;
+    }
+    const auto entry = builder.Finish(HOLE + i);
+    std::array<std::uint8_t, samplelog::INDEX_ENTRY_SIZE> out{};
+    entry.Store(out.data());
+    Append(path, block);
+    Append(index, out);
+  }
+
+  samplelog::Reader reader{path};
+  CHECK(reader.GetBlockCount() == HOLE + BLOCKS);
+  std::uint64_t last{};
+  CHECK(reader.Query(START_US, timeUs, [&last](const auto& sample) {
+    last = sample.timestampUs;
+  }) == samples);
+  CHECK(last == timeUs - 1000U);
+  CHECK(reader.Summarize(START_US, timeUs).count == samples);
+  CHECK(!reader.GetErrors());
+  std::remove(path.c_str());
+  std::remove(index.c_str());
+}
+
+void TestJournal()
+{
+  constexpr std::uint64_t SIZE = TWO_GIB + 100U;
+  constexpr std::size_t RECORDS = 10U;
+  constexpr std::size_t PAYLOAD = 20U;
+  const std::string path = "large_file_test.jl";
+  // not a journal, kept as it is and appended to
+  Extend(path, SIZE);
+  {
+    Journal journal{path.c_str(), Journal::DEFAULT_CONFIG};
+    CHECK(journal.GetRecovery().size == SIZE);
+    const std::array<std::uint8_t, PAYLOAD> payload{};
+    for (std::size_t i{}; i < RECORDS; ++i)
+      CHECK(journal.Append(payload));
+    CHECK(!journal.Stop().drops);
+  }
+  constexpr auto END = SIZE + Journal::HEADER_SIZE + 12U +
+                       RECORDS * (Journal::HEADER_SIZE + PAYLOAD);
+  auto recovery = Journal::Recover(path.c_str());
+  CHECK(recovery.size == END && !recovery.dropped);
+  CHECK(recovery.nextSequence == RECORDS + 1U);
+  // the search back from the end stays at the end
+  CHECK(recovery.scanned < Journal::DEFAULT_CONFIG.checkpointInterval * 2U);
+
+  // a torn last record
+  CHECK(!truncate(path.c_str(), static_cast<off_t>(END - 5U)));
+  recovery = Journal::Recover(path.c_str());
+  CHECK(recovery.size == END - Journal::HEADER_SIZE - PAYLOAD);
+  CHECK(recovery.dropped == Journal::HEADER_SIZE + PAYLOAD - 5U);
+  std::remove(path.c_str());
+}
+} // namespace
+
+int main()
+{
+  TestSampleLog();
+  TestJournal();
+  std::puts("large_file_test: ok");
+  return 0;
+}
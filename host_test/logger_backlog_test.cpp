@@ -0,0 +1,88 @@
+#include "check.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <logger/logger.hpp>
+#include <mutex>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// A slow card keeps the blocks of the logger full while a producer floods
+// it, the writer still syncs at the sync interval instead of writing the
+// backlog first. Linked with -Wl,--wrap=fwrite.
+namespace {
+constexpr const char* PATH = "logger_backlog_test.log";
+constexpr auto WRITE_TIME = std::chrono::milliseconds{5};
+constexpr auto SYNC_INTERVAL = std::chrono::milliseconds{20};
+constexpr auto FLOOD = std::chrono::milliseconds{500};
+// a sync waits for the block being written and the sync itself
+constexpr auto MAX_SYNC_GAP = SYNC_INTERVAL + 4 * WRITE_TIME;
+using Clock = std::chrono::steady_clock;
+
+std::mutex g_mutex;
+std::vector<Clock::time_point> g_syncs;
+} // namespace
+
+extern "C" std::size_t __real_fwrite(const void* data, std::size_t size,
+                                     std::size_t count, std::FILE* file);
+
+extern "C" std::size_t __wrap_fwrite(const void* data, std::size_t size,
+                                     std::size_t count, std::FILE* file)
+{
+  std::this_thread::sleep_for(WRITE_TIME);
+  return __real_fwrite(data, size, count, file);
+}
+
+// the writer of the logger syncs through this one
+extern "C" int fsync(int fd)
+{
+  {
+    std::scoped_lock lock{g_mutex};
+    g_syncs.push_back(Clock::now());
+  }
+  return static_cast<int>(syscall(SYS_fsync, fd));
+}
+
+int main()
+{
+  std::remove(PATH);
+  Logger::Config config{4096U, 4U, SYNC_INTERVAL, 1, true, false};
+  Logger logger{PATH, config};
+  std::array<std::uint8_t, 64> record{};
+
+  const auto start = Clock::now();
+  const auto end = start + FLOOD;
+  while (Clock::now() < end)
+    logger.Append(record);
+  const auto stats = logger.Stop();
+
+  std::vector<Clock::time_point> syncs;
+  {
+    std::scoped_lock lock{g_mutex};
+    syncs = g_syncs;
+  }
+  // the queue was full all along
+  CHECK(stats.maxQueued == config.blocks && stats.drops > 0U);
+  CHECK(!stats.errors);
+  auto last = start;
+  auto maxGap = Clock::duration{};
+  for (const auto sync : syncs)
+    if (sync < end) {
+      maxGap = std::max(maxGap, sync - last);
+      last = sync;
+    }
+  maxGap = std::max(maxGap, end - last);
+  std::printf("%zu syncs, the longest gap %lld ms\n", syncs.size(),
+              static_cast<long long>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(maxGap)
+                  .count()));
+  CHECK(maxGap <= MAX_SYNC_GAP);
+  std::remove(PATH);
+  std::puts("logger_backlog_test passed");
+}
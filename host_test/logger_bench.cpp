@@ -0,0 +1,106 @@
+#include "check.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <logger/logger.hpp>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+// The throughput of a flooding producer, and the worst Append stall of a
+// paced producer while every 5th sync of the writer takes 300 ms, a slow SD
+// card. The floors are loose, the stall of the card must not reach the
+// producer.
+namespace {
+constexpr const char* PATH = "logger_bench.log";
+constexpr std::size_t RECORD_SIZE = 32U;
+constexpr double MIN_FLOOD_MB_PER_S = 10.;
+constexpr auto STALL = std::chrono::milliseconds{300};
+constexpr auto MAX_APPEND = std::chrono::milliseconds{20};
+// 200 KB/s of records
+constexpr auto PACE = std::chrono::microseconds{160};
+using Clock = std::chrono::steady_clock;
+
+std::atomic<bool> g_stalls{};
+std::atomic<int> g_syncs{};
+std::array<std::uint8_t, RECORD_SIZE> g_record{};
+} // namespace
+
+// the writer of the logger syncs through this one
+extern "C" int fsync(int fd)
+{
+  if (g_stalls && ++g_syncs % 5 == 0)
+    std::this_thread::sleep_for(STALL);
+  return static_cast<int>(syscall(SYS_fsync, fd));
+}
+
+namespace {
+void Flood()
+{
+  std::remove(PATH);
+  Logger logger{PATH, Logger::Config{Logger::CLUSTER_SIZE, 4U,
+                                     std::chrono::seconds{1}, 1, true, false}};
+  Clock::duration worst{};
+  const auto start = Clock::now();
+  while (Clock::now() - start < std::chrono::seconds{1}) {
+    const auto before = Clock::now();
+    static_cast<void>(logger.Append(g_record));
+    worst = std::max(worst, Clock::now() - before);
+  }
+  const auto stats = logger.Stop();
+  const auto seconds =
+    std::chrono::duration<double>(Clock::now() - start).count();
+  const auto rate = static_cast<double>(stats.bytes) / seconds / 1e6;
+  std::printf("flood: %.1f MB/s, %u drops, worst Append %lld ns\n", rate,
+              stats.drops,
+              static_cast<long long>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(worst)
+                  .count()));
+  CHECK(!stats.errors);
+  CHECK(rate >= MIN_FLOOD_MB_PER_S);
+}
+
+void Paced()
+{
+  std::remove(PATH);
+  g_stalls = true;
+  Logger logger{PATH, Logger::Config{Logger::CLUSTER_SIZE, 8U,
+                                     std::chrono::milliseconds{100}, 1, true,
+                                     false}};
+  Clock::duration worst{};
+  std::uint64_t records{};
+  const auto start = Clock::now();
+  while (Clock::now() - start < std::chrono::seconds{2}) {
+    const auto before = Clock::now();
+    static_cast<void>(logger.Append(g_record));
+    worst = std::max(worst, Clock::now() - before);
+    std::this_thread::sleep_until(start + PACE * ++records);
+  }
+  const auto stats = logger.Stop();
+  g_stalls = false;
+  std::printf("paced: %llu records, %u drops, slowest sync %lld ms, "
+              "worst Append %lld us\n",
+              static_cast<unsigned long long>(records), stats.drops,
+              static_cast<long long>(stats.maxWrite.count() / 1000),
+              static_cast<long long>(
+                std::chrono::duration_cast<std::chrono::microseconds>(worst)
+                  .count()));
+  CHECK(!stats.drops && !stats.errors);
+  CHECK(stats.bytes == records * RECORD_SIZE);
+  CHECK(stats.maxWrite >= STALL);
+  CHECK(worst <= MAX_APPEND);
+}
+} // namespace
+
+int main()
+{
+  for (std::size_t i{}; i < g_record.size(); ++i)
+    g_record[i] = static_cast<std::uint8_t>(i);
+  Flood();
+  Paced();
+  std::remove(PATH);
+  return 0;
+}
@@ -0,0 +1,110 @@
+#include "alloc-count.hpp"
+#include "check.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mqtt-helper/loopback.hpp>
+#include <string>
+
+// Publish and receive through the loopback broker, then dispatch DATA events
+// straight to the client among many filter handlers. The floors are loose,
+// they catch an order of magnitude, not noise.
+namespace {
+constexpr int ROUND_TRIPS = 200000;
+constexpr int DISPATCHES = 1000000;
+constexpr int FILTERS = 50;
+constexpr double MIN_ROUND_TRIPS_PER_S = 20000.;
+constexpr double MAX_DISPATCH_NS = 5000.;
+constexpr std::string_view PAYLOAD = "{\"g\":123.4}";
+using Clock = std::chrono::steady_clock;
+
+/// Hands the client to the benchmark to feed it DATA events
+class DirectTransport final : public mqtt::ITransport {
+public:
+  mqtt::ITransportHandler* handler{};
+
+  void Start(mqtt::ITransportHandler& h) override
+  {
+    handler = &h;
+    h.OnConnected(false);
+  }
+  int Subscribe(const char*, mqtt::QoS) override { return 1; }
+  int Unsubscribe(const char*) override { return 1; }
+  int Publish(const char*, std::string_view, mqtt::QoS, bool) override
+  {
+    return 1;
+  }
+  int Enqueue(const char*, std::string_view, mqtt::QoS, bool, bool) override
+  {
+    return 1;
+  }
+};
+
+void RoundTrip()
+{
+  mqtt::LoopbackBroker broker;
+  mqtt::Client client{std::make_unique<mqtt::LoopbackTransport>(broker)};
+  std::atomic<int> received{};
+  CHECK(client.AddFilterHandler("a/#", [&received](const auto&) {
+    received.fetch_add(1, std::memory_order_relaxed);
+  }));
+  client.Subscribe("a/#", mqtt::QoS::e0);
+  broker.WaitIdle();
+  const auto topic = client.InternTopic("a/t");
+  CHECK(topic);
+
+  double seconds{};
+  const auto allocations = alloc_count::Count([&] {
+    const auto start = Clock::now();
+    for (int i{}; i < ROUND_TRIPS; ++i)
+      client.Publish(*topic, PAYLOAD, mqtt::QoS::e0);
+    broker.WaitIdle();
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  });
+  CHECK(received == ROUND_TRIPS);
+  const auto rate = ROUND_TRIPS / seconds;
+  // the broker copies every message into its task queue
+  std::printf("loopback: %.0f messages/s, %.2f allocations/message "
+              "with the broker\n",
+              rate, static_cast<double>(allocations) / ROUND_TRIPS);
+  CHECK(rate >= MIN_ROUND_TRIPS_PER_S);
+}
+
+void Dispatch()
+{
+  auto owned = std::make_unique<DirectTransport>();
+  auto& transport = *owned;
+  mqtt::Client client{std::move(owned)};
+  int received{};
+  for (int i{}; i < FILTERS; ++i)
+    CHECK(client.AddFilterHandler("dev/" + std::to_string(i) + "/#",
+                                  [&received](const auto&) { ++received; }));
+  const mqtt::DataChunk chunk{"dev/7/weight", 0U, PAYLOAD, PAYLOAD.size()};
+  // the buffers of the message in flight grow once
+  transport.handler->OnData(chunk);
+
+  double ns{};
+  const auto allocations = alloc_count::Count([&] {
+    const auto start = Clock::now();
+    for (int i{}; i < DISPATCHES; ++i)
+      transport.handler->OnData(chunk);
+    const std::chrono::duration<double, std::nano> time =
+      Clock::now() - start;
+    ns = time.count() / DISPATCHES;
+  });
+  CHECK(received == DISPATCHES + 1);
+  std::printf("dispatch: %.0f ns/message, %.2f allocations/message\n", ns,
+              static_cast<double>(allocations) / DISPATCHES);
+  CHECK(!allocations);
+  CHECK(ns <= MAX_DISPATCH_NS);
+}
+} // namespace
+
+int main()
+{
+  RoundTrip();
+  Dispatch();
+  return 0;
+}
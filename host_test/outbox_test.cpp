@@ -0,0 +1,201 @@
+#include "check.hpp"
+
+#include <cstdio>
+#include <functional>
+#include <logic/logic.hpp>
+#include <memory>
+#include <message-queue/context.hpp>
+#include <message-queue/scheduler.hpp>
+#include <message-queue/virtual-clock.hpp>
+#include <mqtt-helper/outbox.hpp>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr const char* PATH = "outbox_test.bin";
+constexpr const char* CRASH_PATH = "outbox_test_crash.bin";
+
+/// Copy the file as a crash at this point would leave it on the card
+void CopyFile(const char* from, const char* to)
+{
+  auto* in = std::fopen(from, "rb");
+  auto* out = std::fopen(to, "wb");
+  CHECK(in && out);
+  char buffer[512];
+  for (std::size_t n; (n = std::fread(buffer, 1U, sizeof(buffer), in));)
+    CHECK(std::fwrite(buffer, 1U, n, out) == n);
+  std::fclose(in);
+  std::fclose(out);
+}
+
+/// Refuses the publishes while offline or for a number of attempts
+class FakeTransport final : public mqtt::ITransport {
+public:
+  bool online{};
+  int refusals{};
+  std::vector<std::string> payloads;
+  std::function<void()> onPublish;
+
+  void Start(mqtt::ITransportHandler& handler) override
+  {
+    handler.OnConnected(false);
+  }
+  int Subscribe(const char*, mqtt::QoS) override { return 1; }
+  int Unsubscribe(const char*) override { return 1; }
+  int Publish(const char*, std::string_view data, mqtt::QoS, bool) override
+  {
+    if (!online || refusals-- > 0)
+      return ERROR_ID;
+    payloads.emplace_back(data);
+    if (onPublish)
+      std::exchange(onPublish, nullptr)();
+    return 1;
+  }
+  int Enqueue(const char* topic, std::string_view data, mqtt::QoS qos,
+              bool retain, bool) override
+  {
+    return Publish(topic, data, qos, retain);
+  }
+};
+
+/// Answers every read with the number of the reads so far
+class FakeMeter final : public mq::ISystem {
+public:
+  explicit FakeMeter(mq::IContext& ctx) : m_ctx{ctx} {}
+
+  void Process(const mq::Message& msg) override
+  {
+    if (msg.to.sys != GetId() ||
+        msg.to.ev != utils::EnumValue(WeightMeter::Event::eReadCmd))
+      return;
+    m_ctx.Push(mq::Message{msg.to, msg.from,
+                           WeightMeter::Reading{static_cast<float>(m_reads++),
+                                                {},
+                                                WeightMeter::Quality::eStable}},
+               0);
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eWeightMeter;
+  }
+
+private:
+  mq::IContext& m_ctx;
+  int m_reads{};
+};
+
+/// A polling Logic publishing every reading through an outbox
+struct Setup {
+  mq::VirtualClock clock;
+  mq::Context ctx;
+  mq::Scheduler scheduler{clock};
+  FakeTransport* transport = new FakeTransport;
+  std::shared_ptr<mqtt::Outbox> outbox =
+    std::make_shared<mqtt::Outbox>(PATH, 1U << 16U);
+
+  Setup()
+  {
+    auto client = std::make_shared<mqtt::Client>(
+      std::unique_ptr<mqtt::ITransport>{transport});
+    ctx.AddSystem(std::make_shared<FakeMeter>(ctx));
+    ctx.AddSystem(std::make_shared<Logic>(
+      ctx, scheduler, client, Logic::Mode::ePoll,
+      std::vector<mq::Id>{mq::Id::eWeightMeter},
+      Logic::Polling{std::chrono::milliseconds{500},
+                     std::chrono::milliseconds{500}, 5.f}));
+    Logic::Telemetry telemetry{"w", 1U, std::chrono::seconds{1},
+                               mqtt::QoS::e1};
+    telemetry.outbox = outbox;
+    ctx.Push(mq::Message{
+               mq::NONE,
+               mq::Addr{mq::Id::eLogic,
+                        utils::EnumValue(Logic::Event::eConfigureTelemetry)},
+               telemetry},
+             0);
+  }
+};
+
+void TestPopRestore()
+{
+  std::remove(PATH);
+  {
+    mqtt::Outbox outbox{PATH, 256U};
+    for (const auto* payload : {"0", "1", "2"})
+      CHECK(outbox.Push("t", payload, mqtt::QoS::e1));
+    CHECK(outbox.Pop()->payload == "0" && outbox.Restore());
+    CHECK(!outbox.Restore() && outbox.Pop()->payload == "0");
+  }
+  // the pop is durable
+  mqtt::Outbox outbox{PATH, 256U};
+  CHECK(outbox.Pop()->payload == "1" && outbox.Restore());
+  // a full ring overwrites the popped message, it can't return
+  CHECK(outbox.Pop()->payload == "1");
+  CHECK(outbox.Push("t", std::string(230U, 'x'), mqtt::QoS::e1));
+  CHECK(!outbox.Restore() && outbox.Pop()->payload == "2");
+  CHECK(outbox.Pop()->payload.size() == 230U && outbox.IsEmpty());
+  std::remove(PATH);
+}
+
+/// A stored message refused by the client stays in the outbox
+void TestDrainRetry()
+{
+  std::remove(PATH);
+  Setup setup;
+  auto& [clock, ctx, scheduler, transport, outbox] = setup;
+
+  mq::Simulate(ctx, scheduler, clock, std::chrono::seconds{5});
+  CHECK(transport->payloads.empty() && !outbox->IsEmpty());
+  // the client takes every other attempt
+  transport->online = true;
+  for (int i{}; i < 20; ++i) {
+    transport->refusals = 1;
+    mq::Simulate(ctx, scheduler, clock, std::chrono::milliseconds{200});
+  }
+  transport->refusals = 0;
+  mq::Simulate(ctx, scheduler, clock, std::chrono::seconds{2});
+  CHECK(outbox->IsEmpty());
+
+  // every reading once and in order
+  int last = -1;
+  for (const auto& payload : transport->payloads) {
+    int grams{};
+    CHECK(std::sscanf(payload.c_str(), "{\"t\":%*d,\"w\":[[0,0,%d", &grams) ==
+          1);
+    CHECK(grams == last + 1);
+    last = grams;
+  }
+  CHECK(last >= 10);
+  std::remove(PATH);
+}
+
+/// A reboot between the publish of a stored message and the next commit
+/// doesn't send the message again
+void TestCrashAfterPublish()
+{
+  std::remove(PATH);
+  std::remove(CRASH_PATH);
+  Setup setup;
+  auto& [clock, ctx, scheduler, transport, outbox] = setup;
+
+  mq::Simulate(ctx, scheduler, clock, std::chrono::seconds{5});
+  CHECK(transport->payloads.empty() && !outbox->IsEmpty());
+  transport->online = true;
+  transport->onPublish = [] { CopyFile(PATH, CRASH_PATH); };
+  mq::Simulate(ctx, scheduler, clock, std::chrono::seconds{5});
+  CHECK(outbox->IsEmpty() && transport->payloads.size() >= 2U);
+
+  mqtt::Outbox rebooted{CRASH_PATH, 1U << 16U};
+  const auto next = rebooted.Pop();
+  CHECK(next && next->payload == transport->payloads[1]);
+  std::remove(PATH);
+  std::remove(CRASH_PATH);
+}
+} // namespace
+
+int main()
+{
+  TestPopRestore();
+  TestDrainRetry();
+  TestCrashAfterPublish();
+  std::puts("outbox_test passed");
+}
@@ -0,0 +1,120 @@
+#include "check.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <logic/logic.hpp>
+#include <memory>
+#include <message-queue/context.hpp>
+#include <message-queue/scheduler.hpp>
+#include <message-queue/virtual-clock.hpp>
+#include <vector>
+
+// The adaptive polling of Logic in the virtual time against a scripted
+// load: the read rate of an idle scale and the latency of a load change
+namespace {
+using namespace std::chrono_literals;
+using Duration = mq::IClock::duration;
+
+/// Answers the reads with the scripted weight at the virtual time
+class ScriptedMeter final : public mq::ISystem {
+public:
+  using Script = std::function<float(Duration)>;
+
+  ScriptedMeter(mq::IContext& ctx, const mq::IClock& clock, Script script)
+    : m_ctx{ctx}, m_clock{clock}, m_script{std::move(script)}
+  {
+  }
+
+  std::vector<Duration> reads;
+
+  void Process(const mq::Message& msg) override
+  {
+    if (msg.to.sys != GetId() ||
+        msg.to.ev != utils::EnumValue(WeightMeter::Event::eReadCmd))
+      return;
+    const auto now = m_clock.Now().time_since_epoch();
+    reads.push_back(now);
+    m_ctx.Push(mq::Message{msg.to, msg.from,
+                           WeightMeter::Reading{m_script(now),
+                                                {},
+                                                WeightMeter::Quality::eStable}},
+               0);
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eWeightMeter;
+  }
+
+private:
+  mq::IContext& m_ctx;
+  const mq::IClock& m_clock;
+  Script m_script;
+};
+
+std::size_t CountBetween(const std::vector<Duration>& reads, Duration from,
+                         Duration to)
+{
+  return static_cast<std::size_t>(
+    std::count_if(reads.cbegin(), reads.cend(),
+                  [&](Duration t) { return t >= from && t < to; }));
+}
+
+long long Ms(Duration duration)
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(duration)
+    .count();
+}
+} // namespace
+
+int main()
+{
+  constexpr Logic::Polling POLLING{250ms, 1min, 5.f};
+  constexpr Duration LOADED{2h};
+  constexpr Duration UNLOADED{2h + 1min};
+  mq::VirtualClock clock;
+  mq::Context ctx;
+  mq::Scheduler scheduler{clock};
+  // idle for 2 h, a 1 min load moving by 100 g/s, idle again
+  auto meter = std::make_shared<ScriptedMeter>(ctx, clock, [&](Duration t) {
+    if (t < LOADED || t >= UNLOADED)
+      return 0.f;
+    return 500.f + 0.1f * static_cast<float>(Ms(t - LOADED));
+  });
+  ctx.AddSystem(meter);
+  ctx.AddSystem(std::make_shared<Logic>(
+    ctx, scheduler, nullptr, Logic::Mode::ePoll,
+    std::vector<mq::Id>{mq::Id::eWeightMeter}, POLLING));
+  mq::Simulate(ctx, scheduler, clock, 3h);
+  const auto& reads = meter->reads;
+
+  // the idle interval backs off from the shortest to the longest one by
+  // doubling, then stays there
+  CHECK(reads.size() > 10U);
+  Duration interval = POLLING.minInterval * 2;
+  for (std::size_t i = 1U; reads[i] < 1h; ++i) {
+    CHECK(reads[i] - reads[i - 1U] == interval);
+    interval = std::min<Duration>(interval * 2, POLLING.maxInterval);
+  }
+  const auto idle = CountBetween(reads, 1h, 2h);
+  CHECK(idle == 60U);
+
+  // the load is seen within the longest interval, then it is read at the
+  // shortest one while it moves
+  const auto first = std::find_if(reads.cbegin(), reads.cend(),
+                                  [&](Duration t) { return t >= LOADED; });
+  CHECK(first != reads.cend() && *first - LOADED <= POLLING.maxInterval);
+  const auto active = CountBetween(reads, *first + 1s, UNLOADED);
+  CHECK(active >= static_cast<std::size_t>((UNLOADED - *first - 1s) /
+                                           POLLING.minInterval) -
+                     1U);
+  // and backs off again once the load is gone
+  CHECK(CountBetween(reads, 2h + 30min, 3h) == 30U);
+
+  std::printf("reads per hour: %zu idle, %zu at a fixed 5 s\n", idle,
+              static_cast<std::size_t>(1h / 5s));
+  std::printf("load seen after %lld ms, then %zu reads in %lld ms\n",
+              Ms(*first - LOADED), active, Ms(UNLOADED - *first - 1s));
+  std::puts("polling_test passed");
+}
@@ -0,0 +1,137 @@
+#include "alloc-count.hpp"
+#include "check.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <logic/logic.hpp>
+#include <memory>
+#include <message-queue/context.hpp>
+#include <message-queue/scheduler.hpp>
+#include <message-queue/virtual-clock.hpp>
+#include <random>
+#include <utils/text-writer.hpp>
+
+// A telemetry publish, from the batch to the transport, allocates nothing
+namespace {
+
+/// Takes every publish without allocating
+class NullTransport final : public mqtt::ITransport {
+public:
+  std::size_t publishes{};
+  std::size_t bytes{};
+
+  void Start(mqtt::ITransportHandler& handler) override
+  {
+    handler.OnConnected(false);
+  }
+  int Subscribe(const char*, mqtt::QoS) override { return 1; }
+  int Unsubscribe(const char*) override { return 1; }
+  int Publish(const char*, std::string_view data, mqtt::QoS, bool) override
+  {
+    ++publishes;
+    bytes += data.size();
+    return 1;
+  }
+  int Enqueue(const char* topic, std::string_view data, mqtt::QoS qos,
+              bool retain, bool) override
+  {
+    return Publish(topic, data, qos, retain);
+  }
+};
+
+/// The fixed point formatting matches printf
+void TestFixed()
+{
+  std::mt19937 random{3U};
+  std::uniform_real_distribution<float> grams{-5000.f, 5000.f};
+  std::array<char, 64> buffer{};
+  std::array<char, 64> expected{};
+  for (int i{}; i < 100000; ++i) {
+    auto value = grams(random);
+    if (!(i % 3))
+      value = std::round(value * 100.f) / 100.f; // the ties
+    utils::TextWriter text{buffer};
+    text.AppendFixed(value, 1U);
+    std::snprintf(expected.data(), expected.size(), "%.1f",
+                  static_cast<double>(value));
+    CHECK(text.View() == expected.data());
+  }
+  // the decimal ties which are inexact in binary, e.g. 0.15 is 0.1499...
+  for (unsigned decimals{}; decimals <= 6U; ++decimals)
+    for (int i{-20000}; i <= 20000; ++i) {
+      const auto value = (i + 0.5) / std::pow(10., decimals + 1U);
+      utils::TextWriter text{buffer};
+      text.AppendFixed(value, decimals);
+      std::snprintf(expected.data(), expected.size(), "%.*f",
+                    static_cast<int>(decimals), value);
+      CHECK(text.View() == expected.data());
+    }
+  utils::TextWriter text{buffer};
+  text.AppendFixed(0.15, 1U).Append(' ').AppendFixed(-0.04, 1U);
+  CHECK(text.View() == "0.1 -0.0");
+}
+
+void TestLogic(Logic::Telemetry::Format format)
+{
+  constexpr std::size_t READINGS = 20U;
+  mq::VirtualClock clock;
+  mq::Context ctx;
+  mq::Scheduler scheduler{clock};
+  auto* transport = new NullTransport;
+  auto client = std::make_shared<mqtt::Client>(
+    std::unique_ptr<mqtt::ITransport>{transport});
+  // no meter: the readings are pushed below
+  ctx.AddSystem(std::make_shared<Logic>(
+    ctx, scheduler, client, Logic::Mode::eSubscribe,
+    std::vector<mq::Id>{mq::Id::eWeightMeter,
+                        mq::MakeId(mq::Id::eWeightMeter, 1)}));
+  Logic::Telemetry telemetry{"scale/w/telemetry", READINGS,
+                             std::chrono::hours{1}, mqtt::QoS::e1, format};
+  ctx.Push(mq::Message{
+             mq::NONE,
+             mq::Addr{mq::Id::eLogic,
+                      utils::EnumValue(Logic::Event::eConfigureTelemetry)},
+             telemetry},
+           0);
+  while (ctx.ProcessOneMessage()) {
+  }
+
+  std::size_t allocations{};
+  for (int batch{}; batch < 10; ++batch) {
+    for (std::size_t i{}; i < READINGS; ++i)
+      ctx.Push(
+        mq::Message{
+          mq::Addr{mq::MakeId(mq::Id::eWeightMeter, i % 2U),
+                   utils::EnumValue(WeightMeter::Event::eSubscribe)},
+          mq::Addr{mq::Id::eLogic, utils::EnumValue(Logic::Event::eGotWeight)},
+          WeightMeter::Reading{static_cast<float>(batch * 100 + i) / 10.f,
+                               {},
+                               WeightMeter::Quality::eStable}},
+        0);
+    // the last reading fills the batch and publishes it. The first one
+    // schedules the flush of the window, a node of the scheduler, and the
+    // first batch warms up the queue.
+    for (std::size_t i{}; i < READINGS; ++i) {
+      const auto count =
+        alloc_count::Count([&ctx] { CHECK(ctx.ProcessOneMessage()); });
+      if (batch && i)
+        allocations += count;
+    }
+    clock.Advance(std::chrono::milliseconds{100});
+  }
+  std::printf("%s: %zu publishes, %zu bytes, %zu allocations\n",
+              format == Logic::Telemetry::Format::eJson ? "json" : "binary",
+              transport->publishes, transport->bytes, allocations);
+  CHECK(transport->publishes ==
+        (format == Logic::Telemetry::Format::eJson ? 10U : 20U));
+  CHECK(!allocations);
+}
+} // namespace
+
+int main()
+{
+  TestFixed();
+  TestLogic(Logic::Telemetry::Format::eJson);
+  TestLogic(Logic::Telemetry::Format::eBinary);
+  std::puts("publish_alloc_test passed");
+}
@@ -0,0 +1,98 @@
+#include "alloc-count.hpp"
+#include "check.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mqtt-helper/mqtt-helper.hpp>
+#include <string>
+#include <utils/text-writer.hpp>
+
+// Format and publish a one-reading JSON batch: into a stack buffer to an
+// interned topic, against a string built with snprintf to a string topic
+namespace {
+constexpr int PUBLISHES = 200000;
+constexpr const char* TOPIC = "scale/w/telemetry";
+using Clock = std::chrono::steady_clock;
+
+class NullTransport final : public mqtt::ITransport {
+public:
+  std::size_t bytes{};
+
+  void Start(mqtt::ITransportHandler& handler) override
+  {
+    handler.OnConnected(false);
+  }
+  int Subscribe(const char*, mqtt::QoS) override { return 1; }
+  int Unsubscribe(const char*) override { return 1; }
+  int Publish(const char*, std::string_view data, mqtt::QoS, bool) override
+  {
+    bytes += data.size();
+    return 1;
+  }
+  int Enqueue(const char* topic, std::string_view data, mqtt::QoS qos,
+              bool retain, bool) override
+  {
+    return Publish(topic, data, qos, retain);
+  }
+};
+
+struct Result {
+  double ns;
+  double allocations;
+};
+
+template<typename Publish>
+Result Measure(Publish&& publish)
+{
+  Result result{};
+  const auto allocations = alloc_count::Count([&publish, &result] {
+    const auto start = Clock::now();
+    for (int i{}; i < PUBLISHES; ++i)
+      publish(i);
+    const std::chrono::duration<double, std::nano> time = Clock::now() - start;
+    result.ns = time.count() / PUBLISHES;
+  });
+  result.allocations = static_cast<double>(allocations) / PUBLISHES;
+  return result;
+}
+} // namespace
+
+int main()
+{
+  mqtt::Client client{std::make_unique<NullTransport>()};
+  const auto topic = client.InternTopic(TOPIC);
+  CHECK(topic);
+
+  std::array<char, 256> buffer{};
+  const auto writer = Measure([&](int i) {
+    utils::TextWriter text{buffer};
+    utils::JsonWriter json{text};
+    json.BeginObject().Key("t").Value(i).Key("w").BeginArray();
+    json.BeginArray().Value(0).Value(std::uint8_t{1});
+    json.Fixed(static_cast<float>(i % 5000) / 10.f, 1U).EndArray();
+    json.EndArray().EndObject();
+    CHECK(client.PublishAsync(*topic, text.View(), mqtt::QoS::e1) !=
+          mqtt::Client::ERROR_ID);
+  });
+
+  const std::string topicString{TOPIC};
+  const auto printed = Measure([&](int i) {
+    std::string payload;
+    std::array<char, 48> field{};
+    std::snprintf(field.data(), field.size(), "{\"t\":%d,\"w\":[", i);
+    payload += field.data();
+    std::snprintf(field.data(), field.size(), "[%d,%u,%.1f]]}", 0, 1U,
+                  static_cast<double>(static_cast<float>(i % 5000) / 10.f));
+    payload += field.data();
+    CHECK(client.PublishAsync(std::string{topicString}, payload,
+                              mqtt::QoS::e1) != mqtt::Client::ERROR_ID);
+  });
+
+  std::printf("publish: writer %.0f ns %.2f allocations, "
+              "snprintf %.0f ns %.2f allocations\n",
+              writer.ns, writer.allocations, printed.ns,
+              printed.allocations);
+  CHECK(!writer.allocations);
+}
@@ -0,0 +1,123 @@
+#include "check.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sample-log/mapped-reader.hpp>
+#include <sample-log/reader.hpp>
+#include <sample-log/writer.hpp>
+#include <string>
+
+// A 5 minute range query of a 1 GB log of 1 kHz samples, with the index
+// and through a linear scan of every block. The size in MB is the optional
+// argument. The blocks are raw columns, so the size is known up front.
+namespace {
+constexpr const char* PATH = "query_bench.slb";
+constexpr std::uint64_t DEFAULT_MB = 1024U;
+constexpr std::uint64_t PERIOD_US = 1000U;
+constexpr std::uint64_t START_US = 1000000U;
+constexpr std::uint64_t RANGE_US = 300000000U;
+// the index must win by far more than that
+constexpr double MIN_SPEEDUP = 10.;
+using Clock = std::chrono::steady_clock;
+
+double Ms(Clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+    .count();
+}
+
+struct Result {
+  std::uint64_t samples;
+  std::int64_t sum;
+};
+
+template<typename Reader>
+Result Query(Reader& reader, std::uint64_t fromUs, std::uint64_t toUs)
+{
+  Result result{};
+  result.samples = reader.Query(fromUs, toUs, [&result](const auto& sample) {
+    result.sum += sample.value;
+  });
+  return result;
+}
+
+/// Every block is read and decoded, the index is not used
+Result Scan(std::uint64_t fromUs, std::uint64_t toUs)
+{
+  Result result{};
+  samplelog::FileSource source{PATH};
+  for (std::uint32_t i{}; i < source.GetBlockCount(); ++i) {
+    const auto block = source.ReadBlock(i);
+    const auto header = samplelog::ReadHeader(block, i);
+    if (!header)
+      continue;
+    samplelog::BlockDecoder decoder{block, *header};
+    for (samplelog::Sample sample{}; decoder.Next(sample);)
+      if (sample.timestampUs >= fromUs && sample.timestampUs <= toUs) {
+        result.sum += sample.value;
+        ++result.samples;
+      }
+  }
+  return result;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  const std::uint64_t mb =
+    argc > 1 ? std::strtoull(argv[1], nullptr, 10) : DEFAULT_MB;
+  const auto count = mb * 1024U * 1024U / 8U;
+  std::remove(PATH);
+  std::remove((std::string{PATH} + samplelog::INDEX_SUFFIX).c_str());
+  {
+    auto config = Logger::DEFAULT_CONFIG;
+    config.blocks = 64U;
+    samplelog::Writer writer{PATH, 1U, config,
+                             samplelog::Writer::Compression{false, {}}};
+    const auto start = Clock::now();
+    for (std::uint64_t i{}; i < count; ++i)
+      static_cast<void>(writer.Add(samplelog::Sample{
+        START_US + i * PERIOD_US,
+        static_cast<std::int32_t>(i * 7919U % 100000U) - 50000}));
+    const auto stats = writer.Stop();
+    std::printf("write: %llu MB in %.0f ms, %u dropped blocks\n",
+                static_cast<unsigned long long>(stats.bytes >> 20U),
+                Ms(start), stats.drops);
+  }
+
+  const auto fromUs = START_US + count / 2U * PERIOD_US;
+  const auto toUs = fromUs + RANGE_US;
+  auto start = Clock::now();
+  const auto linear = Scan(fromUs, toUs);
+  const auto linearMs = Ms(start);
+
+  samplelog::Reader reader{PATH};
+  start = Clock::now();
+  const auto indexed = Query(reader, fromUs, toUs);
+  const auto indexedMs = Ms(start);
+
+  samplelog::MappedReader mapped{PATH};
+  start = Clock::now();
+  const auto inPlace = Query(mapped, fromUs, toUs);
+  const auto mappedMs = Ms(start);
+  start = Clock::now();
+  const auto summary = mapped.Summarize(fromUs, toUs);
+  const auto summaryMs = Ms(start);
+
+  std::printf("%u blocks, %llu samples in the range\n",
+              reader.GetBlockCount(),
+              static_cast<unsigned long long>(linear.samples));
+  std::printf("query: %.2f ms, mapped %.2f ms, summary %.3f ms, "
+              "linear scan %.0f ms\n",
+              indexedMs, mappedMs, summaryMs, linearMs);
+  CHECK(linear.samples);
+  CHECK(indexed.samples == linear.samples && indexed.sum == linear.sum);
+  CHECK(inPlace.samples == linear.samples && inPlace.sum == linear.sum);
+  CHECK(summary.count == linear.samples);
+  CHECK(indexedMs * MIN_SPEEDUP < linearMs);
+  std::remove(PATH);
+  std::remove((std::string{PATH} + samplelog::INDEX_SUFFIX).c_str());
+  return 0;
+}
@@ -0,0 +1,196 @@
+#include "check.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <message-queue/context.hpp>
+#include <message-queue/recorder.hpp>
+#include <message-queue/replayer.hpp>
+#include <message-queue/virtual-clock.hpp>
+#include <vector>
+
+namespace {
+using namespace std::chrono_literals;
+constexpr const char* PATH = "replay_test.bin";
+constexpr mq::Addr ECHO{mq::Id::eLogic, 0};
+constexpr mq::Addr REPLY{mq::Id::eWeightMeter, 1};
+constexpr mq::Addr OTHER{mq::Id::eWeightMeter, 2};
+
+/// Replies to every message with its value plus one, at the priority of the
+/// requests so that a replay of the replies keeps the order
+class Echo final : public mq::ISystem {
+public:
+  explicit Echo(mq::IContext& ctx) : m_ctx{ctx} {}
+
+  void Process(const mq::Message& msg) override
+  {
+    if (msg.to == ECHO)
+      m_ctx.Push(mq::Message{ECHO, REPLY, *std::any_cast<int>(&msg.data) + 1},
+                 1);
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override { return ECHO.sys; }
+
+private:
+  mq::IContext& m_ctx;
+};
+
+struct Seen {
+  mq::Addr to;
+  int value;
+  std::chrono::milliseconds at;
+};
+
+/// Notes every dispatched message with its time since the start
+class Observer final : public mq::ISystem {
+public:
+  Observer(const mq::IClock& clock, std::vector<Seen>& seen)
+    : m_clock{clock}, m_start{clock.Now()}, m_seen{seen}
+  {
+  }
+
+  void Process(const mq::Message& msg) override
+  {
+    const auto* value = std::any_cast<int>(&msg.data);
+    m_seen.push_back(Seen{
+      msg.to, value ? *value : -1,
+      std::chrono::duration_cast<std::chrono::milliseconds>(m_clock.Now() -
+                                                             m_start)});
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override { return mq::Id::eNone; }
+
+private:
+  const mq::IClock& m_clock;
+  const mq::IClock::time_point m_start;
+  std::vector<Seen>& m_seen;
+};
+
+void Drain(mq::IContext& ctx)
+{
+  while (ctx.ProcessOneMessage()) {}
+}
+
+/// Two requests to the echo 10 ms apart, a message to another system 1 s
+/// later
+std::vector<Seen> Record(const mq::PayloadCodec& codec)
+{
+  mq::VirtualClock clock;
+  mq::Context ctx;
+  std::vector<Seen> seen;
+  mq::Recorder recorder{ctx, codec, PATH, clock};
+  recorder.AddSystem(std::make_shared<Echo>(recorder));
+  recorder.AddSystem(std::make_shared<Observer>(clock, seen));
+
+  recorder.Push(mq::Message{mq::NONE, ECHO, 5}, 1);
+  Drain(recorder);
+  clock.Advance(10ms);
+  recorder.Push(mq::Message{mq::NONE, ECHO, 7}, 1);
+  Drain(recorder);
+  clock.Advance(1s);
+  recorder.Push(mq::Message{mq::NONE, OTHER, 9}, 1);
+  Drain(recorder);
+  return seen;
+}
+
+void CheckSame(const std::vector<Seen>& a, const std::vector<Seen>& b)
+{
+  CHECK(a.size() == b.size());
+  for (std::size_t i{}; i < a.size(); ++i) {
+    CHECK(a[i].to == b[i].to);
+    CHECK(a[i].value == b[i].value);
+    CHECK(a[i].at == b[i].at);
+  }
+}
+
+/// Replays on a virtual clock into a fresh context
+std::size_t Replay(const mq::PayloadCodec& codec, mq::Replayer::Filter filter,
+                   bool echo, mq::Replayer::Speed speed,
+                   std::vector<Seen>& seen)
+{
+  mq::VirtualClock clock;
+  mq::Context ctx;
+  if (echo)
+    ctx.AddSystem(std::make_shared<Echo>(ctx));
+  ctx.AddSystem(std::make_shared<Observer>(clock, seen));
+  mq::LogReader reader{PATH};
+  mq::Replayer replayer{ctx, codec, std::move(filter), clock};
+  return replayer.Run(reader, speed);
+}
+
+void TestDefaultFilter(const mq::PayloadCodec& codec,
+                       const std::vector<Seen>& recorded)
+{
+  // every push is replayed, the replies too, so no echo under replay
+  std::vector<Seen> seen;
+  CHECK(Replay(codec, nullptr, false, mq::Replayer::Speed::eRealTime, seen) ==
+        5U);
+  CheckSame(recorded, seen);
+}
+
+void TestExternalInputs(const mq::PayloadCodec& codec,
+                        const std::vector<Seen>& recorded)
+{
+  // the echo under replay generates the replies itself
+  std::vector<Seen> seen;
+  CHECK(Replay(
+          codec,
+          [](const mq::Record& record) {
+            return record.kind == mq::Record::Kind::ePush &&
+                   record.from.sys == mq::Id::eNone;
+          },
+          true, mq::Replayer::Speed::eRealTime, seen) == 3U);
+  CheckSame(recorded, seen);
+
+  seen.clear();
+  CHECK(Replay(
+          codec,
+          [](const mq::Record& record) {
+            return record.kind == mq::Record::Kind::ePush &&
+                   record.from.sys == mq::Id::eNone;
+          },
+          true, mq::Replayer::Speed::eAsFastAsPossible, seen) == 3U);
+  CHECK(seen.size() == recorded.size());
+  for (const auto& s : seen)
+    CHECK(s.at == 0ms);
+}
+
+void TestDispatchRecords(const mq::PayloadCodec& codec,
+                         const std::vector<Seen>& recorded)
+{
+  // a filter sees the records of every kind, the dispatched messages are
+  // pushed again
+  std::vector<Seen> seen;
+  CHECK(Replay(
+          codec,
+          [](const mq::Record& record) {
+            return record.kind == mq::Record::Kind::eDispatch;
+          },
+          false, mq::Replayer::Speed::eRealTime, seen) == 5U);
+  CheckSame(recorded, seen);
+
+  // nothing is accepted
+  seen.clear();
+  CHECK(Replay(
+          codec, [](const mq::Record&) { return false; }, false,
+          mq::Replayer::Speed::eRealTime, seen) == 0U);
+  CHECK(seen.empty());
+}
+} // namespace
+
+int main()
+{
+  mq::PayloadCodec codec;
+  codec.Add<int>(1U);
+
+  const auto recorded = Record(codec);
+  CHECK(recorded.size() == 5U);
+  CHECK(recorded[1].value == 6 && recorded[1].at == 0ms);
+  CHECK(recorded[3].value == 8 && recorded[3].at == 10ms);
+  CHECK(recorded[4].to == OTHER && recorded[4].at == 1010ms);
+
+  TestDefaultFilter(codec, recorded);
+  TestExternalInputs(codec, recorded);
+  TestDispatchRecords(codec, recorded);
+
+  std::remove(PATH);
+  std::puts("replay_test passed");
+}
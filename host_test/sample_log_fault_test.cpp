@@ -0,0 +1,182 @@
+#include "check.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <sample-log/reader.hpp>
+#include <sample-log/writer.hpp>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// Power losses injected into a sample log: the writes of the loggers failing
+// from every one on, the first failing one torn, and the files followed by
+// nothing, or zeros or random bytes up to a whole block or entry and one
+// more. The recovered log is continued by a new writer and read back whole.
+// Linked with -Wl,--wrap=fwrite.
+namespace {
+constexpr const char* PATH = "sample_log_fault_test.slg";
+constexpr std::uint32_t FIRST_SAMPLES = 5U * samplelog::BLOCK_CAPACITY + 1000U;
+constexpr std::uint32_t NEXT_SAMPLES = 3000U;
+constexpr std::uint64_t PERIOD_US = 1000U;
+
+// the writes from the limit on fail, the one at it is torn
+long g_writes{};
+long g_limit = -1;
+} // namespace
+
+extern "C" std::size_t __real_fwrite(const void* data, std::size_t size,
+                                     std::size_t count, std::FILE* file);
+
+extern "C" std::size_t __wrap_fwrite(const void* data, std::size_t size,
+                                     std::size_t count, std::FILE* file)
+{
+  if (g_limit < 0)
+    return __real_fwrite(data, size, count, file);
+  const auto write = g_writes++;
+  if (write < g_limit)
+    return __real_fwrite(data, size, count, file);
+  if (write == g_limit && size * count > 1U)
+    return __real_fwrite(data, 1U, size * count / 2U, file) / size;
+  return 0U;
+}
+
+namespace {
+const std::string INDEX_PATH = std::string{PATH} + samplelog::INDEX_SUFFIX;
+
+std::uint64_t Size(const std::string& path)
+{
+  struct stat info {};
+  return stat(path.c_str(), &info) ? 0U
+                                   : static_cast<std::uint64_t>(info.st_size);
+}
+
+/// Fill the file up to a whole unit and append another one, as FAT may
+/// leave a cluster allocated before its data is written
+void AppendTail(const std::string& path, std::size_t unit, int tail,
+                std::mt19937& rng)
+{
+  const auto size = (unit - Size(path) % unit) % unit + unit;
+  auto* file = std::fopen(path.c_str(), "ab");
+  CHECK(file);
+  for (std::size_t i{}; tail && i < size; ++i)
+    std::fputc(tail == 1 ? 0 : static_cast<int>(rng() & 0xFFU), file);
+  std::fclose(file);
+}
+
+/// Samples from the one at the start on
+void Write(std::uint32_t start, std::uint32_t count)
+{
+  auto config = Logger::DEFAULT_CONFIG;
+  config.blocks = 64U;
+  samplelog::Writer writer{PATH, 0U, config,
+                           samplelog::Writer::Compression{false, {}}};
+  for (auto i = start; i < start + count; ++i)
+    CHECK(writer.Add(samplelog::Sample{i * PERIOD_US,
+                                       static_cast<std::int32_t>(i)}));
+}
+
+/// Read the whole log back: the index matches the blocks, the samples of the
+/// first writer up to some one, then all the samples of the next one
+void CheckLog(std::uint32_t blocks)
+{
+  samplelog::FileSource source{PATH};
+  CHECK(source.GetIndexCount() == blocks);
+  for (std::uint32_t i{}; i < blocks; ++i) {
+    std::array<std::uint8_t, samplelog::INDEX_ENTRY_SIZE> stored{};
+    std::array<std::uint8_t, samplelog::INDEX_ENTRY_SIZE> expected{};
+    source.ReadIndex(i).Store(stored.data());
+    const auto header = samplelog::ReadHeader(source.ReadBlock(i), i);
+    CHECK(header);
+    header->Store(expected.data());
+    CHECK(stored == expected);
+  }
+
+  samplelog::Reader reader{PATH};
+  CHECK(reader.GetBlockCount() == blocks);
+  std::vector<std::uint32_t> values;
+  reader.Query(0U, UINT64_MAX, [&values](const samplelog::Sample& sample) {
+    CHECK(sample.timestampUs ==
+          static_cast<std::uint64_t>(sample.value) * PERIOD_US);
+    values.push_back(static_cast<std::uint32_t>(sample.value));
+  });
+  CHECK(!reader.GetErrors());
+  CHECK(values.size() >= NEXT_SAMPLES);
+  const auto first = values.size() - NEXT_SAMPLES;
+  for (std::size_t i{}; i < values.size(); ++i)
+    CHECK(values[i] == (i < first ? i : FIRST_SAMPLES + (i - first)));
+}
+
+void TestWriteFaults()
+{
+  std::mt19937 rng{1U};
+  long limit{};
+  for (;; ++limit)
+    for (int tail{}; tail < 3; ++tail) {
+      std::remove(PATH);
+      std::remove(INDEX_PATH.c_str());
+      g_writes = 0;
+      g_limit = limit;
+      Write(0U, FIRST_SAMPLES);
+      const auto writes = g_writes;
+      g_limit = -1;
+      AppendTail(PATH, samplelog::BLOCK_SIZE, tail, rng);
+      AppendTail(INDEX_PATH, samplelog::INDEX_ENTRY_SIZE, tail, rng);
+
+      const auto recovery = samplelog::Writer::Recover(PATH);
+      CHECK(recovery.entries == recovery.blocks);
+      CHECK(Size(PATH) == recovery.blocks * samplelog::BLOCK_SIZE);
+      CHECK(Size(INDEX_PATH) ==
+            recovery.entries * samplelog::INDEX_ENTRY_SIZE);
+      // the next writer continues the recovered log
+      Write(FIRST_SAMPLES, NEXT_SAMPLES);
+      CHECK(Size(INDEX_PATH) ==
+            (recovery.blocks + 2U) * samplelog::INDEX_ENTRY_SIZE);
+      CheckLog(recovery.blocks + 2U);
+      const auto again = samplelog::Writer::Recover(PATH);
+      CHECK(again.blocks == recovery.blocks + 2U &&
+            again.entries == again.blocks);
+      if (tail == 2 && limit >= writes) {
+        std::printf("write faults: %ld writes\n", limit);
+        return;
+      }
+    }
+}
+
+/// A bad block within the log stays for the readers to skip, the index
+/// stops before it
+void TestBadBlock()
+{
+  std::remove(PATH);
+  std::remove(INDEX_PATH.c_str());
+  Write(0U, FIRST_SAMPLES);
+  auto* file = std::fopen(PATH, "r+b");
+  CHECK(file);
+  CHECK(!std::fseek(file, static_cast<long>(samplelog::BLOCK_SIZE + 100U),
+                    SEEK_SET));
+  std::fputc(0x55, file);
+  std::fclose(file);
+  std::remove(INDEX_PATH.c_str());
+
+  const auto recovery = samplelog::Writer::Recover(PATH);
+  CHECK(recovery.blocks == 6U && recovery.entries == 1U);
+  Write(FIRST_SAMPLES, NEXT_SAMPLES);
+  // the entries after the bad block would not match their blocks
+  CHECK(Size(INDEX_PATH) == samplelog::INDEX_ENTRY_SIZE);
+  samplelog::Reader reader{PATH};
+  CHECK(reader.GetBlockCount() == 8U);
+  const auto samples = reader.Query(0U, UINT64_MAX, [](const auto&) {});
+  CHECK(samples == FIRST_SAMPLES + NEXT_SAMPLES - samplelog::BLOCK_CAPACITY);
+  CHECK(reader.GetErrors() == 1U);
+}
+} // namespace
+
+int main()
+{
+  TestWriteFaults();
+  TestBadBlock();
+  std::remove(PATH);
+  std::remove(INDEX_PATH.c_str());
+  std::puts("sample_log_fault_test passed");
+}
@@ -0,0 +1,143 @@
+#include "check.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <logic/logic.hpp>
+#include <memory>
+#include <message-queue/context.hpp>
+#include <message-queue/scheduler.hpp>
+#include <message-queue/virtual-clock.hpp>
+#include <vector>
+
+namespace {
+using namespace std::chrono_literals;
+constexpr mq::Addr TARGET{mq::Id::eLogic, 1};
+
+struct Seen {
+  int value;
+  mq::IClock::duration at;
+};
+
+/// Notes the value and the virtual time of every message to it
+class Sink final : public mq::ISystem {
+public:
+  Sink(const mq::IClock& clock, std::vector<Seen>& seen)
+    : m_clock{clock}, m_seen{seen}
+  {
+  }
+
+  void Process(const mq::Message& msg) override
+  {
+    m_seen.push_back(Seen{*std::any_cast<int>(&msg.data),
+                          m_clock.Now().time_since_epoch()});
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override { return TARGET.sys; }
+
+private:
+  const mq::IClock& m_clock;
+  std::vector<Seen>& m_seen;
+};
+
+/// Counts the reads at the virtual times, the weight never changes
+class FakeMeter final : public mq::ISystem {
+public:
+  FakeMeter(mq::IContext& ctx, const mq::IClock& clock)
+    : m_ctx{ctx}, m_clock{clock}
+  {
+  }
+
+  std::vector<mq::IClock::duration> reads;
+
+  void Process(const mq::Message& msg) override
+  {
+    if (msg.to.sys != GetId() ||
+        msg.to.ev != utils::EnumValue(WeightMeter::Event::eReadCmd))
+      return;
+    reads.push_back(m_clock.Now().time_since_epoch());
+    m_ctx.Push(mq::Message{msg.to, msg.from,
+                           WeightMeter::Reading{100.f,
+                                                {},
+                                                WeightMeter::Quality::eStable}},
+               0);
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eWeightMeter;
+  }
+
+private:
+  mq::IContext& m_ctx;
+  const mq::IClock& m_clock;
+};
+
+/// The deadlines are kept in the virtual time, the ties in their order
+void TestDeadlines()
+{
+  mq::VirtualClock clock;
+  mq::Context ctx;
+  mq::Scheduler scheduler{clock};
+  std::vector<Seen> seen;
+  ctx.AddSystem(std::make_shared<Sink>(clock, seen));
+
+  CHECK(!scheduler.GetNextDeadline());
+  scheduler.ScheduleAfter(mq::Message{mq::NONE, TARGET, 3}, 0, 3s);
+  scheduler.ScheduleAfter(mq::Message{mq::NONE, TARGET, 1}, 0, 1s);
+  scheduler.ScheduleAfter(mq::Message{mq::NONE, TARGET, 2}, 0, 1s);
+  CHECK(scheduler.GetNextDeadline() == mq::IClock::time_point{1s});
+
+  // nothing is due before the clock moves
+  scheduler.ProcessSchedule(ctx);
+  CHECK(!ctx.ProcessOneMessage());
+
+  CHECK(mq::Simulate(ctx, scheduler, clock, 2s) == 2U);
+  CHECK(clock.Now() == mq::IClock::time_point{2s});
+  CHECK(seen.size() == 2U);
+  CHECK(seen[0].value == 1 && seen[0].at == 1s);
+  CHECK(seen[1].value == 2 && seen[1].at == 1s);
+  CHECK(scheduler.GetNextDeadline() == mq::IClock::time_point{3s});
+
+  // a deadline in the past is due at once
+  scheduler.Schedule(mq::Message{mq::NONE, TARGET, 0}, 0,
+                     mq::IClock::time_point{});
+  CHECK(mq::Simulate(ctx, scheduler, clock, 0s) == 1U);
+  CHECK(seen.back().value == 0 && seen.back().at == 2s);
+
+  // a deadline on the end of the period is included
+  CHECK(mq::Simulate(ctx, scheduler, clock, 1s) == 1U);
+  CHECK(seen.back().value == 3 && seen.back().at == 3s);
+  CHECK(!scheduler.GetNextDeadline());
+}
+
+/// A 24 hour shift of the 5 s polling runs at the CPU speed
+void TestPollingShift()
+{
+  mq::VirtualClock clock;
+  mq::Context ctx;
+  mq::Scheduler scheduler{clock};
+  auto meter = std::make_shared<FakeMeter>(ctx, clock);
+  ctx.AddSystem(meter);
+  ctx.AddSystem(std::make_shared<Logic>(
+    ctx, scheduler, nullptr, Logic::Mode::ePoll,
+    std::vector<mq::Id>{mq::Id::eWeightMeter},
+    Logic::Polling{5s, 5s, 5.f}));
+
+  const auto start = std::chrono::steady_clock::now();
+  mq::Simulate(ctx, scheduler, clock, 24h);
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  // from the first poll at the start to the one at the end
+  CHECK(meter->reads.size() == 24U * 3600U / 5U + 1U);
+  for (std::size_t i{}; i < meter->reads.size(); ++i)
+    CHECK(meter->reads[i] == i * mq::IClock::duration{5s});
+  CHECK(clock.Now() == mq::IClock::time_point{24h});
+  std::printf("24 h of polling in %.1f ms\n",
+              std::chrono::duration<double, std::milli>(elapsed).count());
+}
+} // namespace
+
+int main()
+{
+  TestDeadlines();
+  TestPollingShift();
+  std::puts("scheduler_test passed");
+}
@@ -0,0 +1,23 @@
+#pragma once
+// the GPIO driver as the components use it, on the host nothing is attached
+#include <cstdint>
+
+typedef int gpio_num_t;
+typedef int gpio_int_type_t;
+typedef int gpio_pulldown_t;
+typedef int gpio_pullup_t;
+#define GPIO_PIN_INTR_DISABLE 0
+#define GPIO_MODE_OUTPUT 1
+#define GPIO_MODE_INPUT 2
+
+struct gpio_config_t {
+  gpio_int_type_t intr_type;
+  int mode;
+  std::uint64_t pin_bit_mask;
+  gpio_pulldown_t pull_down_en;
+  gpio_pullup_t pull_up_en;
+};
+
+inline int gpio_config(const gpio_config_t*) { return 0; }
+inline int gpio_get_level(gpio_num_t) { return 0; }
+inline int gpio_set_level(gpio_num_t, int) { return 0; }
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdio>
+
+// the host builds print the logs to stdout, the tag is dropped
+#define ESP_LOGE(tag, fmt, ...) std::printf("E " fmt "\n", ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) std::printf("W " fmt "\n", ##__VA_ARGS__)
+// HOST_LOG_QUIET drops the info logs of the long simulations
+#ifdef HOST_LOG_QUIET
+#define ESP_LOGI(tag, fmt, ...) ((void)0)
+#else
+#define ESP_LOGI(tag, fmt, ...) std::printf("I " fmt "\n", ##__VA_ARGS__)
+#endif
+#define ESP_LOGD(tag, fmt, ...) ((void)0)
+#define ESP_LOGV(tag, fmt, ...) ((void)0)
@@ -0,0 +1,2 @@
+#pragma once
+inline void ets_delay_us(unsigned) {}
@@ -0,0 +1,3 @@
+#pragma once
+#define portDISABLE_INTERRUPTS()
+#define portENABLE_INTERRUPTS()
@@ -0,0 +1,118 @@
+#include "check.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <mqtt-helper/loopback.hpp>
+#include <string>
+#include <vector>
+
+// A subscription is kept by a resumed session only once the broker has
+// acknowledged it, an unsubscription stays pending until it is sent
+namespace {
+using mqtt::InboundMessage;
+
+class FakeTransport final : public mqtt::ITransport {
+public:
+  mqtt::ITransportHandler* handler{};
+  bool refuseUnsubscribe{};
+  int lastId{};
+  std::vector<std::string> subscribed;
+  std::vector<std::string> unsubscribed;
+
+  void Start(mqtt::ITransportHandler& h) override
+  {
+    handler = &h;
+    h.OnConnected(false);
+  }
+  int Subscribe(const char* filter, mqtt::QoS) override
+  {
+    subscribed.emplace_back(filter);
+    return ++lastId;
+  }
+  int Unsubscribe(const char* filter) override
+  {
+    if (refuseUnsubscribe)
+      return ERROR_ID;
+    unsubscribed.emplace_back(filter);
+    return ++lastId;
+  }
+  int Publish(const char*, std::string_view, mqtt::QoS, bool) override
+  {
+    return ++lastId;
+  }
+  int Enqueue(const char*, std::string_view, mqtt::QoS, bool, bool) override
+  {
+    return ++lastId;
+  }
+};
+
+void TestFake()
+{
+  auto owned = std::make_unique<FakeTransport>();
+  auto& transport = *owned;
+  mqtt::Client client{std::move(owned)};
+
+  const auto acked = client.Subscribe("acked", mqtt::QoS::e1);
+  client.Subscribe("pending", mqtt::QoS::e1);
+  transport.handler->OnSubscribed(acked);
+  transport.handler->OnDisconnected();
+  transport.subscribed.clear();
+  transport.handler->OnConnected(true);
+  // the SUBACK of "pending" was lost with the connection
+  CHECK(transport.subscribed == std::vector<std::string>{"pending"});
+
+  // a SUBACK may come before the message ID is returned
+  transport.handler->OnSubscribed(transport.lastId + 1);
+  client.Subscribe("early", mqtt::QoS::e1);
+  transport.handler->OnSubscribed(transport.lastId - 1);
+  transport.handler->OnDisconnected();
+  transport.subscribed.clear();
+  transport.handler->OnConnected(true);
+  CHECK(transport.subscribed.empty());
+
+  transport.handler->OnDisconnected();
+  client.Unsubscribe("acked");
+  transport.refuseUnsubscribe = true;
+  transport.handler->OnConnected(true);
+  CHECK(transport.unsubscribed.empty());
+  transport.handler->OnDisconnected();
+  transport.refuseUnsubscribe = false;
+  transport.handler->OnConnected(true);
+  CHECK(transport.unsubscribed == std::vector<std::string>{"acked"});
+  transport.handler->OnDisconnected();
+  transport.handler->OnConnected(true);
+  CHECK(transport.unsubscribed.size() == 1U);
+}
+
+void TestLoopback()
+{
+  mqtt::LoopbackBroker broker;
+  auto owned = std::make_unique<mqtt::LoopbackTransport>(broker);
+  auto& transport = *owned;
+  auto client = std::make_unique<mqtt::Client>(std::move(owned));
+  broker.WaitIdle();
+
+  std::vector<std::string> received;
+  CHECK(client->AddFilterHandler("a/#", [&received](const InboundMessage& m) {
+    received.emplace_back(m.GetPayload());
+  }));
+  // the broker drops the SUBSCRIBE queued behind the disconnection
+  transport.Disconnect();
+  client->Subscribe("a/#", mqtt::QoS::e1);
+  broker.WaitIdle();
+  transport.Reconnect(true);
+  broker.WaitIdle();
+  client->Publish("a/b", "1", mqtt::QoS::e1);
+  broker.WaitIdle();
+  CHECK(received == std::vector<std::string>{"1"});
+  client.reset();
+}
+} // namespace
+
+int main()
+{
+  TestFake();
+  TestLoopback();
+  std::puts("subscription_test: ok");
+  return 0;
+}
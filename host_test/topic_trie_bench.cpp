@@ -0,0 +1,80 @@
+#include "check.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mqtt-helper/mqtt-helper.hpp>
+#include <mqtt-helper/topic-trie.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+// The dispatch of a topic to its handlers with 1 to 500 filters: through
+// the trie and through the linear #mqtt::MatchTopic scan the handlers used
+// before. The filters are the command topics of the scales of a plant, a
+// tenth of them with a wildcard, the topics are the ones they match.
+namespace {
+constexpr int ROUNDS = 200000;
+// the trie must win by more than that with the most filters
+constexpr double MIN_SPEEDUP = 2.;
+using Clock = std::chrono::steady_clock;
+
+std::string Filter(int i)
+{
+  const auto line = std::to_string(i / 10);
+  const auto scale = std::to_string(i % 10);
+  if (i % 10 == 9)
+    return "plant/line" + line + "/+/cmd/#";
+  return "plant/line" + line + "/scale" + scale + "/cmd/+";
+}
+
+std::string Topic(int i)
+{
+  return "plant/line" + std::to_string(i / 10) + "/scale" +
+         std::to_string(i % 10) + "/cmd/tare";
+}
+
+template<typename Dispatch>
+double Measure(const std::vector<std::string>& topics, Dispatch&& dispatch)
+{
+  long matched{};
+  const auto start = Clock::now();
+  for (int i{}; i < ROUNDS; ++i)
+    matched += dispatch(topics[static_cast<std::size_t>(i) % topics.size()]);
+  const std::chrono::duration<double, std::nano> time = Clock::now() - start;
+  CHECK(matched >= ROUNDS);
+  return time.count() / ROUNDS;
+}
+} // namespace
+
+int main()
+{
+  std::printf("filters  trie [ns]  scan [ns]\n");
+  double speedup{};
+  for (const auto count : {1, 10, 50, 100, 500}) {
+    std::vector<std::string> filters;
+    std::vector<std::string> topics;
+    mqtt::TopicTrie<int> trie;
+    for (int i{}; i < count; ++i) {
+      filters.push_back(Filter(i));
+      topics.push_back(Topic(i));
+      CHECK(trie.Insert(filters.back(), i));
+    }
+    std::shuffle(topics.begin(), topics.end(), std::mt19937{1U});
+
+    const auto byTrie = Measure(topics, [&trie](const std::string& topic) {
+      long matched{};
+      trie.Match(topic, [&matched](int) { ++matched; });
+      return matched;
+    });
+    const auto byScan = Measure(topics, [&filters](const std::string& topic) {
+      long matched{};
+      for (const auto& filter : filters)
+        matched += mqtt::MatchTopic(filter, topic);
+      return matched;
+    });
+    std::printf("%7d  %9.0f  %9.0f\n", count, byTrie, byScan);
+    speedup = byScan / byTrie;
+  }
+  CHECK(speedup > MIN_SPEEDUP);
+}
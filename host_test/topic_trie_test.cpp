@@ -0,0 +1,111 @@
+#include "check.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <mqtt-helper/mqtt-helper.hpp>
+#include <mqtt-helper/topic-trie.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+// The trie against the linear #mqtt::MatchTopic scan: the edge cases, then
+// random filters and topics over a small alphabet so that they collide
+namespace {
+/// The indices of the matching filters, sorted
+std::vector<int> ByTrie(mqtt::TopicTrie<int>& trie, const std::string& topic)
+{
+  std::vector<int> matched;
+  trie.Match(topic, [&matched](int i) { matched.push_back(i); });
+  std::sort(matched.begin(), matched.end());
+  return matched;
+}
+
+std::vector<int> ByScan(const std::vector<std::string>& filters,
+                        const std::string& topic)
+{
+  std::vector<int> matched;
+  for (std::size_t i{}; i < filters.size(); ++i)
+    if (mqtt::MatchTopic(filters[i], topic))
+      matched.push_back(static_cast<int>(i));
+  return matched;
+}
+
+void CheckSame(const std::vector<std::string>& filters,
+               const std::vector<std::string>& topics)
+{
+  mqtt::TopicTrie<int> trie;
+  for (std::size_t i{}; i < filters.size(); ++i)
+    CHECK(trie.Insert(filters[i], static_cast<int>(i)));
+  for (const auto& topic : topics)
+    if (ByTrie(trie, topic) != ByScan(filters, topic)) {
+      std::printf("mismatch on the topic \"%s\"\n", topic.c_str());
+      CHECK(false);
+    }
+}
+
+void TestEdgeCases()
+{
+  CheckSame({"#", "+", "+/#", "$SYS/#", "$SYS/+", "+/monitor", "a/#", "a",
+             "a/+", "a/+/#", "/", "/+", "+/+", "a//b", "a/+/b", "", "a/"},
+            {"$SYS", "$SYS/monitor", "$SYS/a/b", "$", "a$/x", "a", "a/",
+             "a/b", "a/b/c", "/", "//", "/a", "a//b", "a///b", "", "b"});
+
+  // the expectations themselves
+  mqtt::TopicTrie<int> trie;
+  trie.Insert("#", 0);
+  trie.Insert("a/#", 1);
+  trie.Insert("+/+", 2);
+  CHECK(ByTrie(trie, "$SYS/x").empty());
+  CHECK((ByTrie(trie, "a") == std::vector<int>{0, 1}));
+  CHECK((ByTrie(trie, "a/") == std::vector<int>{0, 1, 2}));
+  CHECK((ByTrie(trie, "/") == std::vector<int>{0, 2}));
+
+  // a removed filter does not match, the others still do
+  CHECK(trie.Erase("a/#") && !trie.Erase("a/#") && !trie.Erase("a"));
+  CHECK((ByTrie(trie, "a") == std::vector<int>{0}));
+}
+
+std::string Random(std::mt19937& rng, const std::vector<const char*>& levels,
+                   bool filter)
+{
+  std::string text;
+  const auto depth = 1U + rng() % 4U;
+  for (unsigned i{}; i < depth; ++i) {
+    if (i)
+      text += '/';
+    const std::string level = levels[rng() % levels.size()];
+    // "#" is the last level of a filter
+    if (level == "#" && (!filter || i + 1U != depth))
+      continue;
+    text += level;
+  }
+  return text;
+}
+
+void TestRandom()
+{
+  const std::vector<const char*> filterLevels{"a", "b", "$SYS", "", "+", "#"};
+  const std::vector<const char*> topicLevels{"a", "b", "$SYS", ""};
+  std::mt19937 rng{1U};
+  for (int round{}; round < 200; ++round) {
+    std::vector<std::string> filters;
+    for (int i{}; i < 20; ++i) {
+      auto filter = Random(rng, filterLevels, true);
+      if (std::find(filters.cbegin(), filters.cend(), filter) ==
+          filters.cend())
+        filters.push_back(std::move(filter));
+    }
+    std::vector<std::string> topics;
+    for (int i{}; i < 50; ++i)
+      topics.push_back(Random(rng, topicLevels, false));
+    CheckSame(filters, topics);
+  }
+}
+} // namespace
+
+int main()
+{
+  TestEdgeCases();
+  TestRandom();
+  std::puts("topic_trie_test passed");
+}
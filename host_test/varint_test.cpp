@@ -0,0 +1,29 @@
+#include "check.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <utils/varint.hpp>
+
+int main()
+{
+  std::array<std::uint8_t, varint::MAX_SIZE> buffer{};
+  std::uint64_t value{};
+  for (const std::uint64_t expected :
+       {std::uint64_t{0U}, std::uint64_t{127U}, std::uint64_t{128U},
+        std::uint64_t{1U} << 63U, UINT64_MAX}) {
+    const auto size = varint::Encode(expected, buffer);
+    CHECK(size && varint::Decode(gsl::span{buffer}.first(size), value) == size);
+    CHECK(value == expected);
+  }
+
+  // a 10th byte above 1 overflows 64 bits
+  CHECK(varint::Encode(UINT64_MAX, buffer) == varint::MAX_SIZE);
+  buffer.back() = 0x02U;
+  CHECK(!varint::Decode(buffer, value));
+  buffer.back() = 0x81U;
+  CHECK(!varint::Decode(buffer, value));
+  // truncated
+  CHECK(!varint::Decode(gsl::span{buffer}.first(9U), value));
+  std::puts("varint_test passed");
+}
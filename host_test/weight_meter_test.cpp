@@ -0,0 +1,425 @@
+#include "check.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <logic/logic.hpp>
+#include <message-queue/context.hpp>
+#include <message-queue/scheduler.hpp>
+#include <message-queue/virtual-clock.hpp>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <weight-meter/weight-meter.hpp>
+
+namespace {
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+/// The samples handed to a #FakeSource, kept by the test after the meter
+/// takes the source
+class Feed {
+public:
+  void Push(float grams)
+  {
+    {
+      std::scoped_lock lock{m_mutex};
+      m_samples.push_back(Sample{static_cast<std::uint32_t>(grams), grams});
+      m_idle = false;
+    }
+    m_cv.notify_all();
+  }
+
+  [[nodiscard]] std::optional<Sample> Pop(std::chrono::milliseconds timeout)
+  {
+    std::unique_lock lock{m_mutex};
+    if (m_samples.empty()) {
+      m_idle = true;
+      m_cv.notify_all();
+    }
+    if (!m_cv.wait_for(lock, timeout, [this] { return !m_samples.empty(); }))
+      return std::nullopt;
+    const auto sample = m_samples.front();
+    m_samples.pop_front();
+    return sample;
+  }
+
+  /// @brief Wait until the reader processed every sample and asks for more
+  void WaitIdle()
+  {
+    std::unique_lock lock{m_mutex};
+    m_cv.wait(lock, [this] { return m_idle; });
+  }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::deque<Sample> m_samples;
+  bool m_idle{};
+};
+
+/// Converts the fed samples, nothing is converted while nothing is fed as
+/// with a disconnected sensor
+class FakeSource final : public ISampleSource {
+public:
+  explicit FakeSource(std::shared_ptr<Feed> feed) : m_feed{std::move(feed)} {}
+
+  [[nodiscard]] std::optional<Sample>
+  Read(std::chrono::milliseconds timeout) override
+  {
+    return m_feed->Pop(timeout);
+  }
+
+private:
+  std::shared_ptr<Feed> m_feed;
+};
+
+/// Takes the replies to the test
+class Sink final : public mq::ISystem {
+public:
+  std::optional<WeightMeter::Reading> reading;
+
+  void Process(const mq::Message& msg) override
+  {
+    if (const auto* r = std::any_cast<WeightMeter::Reading>(&msg.data))
+      reading = *r;
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eLogic;
+  }
+};
+
+/// Notes the subscription updates at the virtual time
+class Subscriber final : public mq::ISystem {
+public:
+  struct Update {
+    WeightMeter::Reading reading;
+    mq::IClock::duration at;
+  };
+
+  explicit Subscriber(const mq::IClock& clock) : m_clock{clock} {}
+
+  std::vector<Update> updates;
+
+  void Process(const mq::Message& msg) override
+  {
+    if (msg.to.sys != GetId() ||
+        msg.from.ev != utils::EnumValue(WeightMeter::Event::eSubscribe))
+      return;
+    if (const auto* r = std::any_cast<WeightMeter::Reading>(&msg.data))
+      updates.push_back(Update{*r, m_clock.Now().time_since_epoch()});
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eLogic;
+  }
+
+private:
+  const mq::IClock& m_clock;
+};
+
+/// Notes the sender and the weight of every reading, whoever it goes to
+class Observer final : public mq::ISystem {
+public:
+  std::vector<std::pair<mq::Addr, WeightMeter::Reading>> readings;
+
+  void Process(const mq::Message& msg) override
+  {
+    if (const auto* r = std::any_cast<WeightMeter::Reading>(&msg.data))
+      readings.emplace_back(msg.from, *r);
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eNone;
+  }
+};
+
+/// Notes the capture stats sent to it
+class CaptureClient final : public mq::ISystem {
+public:
+  std::vector<Capture::Stats> stats;
+
+  void Process(const mq::Message& msg) override
+  {
+    if (const auto* s = std::any_cast<Capture::Stats>(&msg.data))
+      stats.push_back(*s);
+  }
+  [[nodiscard]] mq::Id GetId() const noexcept override
+  {
+    return mq::Id::eCommandServer;
+  }
+};
+
+double Ms(Clock::duration duration)
+{
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+/// The message loop stall of a read command at 10 SPS: answering it inline
+/// from an average of 10 conversions, as before, and from the acquired
+/// stream
+void TestReadStall()
+{
+  constexpr int AVG_SAMPLES = 10;
+  auto inlineFeed = std::make_shared<Feed>();
+  auto meterFeed = std::make_shared<Feed>();
+  std::atomic_bool feeding{true};
+  std::thread feeder{[&] {
+    while (feeding) {
+      inlineFeed->Push(500.f);
+      meterFeed->Push(500.f);
+      std::this_thread::sleep_for(100ms);
+    }
+  }};
+
+  FakeSource inlineSource{inlineFeed};
+  auto start = Clock::now();
+  float sum{};
+  for (int i{}; i < AVG_SAMPLES; ++i)
+    sum += inlineSource.Read(1s)->grams;
+  const auto inlineStall = Clock::now() - start;
+  CHECK(sum == 500.f * AVG_SAMPLES);
+
+  mq::Context ctx;
+  mq::Scheduler scheduler;
+  auto sink = std::make_shared<Sink>();
+  ctx.AddSystem(sink);
+  ctx.AddSystem(std::make_shared<WeightMeter>(
+    ctx, scheduler, std::make_unique<FakeSource>(meterFeed)));
+
+  Clock::duration stall{};
+  for (int i{}; i < 20; ++i) {
+    std::this_thread::sleep_for(50ms);
+    ctx.Push(mq::Message{mq::Addr{mq::Id::eLogic, 0},
+                         mq::Addr{mq::Id::eWeightMeter,
+                                  utils::EnumValue(
+                                    WeightMeter::Event::eReadCmd)},
+                         {}},
+             0);
+    start = Clock::now();
+    CHECK(ctx.ProcessOneMessage());
+    stall = std::max(stall, Clock::now() - start);
+    CHECK(ctx.ProcessOneMessage() && sink->reading);
+  }
+  feeding = false;
+  feeder.join();
+
+  // the window is full of the same weight by the end
+  CHECK(sink->reading->quality == WeightMeter::Quality::eStable);
+  CHECK(sink->reading->grams == 500.f);
+  std::printf("read command stall: inline %.1f ms, acquired %.3f ms\n",
+              Ms(inlineStall), Ms(stall));
+  CHECK(inlineStall > 800ms);
+  CHECK(stall < 50ms);
+}
+
+/// A sensor which never converts does not hold up the destructor
+void TestDisconnected()
+{
+  mq::Context ctx;
+  mq::Scheduler scheduler;
+  auto meter = std::make_unique<WeightMeter>(
+    ctx, scheduler, std::make_unique<FakeSource>(std::make_shared<Feed>()));
+  std::this_thread::sleep_for(250ms);
+  CHECK(meter->GetReading().quality == WeightMeter::Quality::eNoData);
+
+  const auto start = Clock::now();
+  meter.reset();
+  const auto join = Clock::now() - start;
+  std::printf("destructor with a disconnected sensor: %.1f ms\n", Ms(join));
+  CHECK(join < 1s);
+}
+/// Updates on the deadband and on the heartbeat only, not more often than
+/// the minimum interval
+void TestSubscription()
+{
+  mq::VirtualClock clock;
+  mq::Context ctx;
+  mq::Scheduler scheduler{clock};
+  auto subscriber = std::make_shared<Subscriber>(clock);
+  auto feed = std::make_shared<Feed>();
+  ctx.AddSystem(subscriber);
+  ctx.AddSystem(std::make_shared<WeightMeter>(
+    ctx, scheduler, std::make_unique<FakeSource>(feed)));
+  ctx.Push(mq::Message{mq::Addr{mq::Id::eLogic, 0},
+                       mq::Addr{mq::Id::eWeightMeter,
+                                utils::EnumValue(
+                                  WeightMeter::Event::eSubscribe)},
+                       WeightMeter::Subscription{100ms, 5s, 10.f}},
+           0);
+  const auto& updates = subscriber->updates;
+
+  // a sample every step, the updates the acquisition pushed are dispatched
+  // before the virtual time moves on
+  const auto step = [&](float grams, mq::IClock::duration period) {
+    feed->Push(grams);
+    feed->WaitIdle();
+    mq::Simulate(ctx, scheduler, clock, period);
+  };
+
+  // the first sample is sent at once, the stable average once settled
+  for (int i{}; i < 10; ++i)
+    step(500.f, 200ms);
+  CHECK(updates.size() == 2U);
+  CHECK(updates[0].at == 0ms);
+  CHECK(updates[1].reading.quality == WeightMeter::Quality::eStable &&
+        updates[1].reading.grams == 500.f);
+  const auto settled = updates[1].at;
+
+  // an idle scale within the deadband sends the heartbeats only
+  for (int i{}; i < 60; ++i)
+    step(i % 2 ? 501.f : 499.f, 200ms);
+  CHECK(updates.size() == 4U);
+  CHECK(updates[2].at == settled + 5s && updates[3].at == settled + 10s);
+
+  // a step is sent by its first sample, which unsettles the average
+  const auto moved = clock.Now().time_since_epoch();
+  step(550.f, 200ms);
+  CHECK(updates.size() == 5U && updates[4].at == moved);
+  CHECK(updates[4].reading.quality == WeightMeter::Quality::eUnstable);
+  // and by the deadband until it settles again
+  for (int i{}; i < 9; ++i)
+    step(550.f, 200ms);
+  CHECK(updates.back().reading.grams == 550.f);
+  CHECK(updates.back().reading.quality == WeightMeter::Quality::eStable);
+
+  // a fast moving weight is sent at the minimum interval at most
+  const auto first = updates.size();
+  for (int i{}; i < 100; ++i)
+    step(550.f + 5.f * static_cast<float>(i), 10ms);
+  CHECK(updates.size() >= first + 9U);
+  for (auto i = first; i < updates.size(); ++i)
+    CHECK(updates[i].at - updates[i - 1U].at >= 100ms);
+
+  // the stopped conversions are reported as stale within twice the bound
+  const auto stopped = clock.Now().time_since_epoch();
+  const auto last = updates.size();
+  mq::Simulate(ctx, scheduler, clock, 3s);
+  CHECK(updates.size() > last);
+  CHECK(updates.back().reading.quality == WeightMeter::Quality::eStale);
+  CHECK(updates.back().at <= stopped + 2s);
+}
+/// Two scales behind the instance IDs, a Logic subscribed to both
+void TestInstances()
+{
+  const auto first = mq::MakeId(mq::Id::eWeightMeter, 0);
+  const auto second = mq::MakeId(mq::Id::eWeightMeter, 1);
+  mq::VirtualClock clock;
+  mq::Context ctx;
+  mq::Scheduler scheduler{clock};
+  auto observer = std::make_shared<Observer>();
+  auto firstFeed = std::make_shared<Feed>();
+  auto secondFeed = std::make_shared<Feed>();
+  ctx.AddSystem(observer);
+  ctx.AddSystem(std::make_shared<WeightMeter>(
+    ctx, scheduler, std::make_unique<FakeSource>(firstFeed), 0));
+  ctx.AddSystem(std::make_shared<WeightMeter>(
+    ctx, scheduler, std::make_unique<FakeSource>(secondFeed), 1));
+  ctx.AddSystem(std::make_shared<Logic>(ctx, scheduler, nullptr,
+                                        Logic::Mode::eSubscribe,
+                                        std::vector<mq::Id>{first, second}));
+  mq::Simulate(ctx, scheduler, clock, 0ms);
+
+  for (int i{}; i < 10; ++i) {
+    firstFeed->Push(500.f);
+    secondFeed->Push(1000.f);
+    firstFeed->WaitIdle();
+    secondFeed->WaitIdle();
+    mq::Simulate(ctx, scheduler, clock, 200ms);
+  }
+  // the updates of both meters, each with its own weight
+  std::size_t fromFirst{};
+  std::size_t fromSecond{};
+  for (const auto& [from, reading] : observer->readings) {
+    CHECK(from.sys == first || from.sys == second);
+    if (reading.quality == WeightMeter::Quality::eNoData)
+      continue;
+    CHECK(reading.grams == (from.sys == first ? 500.f : 1000.f));
+    fromFirst += from.sys == first;
+    fromSecond += from.sys == second;
+  }
+  CHECK(fromFirst && fromSecond);
+
+  // a read command is routed to its instance only, from a system the
+  // Logic does not take the replies of
+  observer->readings.clear();
+  ctx.Push(mq::Message{mq::Addr{mq::Id::eMqttBridge, 0},
+                       mq::Addr{second, utils::EnumValue(
+                                          WeightMeter::Event::eReadCmd)},
+                       {}},
+           0);
+  while (ctx.ProcessOneMessage()) {}
+  CHECK(observer->readings.size() == 1U);
+  CHECK(observer->readings[0].first.sys == second);
+  CHECK(observer->readings[0].second.grams == 1000.f);
+}
+/// A rejected or failing capture request does not stop the running capture
+void TestCaptureRestart()
+{
+  constexpr const char* FIRST = "weight_meter_test_1.bin";
+  constexpr const char* SECOND = "weight_meter_test_2.bin";
+  mq::VirtualClock clock;
+  mq::Context ctx;
+  mq::Scheduler scheduler{clock};
+  auto client = std::make_shared<CaptureClient>();
+  auto feed = std::make_shared<Feed>();
+  ctx.AddSystem(client);
+  ctx.AddSystem(std::make_shared<WeightMeter>(
+    ctx, scheduler, std::make_unique<FakeSource>(feed)));
+
+  const auto start = [&](const char* path, std::chrono::seconds duration) {
+    ctx.Push(mq::Message{mq::Addr{mq::Id::eCommandServer, 0},
+                         mq::Addr{mq::Id::eWeightMeter,
+                                  utils::EnumValue(
+                                    WeightMeter::Event::eStartCapture)},
+                         WeightMeter::CaptureRequest{path, duration}},
+             0);
+    mq::Simulate(ctx, scheduler, clock, 0ms);
+  };
+  const auto sample = [&] {
+    feed->Push(500.f);
+    feed->WaitIdle();
+    mq::Simulate(ctx, scheduler, clock, 10ms);
+  };
+
+  start(FIRST, 60s);
+  sample();
+  start(FIRST, Capture::MAX_DURATION + 1s);
+  sample();
+  start("no-such-dir/weight_meter_test.bin", 60s);
+  sample();
+  // both failed, the first capture got every sample
+  CHECK(client->stats.size() == 2U);
+  CHECK(client->stats[0].failed && client->stats[1].failed);
+
+  start(SECOND, 60s);
+  CHECK(client->stats.size() == 3U);
+  CHECK(!client->stats[2].failed && client->stats[2].samples == 3U);
+  sample();
+  // the same file is started over
+  start(SECOND, 60s);
+  CHECK(client->stats.size() == 4U && client->stats[3].samples == 1U);
+  sample();
+  sample();
+  mq::Simulate(ctx, scheduler, clock, 60s);
+  CHECK(client->stats.size() == 5U && client->stats[4].samples == 2U);
+  std::remove(FIRST);
+  std::remove(SECOND);
+}
+} // namespace
+
+int main()
+{
+  TestReadStall();
+  TestDisconnected();
+  TestSubscription();
+  TestInstances();
+  TestCaptureRestart();
+  std::puts("weight_meter_test passed");
+}
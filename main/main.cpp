@@ -1,8 +1,11 @@
 #include <chrono>
+#include <cstdint>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <hx711/hx711.hpp>
+#include <logger/logger.hpp>
 #include <filter/filter.hpp>
 #include <push-button/push-button.hpp>
 #include <memory>
@@ -13,6 +16,7 @@
 #include <string>
 #include <thread>
 #include <nvs_flash.h>
+#include <sample-log/writer.hpp>
 #include "sdmmc_cmd.h"
 #include "driver/sdmmc_host.h"
 #include <sys/unistd.h>
@@ -52,6 +56,19 @@ try
 
 #define MOUNT_POINT "/sdcard"
 
+// The timer starts over at every boot and the blocks of a sample log are in
+// time order, so every boot gets a new log and the old ones stay
+static std::string NewSampleLogPath()
+{
+    for (unsigned n{};; ++n) {
+        auto path = std::string{MOUNT_POINT"/samples-"} + std::to_string(n) +
+                    ".slg";
+        struct stat info{};
+        if (stat(path.c_str(), &info))
+            return path;
+    }
+}
+
 
 extern "C" void app_main(void)
 try 
@@ -68,7 +85,7 @@ try
         .format_if_mount_failed = false,
 #endif // EXAMPLE_FORMAT_IF_MOUNT_FAILED
         .max_files = 5,
-        .allocation_unit_size = 16 * 1024
+        .allocation_unit_size = Logger::CLUSTER_SIZE
     };
     sdmmc_card_t *card;
     const char mount_point[] = MOUNT_POINT;
@@ -129,60 +146,23 @@ try
     // Card has been initialized, print its properties
     sdmmc_card_print_info(stdout, card);
 
-    // Use POSIX and C standard library functions to work with files:
-
-    // First create a file.
-    const char *file_hello = MOUNT_POINT"/hello.txt";
-
-    ESP_LOGI(TAG, "Opening file %s", file_hello);
-    FILE *f = fopen(file_hello, "w");
-    if (f == NULL) {
-        ESP_LOGE(TAG, "Failed to open file for writing");
-        return;
-    }
-    fprintf(f, "Hello %s!\n", card->cid.name);
-    fclose(f);
-    ESP_LOGI(TAG, "File written");
-
-    const char *file_foo = MOUNT_POINT"/foo.txt";
-
-    // Check if destination file exists before renaming
-    struct stat st;
-    if (stat(file_foo, &st) == 0) {
-        // Delete it if it exists
-        unlink(file_foo);
+    // The card stays mounted and the raw conversions go to a new sample log
+    // at every boot. The writer packs them into blocks of the
+    // allocation unit size above and its logger writes the full ones in the
+    // background, so a slow card never stalls the ADC.
+    const auto hx711 = std::make_unique<Hx711>(
+        static_cast<gpio_num_t>(CONFIG_DATA_PIN),
+        static_cast<gpio_num_t>(CONFIG_SCLK_PIN), Hx711::Gain::e128);
+    const auto samplesPath = NewSampleLogPath();
+    samplelog::Writer samples{samplesPath, 0U, Logger::DEFAULT_CONFIG};
+    ESP_LOGI(TAG, "Sampling to %s", samplesPath.c_str());
+    for (unsigned drops{};;) {
+        const samplelog::Sample sample{
+            static_cast<std::uint64_t>(esp_timer_get_time()),
+            static_cast<std::int32_t>(hx711->Read())};
+        if (!samples.Add(sample) && !(drops++ % 1000U))
+            ESP_LOGW(TAG, "%u samples dropped", drops);
     }
-
-    // Rename original file
-    ESP_LOGI(TAG, "Renaming file %s to %s", file_hello, file_foo);
-    if (rename(file_hello, file_foo) != 0) {
-        ESP_LOGE(TAG, "Rename failed");
-        return;
-    }
-
-    // Open renamed file for reading
-    ESP_LOGI(TAG, "Reading file %s", file_foo);
-    f = fopen(file_foo, "r");
-    if (f == NULL) {
-        ESP_LOGE(TAG, "Failed to open file for reading");
-        return;
-    }
-
-    // Read a line from file
-    char line[64];
-    fgets(line, sizeof(line), f);
-    fclose(f);
-
-    // Strip newline
-    char *pos = strchr(line, '\n');
-    if (pos) {
-        *pos = '\0';
-    }
-    ESP_LOGI(TAG, "Read from file: '%s'", line);
-
-    // All done, unmount partition and disable SDMMC peripheral
-    esp_vfs_fat_sdcard_unmount(mount_point, card);
-    ESP_LOGI(TAG, "Card unmounted");
 } catch (const std::exception &e) {
   ESP_LOGE("Unhandled exception", "%s", e.what());
   std::this_thread::sleep_for(std::chrono::seconds{5U});
@@ -0,0 +1,120 @@
+// Print a message log written by mq::Recorder and the queue build-up in it:
+// the push to dispatch latency and the queue depth per destination system.
+//
+//   mq_log <log> [--records]
+//
+// It is built by host_test/CMakeLists.txt. To feed a log back into the
+// systems themselves, add them to a context on the host and run an
+// mq::Replayer over it, see host_test/replay_test.cpp.
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <map>
+#include <message-queue/replayer.hpp>
+#include <tuple>
+#include <utils/utils.hpp>
+#include <vector>
+
+namespace {
+struct Stats {
+  std::uint64_t pushes{};
+  std::uint64_t dispatches{};
+  std::size_t depth{};
+  std::size_t maxDepth{};
+  std::vector<std::int64_t> latencies; // us
+  // the pending push times by the address and the payload
+  std::map<std::tuple<std::uint16_t, std::uint8_t, mq::PayloadCodec::Bytes>,
+           std::deque<std::int64_t>>
+    pending;
+};
+
+const char* KindName(mq::Record::Kind kind)
+{
+  return kind == mq::Record::Kind::ePush ? "push" : "dispatch";
+}
+
+void PrintRecord(const mq::Record& record)
+{
+  std::printf("%12" PRId64 " %-8s %3u %04x:%-5u -> %04x:%-5u tag %3u %4u B\n",
+              static_cast<std::int64_t>(record.timestamp.count()),
+              KindName(record.kind), record.priority,
+              utils::EnumValue(record.from.sys), record.from.ev,
+              utils::EnumValue(record.to.sys), record.to.ev, record.tag,
+              static_cast<unsigned>(record.payload.size()));
+}
+
+std::int64_t Percentile(std::vector<std::int64_t>& values, unsigned p)
+{
+  if (values.empty())
+    return 0;
+  const auto n = (values.size() - 1U) * p / 100U;
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  if (argc < 2 || (argc == 3 && std::strcmp(argv[2], "--records")) ||
+      argc > 3) {
+    std::fprintf(stderr, "usage: %s <log> [--records]\n", argv[0]);
+    return 2;
+  }
+
+  try {
+    mq::LogReader reader{argv[1]};
+    std::map<std::uint16_t, Stats> bySystem;
+    std::uint64_t records{};
+    std::int64_t last{};
+
+    while (auto record = reader.Next()) {
+      ++records;
+      last = record->timestamp.count();
+      if (argc == 3)
+        PrintRecord(*record);
+
+      // a message is dispatched once, the broadcasts are skipped
+      if (record->to.sys == mq::Id::eAll || record->to.sys == mq::Id::eNone)
+        continue;
+      auto& stats = bySystem[utils::EnumValue(record->to.sys)];
+      auto& pending = stats.pending[{record->to.ev, record->tag,
+                                     std::move(record->payload)}];
+      if (record->kind == mq::Record::Kind::ePush) {
+        ++stats.pushes;
+        pending.push_back(last);
+        stats.maxDepth = std::max(++stats.depth, stats.maxDepth);
+      }
+      else if (!pending.empty()) {
+        ++stats.dispatches;
+        stats.latencies.push_back(last - pending.front());
+        pending.pop_front();
+        --stats.depth;
+      }
+    }
+
+    std::printf("%" PRIu64 " records over %.3f s\n", records, last / 1e6);
+    std::printf("system  pushes dispatches depth  latency p50/p99/max [us]\n");
+    for (auto& [sys, stats] : bySystem) {
+      auto& latencies = stats.latencies;
+      const auto max = latencies.empty()
+                         ? 0
+                         : *std::max_element(latencies.cbegin(),
+                                             latencies.cend());
+      const auto p50 = Percentile(latencies, 50U);
+      const auto p99 = Percentile(latencies, 99U);
+      std::printf("%04x %9" PRIu64 " %10" PRIu64 " %5zu  %" PRId64 "/%" PRId64
+                  "/%" PRId64 "\n",
+                  sys, stats.pushes, stats.dispatches, stats.maxDepth, p50,
+                  p99, max);
+    }
+  }
+  catch (const std::exception& e) {
+    std::fprintf(stderr, "%s: %s\n", argv[1], e.what());
+    return 1;
+  }
+}
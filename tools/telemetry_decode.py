@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""Decode the binary weight telemetry frames (components/telemetry).
+
+Usable as a module (decode_frame) or as a command line tool that prints the
+samples of the frame files given as arguments, or of stdin, as CSV.
+"""
+import argparse
+import struct
+import sys
+
+MAGIC = 0xB7
+VERSION = 1
+HEADER = struct.Struct('<BBIBQfH')
+
+
+def _varint(data, offset):
+    value = 0
+    for i in range(10):
+        if offset + i >= len(data):
+            break
+        byte = data[offset + i]
+        value |= (byte & 0x7F) << (7 * i)
+        if not byte & 0x80:
+            return value, offset + i + 1
+    raise ValueError('the telemetry frame is truncated')
+
+
+def _unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_frame(data):
+    """Return (header dict, [(timestamp ms, value in scale units), ...])."""
+    if len(data) < HEADER.size:
+        raise ValueError('the frame is shorter than the header')
+    magic, version, device, channel, base, scale, count = \
+        HEADER.unpack_from(data)
+    if magic != MAGIC:
+        raise ValueError('not a telemetry frame')
+    if version != VERSION:
+        raise ValueError('unsupported telemetry frame version')
+    header = {'device': device, 'channel': channel, 'base': base,
+              'scale': scale, 'count': count}
+    samples = []
+    offset = HEADER.size
+    timestamp, value = base, 0
+    for _ in range(count):
+        dt, offset = _varint(data, offset)
+        dv, offset = _varint(data, offset)
+        timestamp += _unzigzag(dt)
+        value += _unzigzag(dv)
+        samples.append((timestamp, value * scale))
+    return header, samples
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('frames', nargs='*', help='frame files, stdin if none')
+    args = parser.parse_args()
+
+    print('device,channel,timestamp_ms,value')
+    sources = args.frames or [None]
+    for path in sources:
+        if path is None:
+            data = bytearray(sys.stdin.buffer.read())
+        else:
+            with open(path, 'rb') as frame:
+                data = bytearray(frame.read())
+        header, samples = decode_frame(data)
+        for timestamp, value in samples:
+            print('{},{},{},{:g}'.format(header['device'], header['channel'],
+                                         timestamp, value))
+
+
+if __name__ == '__main__':
+    main()